@@ -0,0 +1,20 @@
+// Memory bound: copies a buffer back and forth through the RAM
+#define WORDS 1024
+#define PASSES 32
+
+int main() {
+    int* volatile a = (int*)0x10000000;
+    int* volatile b = (int*)0x10001000;
+    for (int i = 0; i < WORDS; i++) {
+        a[i] = i;
+    }
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < WORDS; i++) {
+            b[i] = a[i] + 1;
+        }
+        for (int i = 0; i < WORDS; i++) {
+            a[i] = b[i];
+        }
+    }
+    return a[WORDS - 1];
+}
@@ -0,0 +1,15 @@
+// Interrupt bound: makes the timer interrupt pending again as soon as the trap handler of crt0.S
+// has moved the comparator into the future
+#define INTERRUPTS 1000
+
+int main() {
+    int* volatile mtimecmp = (int*)0x80000018;
+    int taken = 0;
+    for (int i = 0; i < INTERRUPTS; i++) {
+        mtimecmp[0] = 0;
+        while (mtimecmp[0] == 0) {
+        }
+        taken++;
+    }
+    return taken;
+}
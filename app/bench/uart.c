@@ -0,0 +1,14 @@
+// MMIO bound: polls the UART status register before every character it sends
+#define CHARACTERS 4096
+
+int main() {
+    int* volatile uart = (int*)0x90000000;
+    int sent = 0;
+    for (int i = 0; i < CHARACTERS; i++) {
+        while (!(uart[3] & (1 << 5))) {
+        }
+        uart[0] = 'a' + i % 26;
+        sent++;
+    }
+    return sent;
+}
@@ -29,7 +29,37 @@ entity eisv_core is
         dmem_byte_enable_o : out byte_flag_t;
         -- System Interface
         external_interrupt_pending_i : in std_ulogic;
-        timer_interrupt_pending_i : in std_ulogic
+        timer_interrupt_pending_i : in std_ulogic;
+        -- Architectural State Interface (simulation checkpoints)
+        -- state_halt_i stops issuing instructions, state_halted_o is set once the pipeline has
+        -- drained and the state read through state_sel_i/state_rdata_o is consistent. The PC is
+        -- the next instruction to execute. Writes are only accepted during reset, the reset values
+        -- are not applied while state_wen_i is set, so the state can be written in consecutive
+        -- cycles before releasing the reset.
+        -- state_sel_i: 0 = PC, 1 to 31 = x1 to x31, 32 + n = special CSR at position n of
+        -- special_csr_t (see eisv_csrs for the format)
+        state_halt_i : in std_ulogic := '0';
+        state_halted_o : out std_ulogic;
+        state_sel_i : in std_ulogic_vector(5 downto 0) := (others => '0');
+        state_wen_i : in std_ulogic := '0';
+        state_wdata_i : in word_t := (others => '0');
+        state_rdata_o : out word_t;
+        -- Retire Interface (simulation lockstep checking), at most one event per cycle:
+        -- retire_valid_o: the instruction at retire_pc_o completed. retire_rd_o (R0 if none) is
+        -- written with retire_rd_value_o, a non-zero retire_store_byte_enable_o marks a store of
+        -- retire_store_data_o to the word at retire_store_addr_o.
+        -- retire_trap_o: the trap handler was entered, retire_pc_o is mepc and retire_rd_value_o
+        -- is mcause. Reported in the cycle after the jump, once both are written.
+        -- retire_trap_return_o: mret returned to retire_pc_o, reported like a trap.
+        retire_valid_o : out std_ulogic;
+        retire_trap_o : out std_ulogic;
+        retire_trap_return_o : out std_ulogic;
+        retire_pc_o : out mem_addr_t;
+        retire_rd_o : out rf_addr_t;
+        retire_rd_value_o : out word_t;
+        retire_store_addr_o : out mem_addr_t;
+        retire_store_data_o : out word_t;
+        retire_store_byte_enable_o : out byte_flag_t
     );
 end entity;
 
@@ -92,6 +122,7 @@ architecture rtl of eisv_core is
 
     signal epc : mem_addr_t;
     signal mtvec : mem_addr_t;
+    signal mcause : word_t;
     signal mstatus_mie : std_ulogic;
     signal mie_mtie, mie_meie : std_ulogic;
 
@@ -101,6 +132,21 @@ architecture rtl of eisv_core is
     signal pipeline_control_write_mtval_value : mem_addr_t;
     signal pipeline_control_interrupt_stack_push : std_ulogic;
 
+    signal state_pc_wen : std_ulogic;
+    signal state_rf_wen : std_ulogic;
+    signal state_rf_rdata : word_t;
+    signal state_csr_sel : special_csr_t;
+    signal state_csr_wen : std_ulogic;
+    signal state_csr_rdata : word_t;
+
+    signal retire_trap_ff : std_ulogic;
+    signal retire_trap_return_ff : std_ulogic;
+    signal retire_store_addr_ff : mem_addr_t;
+    signal retire_store_data_ff : word_t;
+    signal retire_store_byte_enable_ff : byte_flag_t;
+
+    signal hpm_events : hpm_events_t;
+
 begin
 
     -- Shared components
@@ -119,7 +165,11 @@ begin
         wp1_data_i => wb_wp1_data,
         wp2_addr_i => (others => '0'),
         wp2_enable_i => '0',
-        wp2_data_i => (others => '0')
+        wp2_data_i => (others => '0'),
+        state_addr_i => rf_addr_t(state_sel_i(4 downto 0)),
+        state_wen_i => state_rf_wen,
+        state_wdata_i => state_wdata_i,
+        state_rdata_o => state_rf_rdata
     );
 
     csrs_inst: entity eisv.eisv_csrs
@@ -143,12 +193,19 @@ begin
         write_mtval_value_i => pipeline_control_write_mtval_value,
         epc_o => epc,
         mtvec_o => mtvec,
+        mcause_o => mcause,
         mstatus_mie_o => mstatus_mie,
         mie_mtie_o => mie_mtie,
         mie_meie_o => mie_meie,
         trap_enter_i => controller_jump_trap_handler,
         trap_leave_i => controller_jump_trap_return,
-        trap_cause_i => controller_trap_cause_out
+        trap_cause_i => controller_trap_cause_out,
+        instret_i => wb_ctrl.valid,
+        hpm_events_i => hpm_events,
+        state_sel_i => state_csr_sel,
+        state_wen_i => state_csr_wen,
+        state_wdata_i => state_wdata_i,
+        state_rdata_o => state_csr_rdata
      );
 
     controller_inst: entity eisv.eisv_controller
@@ -218,6 +275,12 @@ begin
             if_pipeline_mux_sel <= HOLD;
         end if;
 
+        -- IF halt, keeps refetching the next instruction and if_valid prevents issuing it. An
+        -- instruction held back by a stall is issued first, so the PC has to progress past it.
+        if state_halt_i and not hazard_reg.stall then
+            if_pipeline_mux_sel <= HOLD;
+        end if;
+
         -- DE illegal instruction
         if if_valid and not de_ctrl_out.valid then
             controller_trap <= '1';
@@ -331,8 +394,83 @@ begin
         end if;
     end process;
 
+    -- Architectural state port
+    state_select : process (all) is
+        variable index : natural;
+    begin
+        index := to_integer(unsigned(state_sel_i));
+
+        state_pc_wen <= '0';
+        state_rf_wen <= '0';
+        state_csr_wen <= '0';
+        state_csr_sel <= MHARTID;
+        state_rdata_o <= (others => '0');
+
+        if index = 0 then
+            state_pc_wen <= state_wen_i;
+            state_rdata_o <= word_t(if_pipeline_reg.pc);
+        elsif index < 32 then
+            state_rf_wen <= state_wen_i;
+            state_rdata_o <= state_rf_rdata;
+        elsif index - 32 <= special_csr_t'pos(special_csr_t'high) then
+            state_csr_sel <= special_csr_t'val(index - 32);
+            state_csr_wen <= state_wen_i;
+            state_rdata_o <= state_csr_rdata;
+        end if;
+    end process;
+
+    state_halted_o <= state_halt_i and not hazard_reg.stall and not controller_flushing and
+                      not (ex_ctrl.valid or ex_ctrl.flush) and
+                      not (mem_ctrl.valid or mem_ctrl.flush) and
+                      not (wb_ctrl.valid or wb_ctrl.flush);
+
     controller_flushed <= wb_ctrl.flush;
 
+    -- Retire port, the store of an instruction is issued by the MEM stage one cycle before it
+    -- retires
+    retire_seq : process (clk_i) is
+    begin
+        if rising_edge(clk_i) then
+            if rst_ni then
+                retire_trap_ff <= controller_jump_trap_handler;
+                retire_trap_return_ff <= controller_jump_trap_return;
+            else
+                retire_trap_ff <= '0';
+                retire_trap_return_ff <= '0';
+            end if;
+
+            retire_store_addr_ff <= dmem_addr_o;
+            retire_store_data_ff <= dmem_wdata_o;
+            retire_store_byte_enable_ff <= dmem_byte_enable_o when dmem_wen_o else (others => '0');
+        end if;
+    end process;
+
+    retire_valid_o <= wb_ctrl.valid;
+    retire_trap_o <= retire_trap_ff;
+    retire_trap_return_o <= retire_trap_return_ff;
+    retire_pc_o <= mem_pipeline_reg.pc when wb_ctrl.valid else epc;
+    retire_rd_o <= mem_pipeline_reg.rd when wb_ctrl.rf_wp1_enable else R0;
+    retire_rd_value_o <= wb_wp1_data when wb_ctrl.valid else mcause;
+    retire_store_addr_o <= retire_store_addr_ff;
+    retire_store_data_o <= retire_store_data_ff;
+    retire_store_byte_enable_o <= retire_store_byte_enable_ff;
+
+    -- Performance counter events, stalls only count if an instruction is waiting in DE
+    hpm_event_select : process (all) is
+    begin
+        hpm_events <= (others => '0');
+        hpm_events(HPM_LOAD_USE_STALL) <= if_valid and hazard_out.load_use_stall;
+        hpm_events(HPM_CSR_STALL) <= if_valid and hazard_out.csr_stall;
+        hpm_events(HPM_JUMP_BUBBLE) <= not if_fetch_valid_ff;
+        hpm_events(HPM_FLUSH_BUBBLE) <= if_bubble_reg and if_fetch_valid_ff;
+        hpm_events(HPM_JUMP_TAKEN) <= ex_ctrl.jump and ex_pipeline_out.condition;
+        hpm_events(HPM_MUL) <= wb_ctrl.valid when wb_ctrl.eu_result_sel = MULTIPLIER else '0';
+        hpm_events(HPM_DIV) <= wb_ctrl.valid when wb_ctrl.eu_result_sel = DIVIDER else '0';
+        hpm_events(HPM_LOAD) <= wb_ctrl.valid and wb_ctrl.memory_access and not wb_ctrl.memory_store;
+        hpm_events(HPM_STORE) <= wb_ctrl.valid and wb_ctrl.memory_access and wb_ctrl.memory_store;
+        hpm_events(HPM_TRAP) <= controller_jump_trap_handler;
+    end process;
+
     -- Stage 0 (PC)
     s0 : process (clk_i) is
     begin
@@ -343,7 +481,12 @@ begin
                 if_pipeline_reg <= if_pipeline_out;
             else
                 if_fetch_valid_ff <= '0';
-                if_pipeline_reg.pc <= (others => '0');
+                if not state_wen_i then
+                    if_pipeline_reg.pc <= (others => '0');
+                end if;
+                if state_pc_wen then
+                    if_pipeline_reg.pc <= mem_addr_t(state_wdata_i);
+                end if;
             end if;
         end if;
     end process;
@@ -398,7 +541,9 @@ begin
     instr_rdata_nxt <= instr_rdata_ff when hazard_reg.stall else imem_rdata_i;
     if_instr_rdata <= instr_rdata_ff when hazard_reg.stall else imem_rdata_i;
     if_pc <= de_pipeline_reg.pc when hazard_reg.stall else if_pipeline_reg.pc;
-    if_valid <= if_fetch_valid_ff and not if_bubble_reg;
+    -- While halting only an instruction held back by a stall is still issued
+    if_valid <= if_fetch_valid_ff and not if_bubble_reg and
+                (not state_halt_i or hazard_reg.stall);
 
     de_stage_inst : entity eisv.eisv_de_stage
      port map(
@@ -26,7 +26,24 @@ entity eisv_core_wrapper is
         dmem_wdata_o : out std_ulogic_vector(31 downto 0);
         dmem_byte_enable_o : out std_ulogic_vector(3 downto 0);
         external_interrupt_pending_i : in std_ulogic;
-        timer_interrupt_pending_i : in std_ulogic
+        timer_interrupt_pending_i : in std_ulogic;
+        -- Architectural state for simulation checkpoints, see eisv_core. May be left unconnected.
+        state_halt_i : in std_ulogic := '0';
+        state_halted_o : out std_ulogic;
+        state_sel_i : in std_ulogic_vector(5 downto 0) := (others => '0');
+        state_wen_i : in std_ulogic := '0';
+        state_wdata_i : in std_ulogic_vector(31 downto 0) := (others => '0');
+        state_rdata_o : out std_ulogic_vector(31 downto 0);
+        -- Retired instructions for lockstep checking, see eisv_core. May be left unconnected.
+        retire_valid_o : out std_ulogic;
+        retire_trap_o : out std_ulogic;
+        retire_trap_return_o : out std_ulogic;
+        retire_pc_o : out std_ulogic_vector(31 downto 0);
+        retire_rd_o : out std_ulogic_vector(4 downto 0);
+        retire_rd_value_o : out std_ulogic_vector(31 downto 0);
+        retire_store_addr_o : out std_ulogic_vector(31 downto 0);
+        retire_store_data_o : out std_ulogic_vector(31 downto 0);
+        retire_store_byte_enable_o : out std_ulogic_vector(3 downto 0)
     );
 end entity;
 
@@ -36,6 +53,13 @@ architecture rtl of eisv_core_wrapper is
     signal dmem_addr : mem_addr_t;
     signal dmem_wdata : word_t;
     signal dmem_byte_enable : byte_flag_t;
+    signal state_rdata : word_t;
+    signal retire_pc : mem_addr_t;
+    signal retire_rd : rf_addr_t;
+    signal retire_rd_value : word_t;
+    signal retire_store_addr : mem_addr_t;
+    signal retire_store_data : word_t;
+    signal retire_store_byte_enable : byte_flag_t;
 
 begin
 
@@ -56,12 +80,34 @@ begin
         dmem_wdata_o => dmem_wdata,
         dmem_byte_enable_o => dmem_byte_enable,
         external_interrupt_pending_i => external_interrupt_pending_i,
-        timer_interrupt_pending_i => timer_interrupt_pending_i
+        timer_interrupt_pending_i => timer_interrupt_pending_i,
+        state_halt_i => state_halt_i,
+        state_halted_o => state_halted_o,
+        state_sel_i => state_sel_i,
+        state_wen_i => state_wen_i,
+        state_wdata_i => word_t(state_wdata_i),
+        state_rdata_o => state_rdata,
+        retire_valid_o => retire_valid_o,
+        retire_trap_o => retire_trap_o,
+        retire_trap_return_o => retire_trap_return_o,
+        retire_pc_o => retire_pc,
+        retire_rd_o => retire_rd,
+        retire_rd_value_o => retire_rd_value,
+        retire_store_addr_o => retire_store_addr,
+        retire_store_data_o => retire_store_data,
+        retire_store_byte_enable_o => retire_store_byte_enable
     );
 
     imem_addr_o <= std_ulogic_vector(imem_addr);
     dmem_addr_o <= std_ulogic_vector(dmem_addr);
     dmem_wdata_o <= std_ulogic_vector(dmem_wdata);
     dmem_byte_enable_o <= std_ulogic_vector(dmem_byte_enable);
+    state_rdata_o <= std_ulogic_vector(state_rdata);
+    retire_pc_o <= std_ulogic_vector(retire_pc);
+    retire_rd_o <= std_ulogic_vector(retire_rd);
+    retire_rd_value_o <= std_ulogic_vector(retire_rd_value);
+    retire_store_addr_o <= std_ulogic_vector(retire_store_addr);
+    retire_store_data_o <= std_ulogic_vector(retire_store_data);
+    retire_store_byte_enable_o <= std_ulogic_vector(retire_store_byte_enable);
 
 end architecture;
\ No newline at end of file
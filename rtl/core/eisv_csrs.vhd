@@ -33,18 +33,57 @@ entity eisv_csrs is
         write_mtval_value_i : in mem_addr_t;
         epc_o : out mem_addr_t;
         mtvec_o : out mem_addr_t;
+        mcause_o : out word_t;
         mstatus_mie_o : out std_ulogic;
         mie_mtie_o : out std_ulogic;
         mie_meie_o : out std_ulogic;
         -- Controller Interface
         trap_enter_i : in std_ulogic;
         trap_leave_i : in std_ulogic;
-        trap_cause_i : in trap_cause_t
+        trap_cause_i : in trap_cause_t;
+        -- Performance Counter Interface
+        instret_i : in std_ulogic;
+        hpm_events_i : in hpm_events_t;
+        -- State Port (simulation checkpoints), writes are only accepted during reset and use the
+        -- same format as CSR instructions
+        state_sel_i : in special_csr_t;
+        state_wen_i : in std_ulogic;
+        state_wdata_i : in word_t;
+        state_rdata_o : out word_t
     );
 end entity;
 
 architecture rtl of eisv_csrs is
 
+    subtype counter_t is unsigned(63 downto 0);
+    type hpm_counters_t is array (HPM_FIRST to HPM_LAST) of counter_t;
+    type hpm_selects_t is array (HPM_FIRST to HPM_LAST) of hpm_event_t;
+
+    -- Together the stalls and bubbles account for the cycles not spent on retiring instructions
+    constant HPM_RESET_EVENTS : hpm_selects_t := (
+        HPM_LOAD_USE_STALL, HPM_CSR_STALL, HPM_JUMP_BUBBLE, HPM_FLUSH_BUBBLE
+    );
+
+    -- n of mhpmcounter<n>, mhpmcounter<n>h and mhpmevent<n>
+    function hpm_index (sel : special_csr_t) return natural is
+    begin
+        case sel is
+            when MHPMCOUNTER4 | MHPMCOUNTER4H | MHPMEVENT4 => return 4;
+            when MHPMCOUNTER5 | MHPMCOUNTER5H | MHPMEVENT5 => return 5;
+            when MHPMCOUNTER6 | MHPMCOUNTER6H | MHPMEVENT6 => return 6;
+            when others => return 3;
+        end case;
+    end function;
+
+    -- mhpmevent is WARL, unknown events are not counted
+    function to_hpm_event (data : word_t) return hpm_event_t is
+    begin
+        if unsigned(data) > hpm_event_t'pos(hpm_event_t'high) then
+            return HPM_NONE;
+        end if;
+        return hpm_event_t'val(to_integer(unsigned(data)));
+    end function;
+
     signal epc_ff, epc_nxt : mem_addr_t;
     signal mtvec_ff, mtvec_nxt : mem_addr_t;
     signal mstatus_mie_ff, mstatus_mie_nxt : std_ulogic;
@@ -55,6 +94,11 @@ architecture rtl of eisv_csrs is
     signal mie_meie_ff, mie_meie_nxt : std_ulogic;
     signal mie_mtie_ff, mie_mtie_nxt : std_ulogic;
     signal mscratch_ff, mscratch_nxt : word_t;
+    signal mcountinhibit_ff, mcountinhibit_nxt : std_ulogic_vector(HPM_LAST downto 0);
+    signal mcycle_ff, mcycle_nxt : counter_t;
+    signal minstret_ff, minstret_nxt : counter_t;
+    signal hpm_counter_ff, hpm_counter_nxt : hpm_counters_t;
+    signal hpm_event_ff, hpm_event_nxt : hpm_selects_t;
 
 begin
 
@@ -72,12 +116,39 @@ begin
                 mie_meie_ff <= mie_meie_nxt;
                 mie_mtie_ff <= mie_mtie_nxt;
                 mscratch_ff <= mscratch_nxt;
+                mcountinhibit_ff <= mcountinhibit_nxt;
+                mcycle_ff <= mcycle_nxt;
+                minstret_ff <= minstret_nxt;
+                hpm_counter_ff <= hpm_counter_nxt;
+                hpm_event_ff <= hpm_event_nxt;
+            elsif state_wen_i then
+                -- The reset values are not applied while the state is written
+                epc_ff <= epc_nxt;
+                mtvec_ff <= mtvec_nxt;
+                mstatus_mie_ff <= mstatus_mie_nxt;
+                mstatus_mpie_ff <= mstatus_mpie_nxt;
+                mcause_is_interrupt_ff <= mcause_is_interrupt_nxt;
+                mcause_code_ff <= mcause_code_nxt;
+                mtval_ff <= mtval_nxt;
+                mie_meie_ff <= mie_meie_nxt;
+                mie_mtie_ff <= mie_mtie_nxt;
+                mscratch_ff <= mscratch_nxt;
+                mcountinhibit_ff <= mcountinhibit_nxt;
+                mcycle_ff <= mcycle_nxt;
+                minstret_ff <= minstret_nxt;
+                hpm_counter_ff <= hpm_counter_nxt;
+                hpm_event_ff <= hpm_event_nxt;
             else
                 mtvec_ff <= (others => '0');
                 mstatus_mie_ff <= '0';
                 mstatus_mpie_ff <= '0';
                 mie_meie_ff <= '1';
                 mie_mtie_ff <= '1';
+                mcountinhibit_ff <= (others => '0');
+                mcycle_ff <= (others => '0');
+                minstret_ff <= (others => '0');
+                hpm_counter_ff <= (others => (others => '0'));
+                hpm_event_ff <= HPM_RESET_EVENTS;
             end if;
         end if;
     end process;
@@ -148,10 +219,95 @@ begin
                     others => '0'
                 );
             when MSCRATCH => read_data_o <= mscratch_ff;
+            when MCOUNTINHIBIT =>
+                read_data_o <= word_t(resize(unsigned(mcountinhibit_ff), word_t'length));
+            when MCYCLE => read_data_o <= word_t(mcycle_ff(31 downto 0));
+            when MCYCLEH => read_data_o <= word_t(mcycle_ff(63 downto 32));
+            when MINSTRET => read_data_o <= word_t(minstret_ff(31 downto 0));
+            when MINSTRETH => read_data_o <= word_t(minstret_ff(63 downto 32));
+            when MHPMCOUNTER3 | MHPMCOUNTER4 | MHPMCOUNTER5 | MHPMCOUNTER6 =>
+                read_data_o <= word_t(hpm_counter_ff(hpm_index(read_sel_i))(31 downto 0));
+            when MHPMCOUNTER3H | MHPMCOUNTER4H | MHPMCOUNTER5H | MHPMCOUNTER6H =>
+                read_data_o <= word_t(hpm_counter_ff(hpm_index(read_sel_i))(63 downto 32));
+            when MHPMEVENT3 | MHPMEVENT4 | MHPMEVENT5 | MHPMEVENT6 =>
+                read_data_o <= word_t(to_unsigned(
+                    hpm_event_t'pos(hpm_event_ff(hpm_index(read_sel_i))), word_t'length));
+        end case;
+    end process;
+
+    -- Only the state held in registers, in the format written by CSR instructions. The counters
+    -- and their setup are included, so that they continue after a checkpoint or ISS handover.
+    state_read : process (all) is
+    begin
+        state_rdata_o <= (others => '0');
+        case state_sel_i is
+            when MEPC => state_rdata_o <= word_t(epc_ff);
+            when MTVEC => state_rdata_o <= word_t(mtvec_ff);
+            when MSTATUS =>
+                state_rdata_o(3) <= mstatus_mie_ff;
+                state_rdata_o(7) <= mstatus_mpie_ff;
+            when MCAUSE =>
+                state_rdata_o(31) <= mcause_is_interrupt_ff;
+                for i in 5 downto 0 loop
+                    state_rdata_o(i) <= mcause_code_ff(i);
+                end loop;
+            when MTVAL => state_rdata_o <= word_t(mtval_ff);
+            when MIE =>
+                state_rdata_o(7) <= mie_mtie_ff;
+                state_rdata_o(11) <= mie_meie_ff;
+            when MSCRATCH => state_rdata_o <= mscratch_ff;
+            when MCOUNTINHIBIT =>
+                state_rdata_o <= word_t(resize(unsigned(mcountinhibit_ff), word_t'length));
+            when MCYCLE => state_rdata_o <= word_t(mcycle_ff(31 downto 0));
+            when MCYCLEH => state_rdata_o <= word_t(mcycle_ff(63 downto 32));
+            when MINSTRET => state_rdata_o <= word_t(minstret_ff(31 downto 0));
+            when MINSTRETH => state_rdata_o <= word_t(minstret_ff(63 downto 32));
+            when MHPMCOUNTER3 | MHPMCOUNTER4 | MHPMCOUNTER5 | MHPMCOUNTER6 =>
+                state_rdata_o <= word_t(hpm_counter_ff(hpm_index(state_sel_i))(31 downto 0));
+            when MHPMCOUNTER3H | MHPMCOUNTER4H | MHPMCOUNTER5H | MHPMCOUNTER6H =>
+                state_rdata_o <= word_t(hpm_counter_ff(hpm_index(state_sel_i))(63 downto 32));
+            when MHPMEVENT3 | MHPMEVENT4 | MHPMEVENT5 | MHPMEVENT6 =>
+                state_rdata_o <= word_t(to_unsigned(
+                    hpm_event_t'pos(hpm_event_ff(hpm_index(state_sel_i))), word_t'length));
+            when others => null;
         end case;
     end process;
 
     special_csr_write : process (all) is
+        procedure write_csr (sel : special_csr_t; data : word_t) is
+        begin
+            case sel is
+                when MHARTID => null;
+                when MEPC => epc_nxt <= mem_addr_t(data);
+                when MTVEC => mtvec_nxt <= mem_addr_t(data);
+                when MSTATUS =>
+                    mstatus_mie_nxt <= data(3);
+                    mstatus_mpie_nxt <= data(7);
+                when MCAUSE =>
+                    mcause_is_interrupt_nxt <= data(31);
+                    mcause_code_nxt <= trap_code_t(data(5 downto 0));
+                when MISA => null;
+                when MTVAL => mtval_nxt <= mem_addr_t(data);
+                when MIE =>
+                    mie_mtie_nxt <= data(7);
+                    mie_meie_nxt <= data(11);
+                when MIP => null;
+                when MSCRATCH => mscratch_nxt <= data;
+                when MCOUNTINHIBIT =>
+                    mcountinhibit_nxt <= std_ulogic_vector(data(HPM_LAST downto 0));
+                    mcountinhibit_nxt(1) <= '0'; -- There is no time CSR
+                when MCYCLE => mcycle_nxt(31 downto 0) <= unsigned(data);
+                when MCYCLEH => mcycle_nxt(63 downto 32) <= unsigned(data);
+                when MINSTRET => minstret_nxt(31 downto 0) <= unsigned(data);
+                when MINSTRETH => minstret_nxt(63 downto 32) <= unsigned(data);
+                when MHPMCOUNTER3 | MHPMCOUNTER4 | MHPMCOUNTER5 | MHPMCOUNTER6 =>
+                    hpm_counter_nxt(hpm_index(sel))(31 downto 0) <= unsigned(data);
+                when MHPMCOUNTER3H | MHPMCOUNTER4H | MHPMCOUNTER5H | MHPMCOUNTER6H =>
+                    hpm_counter_nxt(hpm_index(sel))(63 downto 32) <= unsigned(data);
+                when MHPMEVENT3 | MHPMEVENT4 | MHPMEVENT5 | MHPMEVENT6 =>
+                    hpm_event_nxt(hpm_index(sel)) <= to_hpm_event(data);
+            end case;
+        end procedure;
     begin
         epc_nxt <= epc_ff;
         mtvec_nxt <= mtvec_ff;
@@ -163,26 +319,35 @@ begin
         mie_meie_nxt <= mie_meie_ff;
         mie_mtie_nxt <= mie_mtie_ff;
         mscratch_nxt <= mscratch_ff;
+        mcountinhibit_nxt <= mcountinhibit_ff;
+        mcycle_nxt <= mcycle_ff;
+        minstret_nxt <= minstret_ff;
+        hpm_counter_nxt <= hpm_counter_ff;
+        hpm_event_nxt <= hpm_event_ff;
+
+        -- Counters, a CSR write in the same cycle takes precedence
+        if rst_ni then
+            if not mcountinhibit_ff(0) then
+                mcycle_nxt <= mcycle_ff + 1;
+            end if;
+
+            if instret_i and not mcountinhibit_ff(2) then
+                minstret_nxt <= minstret_ff + 1;
+            end if;
+
+            for i in HPM_FIRST to HPM_LAST loop
+                if hpm_events_i(hpm_event_ff(i)) and not mcountinhibit_ff(i) then
+                    hpm_counter_nxt(i) <= hpm_counter_ff(i) + 1;
+                end if;
+            end loop;
+        end if;
 
         if write_enable_i then
-            case write_sel_i is
-                when MHARTID => null;
-                when MEPC => epc_nxt <= mem_addr_t(write_data_i);
-                when MTVEC => mtvec_nxt <= mem_addr_t(write_data_i);
-                when MSTATUS =>
-                    mstatus_mie_nxt <= write_data_i(3);
-                    mstatus_mpie_nxt <= write_data_i(7);
-                when MCAUSE =>
-                    mcause_is_interrupt_nxt <= write_data_i(31);
-                    mcause_code_nxt <= trap_code_t(write_data_i(5 downto 0));
-                when MISA => null;
-                when MTVAL => mtval_nxt <= mem_addr_t(write_data_i);
-                when MIE =>
-                    mie_mtie_nxt <= write_data_i(7);
-                    mie_meie_nxt <= write_data_i(11);
-                when MIP => null;
-                when MSCRATCH => mscratch_nxt <= write_data_i;
-            end case;
+            write_csr(write_sel_i, write_data_i);
+        end if;
+
+        if state_wen_i and not rst_ni then
+            write_csr(state_sel_i, state_wdata_i);
         end if;
 
         if write_epc_i then
@@ -239,4 +404,12 @@ begin
     mie_mtie_o <= mie_mtie_ff;
     mie_meie_o <= mie_meie_ff;
 
+    mcause_output : process (all) is
+    begin
+        mcause_o <= (31 => mcause_is_interrupt_ff, others => '0');
+        for i in 5 downto 0 loop
+            mcause_o(i) <= mcause_code_ff(i);
+        end loop;
+    end process;
+
 end architecture;
\ No newline at end of file
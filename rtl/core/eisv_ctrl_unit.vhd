@@ -56,6 +56,12 @@ begin
                     ctrl_o.special_csr_write <= '1';
                     ctrl_o.operand_b_sel <= CSR;
                     ctrl_o.special_csr <= csr_decoder_special_csr;
+
+                    -- csrrs/csrrc(i) with x0 (or 0) only read, writing back the value read in EX
+                    -- would lose the counter increments until WB
+                    if instruction_i.funct3(1) and nor std_ulogic_vector(instruction_i.rs1) then
+                        ctrl_o.special_csr_write <= '0';
+                    end if;
                 end if;
             end if;
 
@@ -133,8 +139,68 @@ begin
                 csr_decoder_special_csr <= MIP;
             when x"34A" => csr_decoder_implementation <= READ_ONLY_ZERO; -- mtinst
             when x"34B" => csr_decoder_implementation <= READ_ONLY_ZERO; -- mtval2
+            -- Machine Counter/Timers
+            when x"B00" => -- mcycle
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MCYCLE;
+            when x"B02" => -- minstret
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MINSTRET;
+            when x"B03" => -- mhpmcounter3
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMCOUNTER3;
+            when x"B04" => -- mhpmcounter4
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMCOUNTER4;
+            when x"B05" => -- mhpmcounter5
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMCOUNTER5;
+            when x"B06" => -- mhpmcounter6
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMCOUNTER6;
+            when x"B80" => -- mcycleh
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MCYCLEH;
+            when x"B82" => -- minstreth
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MINSTRETH;
+            when x"B83" => -- mhpmcounter3h
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMCOUNTER3H;
+            when x"B84" => -- mhpmcounter4h
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMCOUNTER4H;
+            when x"B85" => -- mhpmcounter5h
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMCOUNTER5H;
+            when x"B86" => -- mhpmcounter6h
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMCOUNTER6H;
+            -- Machine Counter Setup
+            when x"320" => -- mcountinhibit
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MCOUNTINHIBIT;
+            when x"323" => -- mhpmevent3
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMEVENT3;
+            when x"324" => -- mhpmevent4
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMEVENT4;
+            when x"325" => -- mhpmevent5
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMEVENT5;
+            when x"326" => -- mhpmevent6
+                csr_decoder_implementation <= SPECIAL;
+                csr_decoder_special_csr <= MHPMEVENT6;
             -- Machine Configuration
-            when others => csr_decoder_implementation <= UNIMPLEMENTED;
+            when others =>
+                csr_decoder_implementation <= UNIMPLEMENTED;
+                -- The remaining counters (0xB00 - 0xB1F, 0xB80 - 0xB9F) and counter setup
+                -- registers (0x320 - 0x33F) are hardwired to zero
+                if csr_address(11 downto 5) = "1011000" or csr_address(11 downto 5) = "1011100" or
+                   csr_address(11 downto 5) = "0011001" then
+                    csr_decoder_implementation <= READ_ONLY_ZERO;
+                end if;
         end case;
     end process;
 
@@ -86,13 +86,17 @@ begin
         forward_from_ex := hazard.operand_a_forward_sel = EX or hazard.operand_b_forward_sel = EX;
 
         hazard.stall := '0';
+        hazard.load_use_stall := '0';
+        hazard.csr_stall := '0';
         if forward_from_ex and not (??ex_ctrl_i.eu_result_is_result) then
             hazard.stall := '1';
+            hazard.load_use_stall := '1';
         end if;
 
         csr_access_in_pipeline := ex_ctrl_i.csr_access or mem_ctrl_i.csr_access or wb_ctrl_i.csr_access;
         if de_ctrl_out_i.csr_access and csr_access_in_pipeline then
             hazard.stall := '1';
+            hazard.csr_stall := '1';
         end if;
 
         hazard_o <= hazard;
@@ -28,7 +28,12 @@ entity eisv_register_file is
         -- Write Port2 (CSR)
         wp2_addr_i : in rf_addr_t;
         wp2_enable_i : in std_ulogic;
-        wp2_data_i : in word_t
+        wp2_data_i : in word_t;
+        -- State Port (simulation checkpoints), writes are only accepted during reset
+        state_addr_i : in rf_addr_t;
+        state_wen_i : in std_ulogic;
+        state_wdata_i : in word_t;
+        state_rdata_o : out word_t
     );
 end entity;
 
@@ -63,10 +68,20 @@ begin
                 if (??wp2_enable_i) and unsigned(wp2_addr_i) /= 0 then
                     registers_reg(to_integer(unsigned(wp2_addr_i))) <= wp2_data_i;
                 end if;
+            elsif (??state_wen_i) and unsigned(state_addr_i) /= 0 then
+                registers_reg(to_integer(unsigned(state_addr_i))) <= state_wdata_i;
             end if;
         end if;
     end process;
 
+    state_read : process (all) is
+    begin
+        state_rdata_o <= (others => '0');
+        if unsigned(state_addr_i) /= 0 then
+            state_rdata_o <= registers_reg(to_integer(unsigned(state_addr_i)));
+        end if;
+    end process;
+
     rp1_data_o <= rp1_data_reg;
     rp2_data_o <= rp2_data_reg;
 
@@ -57,9 +57,34 @@ package eisv_types_pkg is
     );
 
     type special_csr_t is (
-        MHARTID, MSTATUS, MISA, MIE, MTVEC, MSCRATCH, MEPC, MCAUSE, MTVAL, MIP
+        MHARTID, MSTATUS, MISA, MIE, MTVEC, MSCRATCH, MEPC, MCAUSE, MTVAL, MIP,
+        MCOUNTINHIBIT, MCYCLE, MCYCLEH, MINSTRET, MINSTRETH,
+        MHPMCOUNTER3, MHPMCOUNTER4, MHPMCOUNTER5, MHPMCOUNTER6,
+        MHPMCOUNTER3H, MHPMCOUNTER4H, MHPMCOUNTER5H, MHPMCOUNTER6H,
+        MHPMEVENT3, MHPMEVENT4, MHPMEVENT5, MHPMEVENT6
     );
 
+    -- Performance counters, mhpmevent3 to mhpmevent6 select the event counted by the mhpmcounter
+    -- of the same number (the position in hpm_event_t, other values select HPM_NONE)
+    constant HPM_FIRST : natural := 3;
+    constant HPM_LAST : natural := 6;
+
+    type hpm_event_t is (
+        HPM_NONE,
+        HPM_LOAD_USE_STALL, -- Cycles an instruction waits for a load or CSR read in EX
+        HPM_CSR_STALL,      -- Cycles a CSR access waits for the CSR accesses ahead of it
+        HPM_JUMP_BUBBLE,    -- Cycles without fetch while a jump or branch is resolved
+        HPM_FLUSH_BUBBLE,   -- Cycles without issue after a trap, mret or pipeline flush
+        HPM_JUMP_TAKEN,     -- Taken jumps and branches
+        HPM_MUL,            -- Retired multiplications
+        HPM_DIV,            -- Retired divisions and remainders
+        HPM_LOAD,           -- Retired loads
+        HPM_STORE,          -- Retired stores
+        HPM_TRAP            -- Entered trap handlers
+    );
+
+    type hpm_events_t is array (hpm_event_t) of std_ulogic;
+
     -- MUX select enums
     type rf_write_sel_t is (
         EXECUTION_UNIT, LOAD_STORE_UNIT, PC_PLUS_4, OPB
@@ -190,6 +215,9 @@ package eisv_types_pkg is
         operand_a_forward_sel : forward_sel_t;
         operand_b_forward_sel : forward_sel_t;
         stall : std_ulogic;
+        -- Causes of stall for the performance counters
+        load_use_stall : std_ulogic;
+        csr_stall : std_ulogic;
     end record;
 
     type trap_cause_t is (
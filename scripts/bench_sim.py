@@ -0,0 +1,232 @@
+"""Measures how fast the co-simulation of core_sim and eisv-mem-system runs (make bench-sim).
+
+Every program in app/bench is simulated --repeat times, one run after the other so they do not
+compete for the CPU, and the fastest run counts. Reported are the simulated cycles per second of
+wall-clock time and the peak resident set size of both processes. The system calls per simulated
+cycle are counted in one more run under strace -f -c, which slows the simulation down too much to
+be timed, and are left out if strace is not installed.
+
+The results are written as JSON. With --baseline they are compared against the JSON of an earlier
+run, a benchmark whose speed, memory or system calls got worse by more than --tolerance fails.
+"""
+
+import argparse
+import datetime
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import threading
+import time
+
+from regress import RETURN_VALUE, ROOT, SIMULATED_CYCLES, kill, make
+
+# Metrics compared against the baseline and whether higher values are better
+METRICS = {
+    "cycles_per_second": True,
+    "core_sim_max_rss_kib": False,
+    "mem_system_max_rss_kib": False,
+    "syscalls_per_cycle": False,
+}
+
+
+def wait(process):
+    """Waits like Popen.wait, but also returns the resource usage of the process."""
+    _, status, rusage = os.wait4(process.pid, 0)
+    process.returncode = os.waitstatus_to_exitcode(status)
+    return rusage
+
+
+def strace_calls(path):
+    """Total number of system calls in the summary of strace -c."""
+    with open(path) as file:
+        for line in file:
+            fields = line.split()
+            if fields and fields[-1] == "total":
+                return int(fields[3])
+    return None
+
+
+def run(args, app, strace=False):
+    workdir = os.path.join(args.builddir, "bench", "sim", app)
+    os.makedirs(workdir, exist_ok=True)
+    vhsock_name = f"{args.vhsock_prefix}bench{os.getpid():x}"
+
+    core_sim_command = [os.path.join(args.builddir, "rtl", "core_sim"), "--ieee-asserts=disable",
+                        f"-gVHSOCK_NAME={vhsock_name}", *args.core_sim_flag]
+    mem_system_command = [os.path.join(args.builddir, "sim", "eisv-mem-system"), vhsock_name,
+                          f"--isa={args.isa}",
+                          f"--image={os.path.join(args.builddir, 'app', 'bench', app + '.o')}",
+                          "--uart-out=uart_out", "--dump=dump.bin", *args.mem_system_flag]
+    if strace:
+        core_sim_command = ["strace", "-f", "-c", "-o", "core_sim.strace", *core_sim_command]
+        mem_system_command = ["strace", "-f", "-c", "-o", "mem_system.strace",
+                              *mem_system_command]
+
+    with open(os.path.join(workdir, "core_sim.log"), "w") as core_sim_log, \
+            open(os.path.join(workdir, "eisv-mem-system.log"), "w") as mem_system_log:
+        start = time.perf_counter()
+        core_sim = subprocess.Popen(core_sim_command, cwd=workdir, stdout=core_sim_log,
+                                    stderr=subprocess.STDOUT, start_new_session=True)
+        mem_system = subprocess.Popen(mem_system_command, cwd=workdir, stdout=mem_system_log,
+                                      stderr=subprocess.STDOUT, start_new_session=True)
+        timer = threading.Timer(args.timeout, lambda: (kill(mem_system), kill(core_sim)))
+        timer.start()
+        try:
+            mem_system_usage = wait(mem_system)
+            seconds = time.perf_counter() - start
+            core_sim_usage = wait(core_sim)
+        finally:
+            timer.cancel()
+            kill(mem_system)
+            kill(core_sim)
+
+    with open(os.path.join(workdir, "eisv-mem-system.log"), errors="replace") as log:
+        output = log.read()
+    return_value = RETURN_VALUE.search(output)
+    cycles = SIMULATED_CYCLES.search(output)
+    if mem_system.returncode != 0 or not return_value or not cycles:
+        print(f"[BENCH] ERROR {app} failed (exit code {mem_system.returncode}), see {workdir}")
+        return None
+
+    result = {
+        "return_value": int(return_value.group(1)),
+        "cycles": int(cycles.group(1)),
+        "seconds": seconds,
+        # ru_maxrss is in KiB on Linux
+        "core_sim_max_rss_kib": core_sim_usage.ru_maxrss,
+        "mem_system_max_rss_kib": mem_system_usage.ru_maxrss,
+    }
+    if strace:
+        result["core_sim_syscalls"] = strace_calls(os.path.join(workdir, "core_sim.strace"))
+        result["mem_system_syscalls"] = strace_calls(os.path.join(workdir, "mem_system.strace"))
+    return result
+
+
+def measure(args, app):
+    runs = []
+    for _ in range(args.repeat):
+        result = run(args, app)
+        if not result:
+            return None
+        runs.append(result)
+    best = min(runs, key=lambda result: result["seconds"])
+
+    benchmark = {
+        "app": app,
+        "return_value": best["return_value"],
+        "cycles": best["cycles"],
+        "seconds": round(best["seconds"], 4),
+        "runs": [round(result["seconds"], 4) for result in runs],
+        "cycles_per_second": round(best["cycles"] / best["seconds"]),
+        "core_sim_max_rss_kib": max(result["core_sim_max_rss_kib"] for result in runs),
+        "mem_system_max_rss_kib": max(result["mem_system_max_rss_kib"] for result in runs),
+        "core_sim_syscalls": None,
+        "mem_system_syscalls": None,
+        "syscalls_per_cycle": None,
+    }
+    if args.syscalls:
+        result = run(args, app, strace=True)
+        if not result:
+            return None
+        benchmark["core_sim_syscalls"] = result["core_sim_syscalls"]
+        benchmark["mem_system_syscalls"] = result["mem_system_syscalls"]
+        if result["core_sim_syscalls"] is not None and result["mem_system_syscalls"] is not None:
+            benchmark["syscalls_per_cycle"] = round(
+                (result["core_sim_syscalls"] + result["mem_system_syscalls"]) / result["cycles"],
+                4)
+    return benchmark
+
+
+def compare(benchmarks, baseline, tolerance):
+    """Regressions against the benchmarks of the baseline, as readable strings."""
+    previous = {benchmark["app"]: benchmark for benchmark in baseline["benchmarks"]}
+    regressions = []
+    for benchmark in benchmarks:
+        if benchmark["app"] not in previous:
+            continue
+        for metric, higher_is_better in METRICS.items():
+            old = previous[benchmark["app"]].get(metric)
+            new = benchmark[metric]
+            if not old or new is None:
+                continue
+            change = new / old - 1
+            if (-change if higher_is_better else change) > tolerance:
+                regressions.append(f"{benchmark['app']} {metric} {old} -> {new} "
+                                   f"({change * 100:+.1f}%)")
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--apps", nargs="+", required=True)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--timeout", type=float, default=600, help="Seconds per run")
+    parser.add_argument("--builddir", default="build")
+    parser.add_argument("--isa", required=True)
+    parser.add_argument("--output", default="build/bench/sim.json")
+    parser.add_argument("--baseline", help="JSON of an earlier run to compare against")
+    parser.add_argument("--tolerance", type=float, default=0.1,
+                        help="Relative change of a metric that counts as regression")
+    parser.add_argument("--no-syscalls", dest="syscalls", action="store_false",
+                        help="Skip the run under strace")
+    parser.add_argument("--vhsock-prefix", default="", help="shm: for shared memory")
+    parser.add_argument("--core-sim-flag", action="append", default=[])
+    parser.add_argument("--mem-system-flag", action="append", default=[])
+    args = parser.parse_args()
+    args.builddir = os.path.abspath(os.path.join(ROOT, args.builddir))
+
+    if args.syscalls and not shutil.which("strace"):
+        print("[BENCH] WARN strace not found, not counting system calls")
+        args.syscalls = False
+
+    try:
+        make(f"BUILDDIR={args.builddir}", f"{args.builddir}/rtl/core_sim",
+             f"{args.builddir}/sim/eisv-mem-system",
+             *[f"{args.builddir}/app/bench/{app}.o" for app in args.apps])
+    except subprocess.CalledProcessError as error:
+        print(f"[BENCH] ERROR Build failed: {error}")
+        return 1
+
+    benchmarks = []
+    failed = False
+    for app in args.apps:
+        benchmark = measure(args, app)
+        if not benchmark:
+            failed = True
+            continue
+        syscalls = benchmark["syscalls_per_cycle"]
+        print(f"[BENCH] {app:10} {benchmark['cycles']:>10} cycles "
+              f"{benchmark['cycles_per_second']:>10} cycles/s "
+              f"{'-' if syscalls is None else syscalls:>8} syscalls/cycle "
+              f"{benchmark['core_sim_max_rss_kib']:>8} + "
+              f"{benchmark['mem_system_max_rss_kib']} KiB")
+        benchmarks.append(benchmark)
+
+    results = {
+        "date": datetime.datetime.now().isoformat(timespec="seconds"),
+        "host": platform.node(),
+        "isa": args.isa,
+        "core_sim_flags": args.core_sim_flag,
+        "mem_system_flags": args.mem_system_flag,
+        "benchmarks": benchmarks,
+        "regressions": [],
+    }
+    if args.baseline:
+        with open(args.baseline) as file:
+            results["regressions"] = compare(benchmarks, json.load(file), args.tolerance)
+        for regression in results["regressions"]:
+            print(f"[BENCH] REGRESSION {regression}")
+
+    output = os.path.join(ROOT, args.output)
+    os.makedirs(os.path.dirname(output), exist_ok=True)
+    with open(output, "w") as file:
+        json.dump(results, file, indent=2)
+    print(f"[BENCH] Results in {output}")
+    return 1 if failed or results["regressions"] else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
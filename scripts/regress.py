@@ -0,0 +1,260 @@
+"""Simulates every application on every EISV_CONFIG in parallel (make regress).
+
+Each configuration gets its own core_sim in <builddir>/config<n>, built one after the other as they
+share the generated rtl/core/eisv_config.vhd. The jobs (application x configuration) are then taken
+from a shared queue by --jobs workers, each job in its own directory with its own VHSOCK_NAME, so a
+worker that finishes a short job immediately continues with the next one.
+
+With --backends ghdl verilator every job also runs on the Verilator model of the configuration
+(eisv-verilator), built into <builddir>/config<n>/verilator.
+
+A job passes if the program writes its return value before the timeout and eisv-mem-system exits
+successfully. As there are no reference results, the return value, UART output and RAM dump of an
+application also have to be the same on all configurations and backends, and both backends have to
+take the same number of cycles on a configuration. The results are written to
+<builddir>/results.json and <builddir>/junit.xml.
+"""
+
+import argparse
+import concurrent.futures
+import hashlib
+import json
+import os
+import re
+import signal
+import subprocess
+import sys
+import time
+import xml.etree.ElementTree as ET
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+RETURN_VALUE = re.compile(r"\[TB\] Program finished with return value (-?\d+)")
+SIMULATED_CYCLES = re.compile(r"\[TB\] Simulated (\d+) cycles")
+
+# Lines of the eisv-mem-system output attached to failures in the JUnit summary
+LOG_TAIL = 50
+
+
+def make(*arguments):
+    subprocess.run(["make", "--no-print-directory", "-C", ROOT, *arguments], check=True)
+
+
+def isa_of(config):
+    return subprocess.run(["python3", "scripts/isa_from_config.py"], cwd=ROOT, check=True,
+                          env=dict(os.environ, EISV_CONFIG=config), capture_output=True,
+                          text=True).stdout.strip()
+
+
+def build(args):
+    for config in args.configs:
+        builddir = os.path.join(args.builddir, f"config{config}")
+        targets = {"ghdl": f"{builddir}/rtl/core_sim",
+                   "verilator": f"{builddir}/verilator/eisv-verilator"}
+        make(f"EISV_CONFIG={config}", f"BUILDDIR={builddir}",
+             *[targets[backend] for backend in args.backends])
+    make(f"BUILDDIR={args.builddir}", f"{args.builddir}/sim/eisv-mem-system",
+         *[f"{args.builddir}/app/{app}.o" for app in args.apps])
+
+
+def digest(path):
+    try:
+        with open(path, "rb") as file:
+            return hashlib.sha256(file.read()).hexdigest()
+    except OSError:
+        return None
+
+
+def kill(process):
+    if process.poll() is None:
+        os.killpg(process.pid, signal.SIGKILL)
+        process.wait()
+
+
+def run_job(args, index, app, config, backend):
+    workdir = os.path.join(args.builddir, "jobs", f"{app}-config{config}-{backend}")
+    os.makedirs(workdir, exist_ok=True)
+    for name in ["uart_out", "dump.bin", "wave.ghw"]:
+        if os.path.exists(os.path.join(workdir, name)):
+            os.remove(os.path.join(workdir, name))
+
+    # Has to fit the 31 characters of a vhsock name and be unique among concurrent regressions
+    vhsock_name = f"{args.vhsock_prefix}regress{os.getpid():x}-{index}"
+
+    core_sim_command = [os.path.join(args.builddir, f"config{config}", "rtl", "core_sim"),
+                        "--ieee-asserts=disable", f"-gVHSOCK_NAME={vhsock_name}",
+                        *args.core_sim_flag]
+    if args.wave:
+        core_sim_command.append("--wave=wave.ghw")
+    testbench_flags = [f"--isa={args.isa[config]}",
+                       f"--image={os.path.join(args.builddir, 'app', app + '.o')}",
+                       f"--uart-in={os.path.join(ROOT, 'app', app + '.uart_in')}",
+                       "--uart-out=uart_out", "--dump=dump.bin"]
+    mem_system_command = [os.path.join(args.builddir, "sim", "eisv-mem-system"), vhsock_name,
+                          *testbench_flags, *args.mem_system_flag]
+    # The Verilator model runs in the testbench process, there is no core_sim
+    verilator_command = [os.path.join(args.builddir, f"config{config}", "verilator",
+                                      "eisv-verilator"), *testbench_flags, *args.verilator_flag]
+
+    result = {
+        "app": app,
+        "config": config,
+        "backend": backend,
+        "status": "passed",
+        "message": "",
+        "return_value": None,
+        "cycles": None,
+        "seconds": 0.0,
+        "directory": workdir,
+    }
+    start = time.monotonic()
+    if backend == "verilator":
+        with open(os.path.join(workdir, "eisv-mem-system.log"), "w") as mem_system_log:
+            mem_system = subprocess.Popen(verilator_command, cwd=workdir, stdout=mem_system_log,
+                                          stderr=subprocess.STDOUT, start_new_session=True)
+            try:
+                mem_system.wait(timeout=args.timeout)
+            except subprocess.TimeoutExpired:
+                result["status"] = "timeout"
+                result["message"] = f"Not finished after {args.timeout} s"
+            finally:
+                kill(mem_system)
+        return finish_job(result, mem_system, start)
+
+    with open(os.path.join(workdir, "core_sim.log"), "w") as core_sim_log, \
+            open(os.path.join(workdir, "eisv-mem-system.log"), "w") as mem_system_log:
+        # Own process groups, so a timeout also takes down anything they started
+        core_sim = subprocess.Popen(core_sim_command, cwd=workdir, stdout=core_sim_log,
+                                    stderr=subprocess.STDOUT, start_new_session=True)
+        mem_system = subprocess.Popen(mem_system_command, cwd=workdir, stdout=mem_system_log,
+                                      stderr=subprocess.STDOUT, start_new_session=True)
+        try:
+            mem_system.wait(timeout=args.timeout)
+            core_sim.wait(timeout=10)
+        except subprocess.TimeoutExpired:
+            result["status"] = "timeout"
+            result["message"] = f"Not finished after {args.timeout} s"
+        finally:
+            kill(mem_system)
+            kill(core_sim)
+    return finish_job(result, mem_system, start)
+
+
+def finish_job(result, mem_system, start):
+    """Fills in the result from the testbench log, mem_system is the testbench process."""
+    workdir = result["directory"]
+    result["seconds"] = round(time.monotonic() - start, 3)
+
+    with open(os.path.join(workdir, "eisv-mem-system.log"), errors="replace") as log:
+        output = log.read()
+    match = RETURN_VALUE.search(output)
+    if match:
+        result["return_value"] = int(match.group(1))
+    cycles = SIMULATED_CYCLES.search(output)
+    if cycles:
+        result["cycles"] = int(cycles.group(1))
+    if result["status"] == "passed":
+        if mem_system.returncode != 0:
+            result["status"] = "failed"
+            result["message"] = f"eisv-mem-system exited with {mem_system.returncode}"
+        elif not match:
+            result["status"] = "failed"
+            result["message"] = "No return value"
+    result["uart_out"] = digest(os.path.join(workdir, "uart_out"))
+    result["dump"] = digest(os.path.join(workdir, "dump.bin"))
+    result["log"] = output.splitlines()[-LOG_TAIL:]
+    return result
+
+
+def compare_configs(results):
+    """Fails the jobs whose results differ from the first passed configuration of the app, or
+    whose cycles differ from the first passed backend of the configuration."""
+    reference = {}
+    reference_backend = {}
+    for result in results:
+        if result["status"] != "passed":
+            continue
+        first = reference.setdefault(result["app"], result)
+        differences = [key for key in ["return_value", "uart_out", "dump"]
+                       if result[key] != first[key]]
+        first_backend = reference_backend.setdefault((result["app"], result["config"]), result)
+        if result["cycles"] != first_backend["cycles"]:
+            differences.append(f"cycles ({result['cycles']} instead of "
+                               f"{first_backend['cycles']} on {first_backend['backend']})")
+        if differences:
+            result["status"] = "failed"
+            result["message"] = (f"{', '.join(differences)} differs from "
+                                 f"config{first['config']} {first['backend']}")
+
+
+def write_junit(path, results):
+    suite = ET.Element("testsuite", name="eisv-regress", tests=str(len(results)),
+                       failures=str(sum(result["status"] == "failed" for result in results)),
+                       errors=str(sum(result["status"] == "timeout" for result in results)),
+                       time=str(round(sum(result["seconds"] for result in results), 3)))
+    for result in results:
+        case = ET.SubElement(suite, "testcase",
+                             classname=f"config{result['config']}.{result['backend']}",
+                             name=result["app"], time=str(result["seconds"]))
+        if result["status"] != "passed":
+            tag = "error" if result["status"] == "timeout" else "failure"
+            ET.SubElement(case, tag, message=result["message"]).text = "\n".join(result["log"])
+        ET.SubElement(case, "system-out").text = "\n".join(result["log"])
+    ET.ElementTree(suite).write(path, encoding="utf-8", xml_declaration=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--apps", nargs="+", required=True)
+    parser.add_argument("--configs", nargs="+", default=["0", "1"])
+    parser.add_argument("--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--timeout", type=float, default=300, help="Seconds per job")
+    parser.add_argument("--builddir", default="build/regress")
+    parser.add_argument("--vhsock-prefix", default="", help="shm: for shared memory")
+    parser.add_argument("--wave", action="store_true", help="Write wave.ghw in every job")
+    parser.add_argument("--core-sim-flag", action="append", default=[])
+    parser.add_argument("--mem-system-flag", action="append", default=[])
+    parser.add_argument("--backends", nargs="+", choices=["ghdl", "verilator"], default=["ghdl"])
+    parser.add_argument("--verilator-flag", action="append", default=[])
+    args = parser.parse_args()
+    args.builddir = os.path.abspath(os.path.join(ROOT, args.builddir))
+    args.isa = {config: isa_of(config) for config in args.configs}
+
+    try:
+        build(args)
+    except subprocess.CalledProcessError as error:
+        print(f"[REGRESS] ERROR Build failed: {error}")
+        return 1
+
+    jobs = [(app, config, backend) for app in args.apps for config in args.configs
+            for backend in args.backends]
+    print(f"[REGRESS] Running {len(jobs)} jobs on {args.jobs} workers")
+    results = []
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futures = [pool.submit(run_job, args, index, app, config, backend)
+                   for index, (app, config, backend) in enumerate(jobs)]
+        for future in concurrent.futures.as_completed(futures):
+            result = future.result()
+            print(f"[REGRESS] {result['status']:7} {result['app']} config{result['config']} "
+                  f"{result['backend']} ({result['seconds']:.1f} s) {result['message']}")
+            results.append(result)
+
+    results.sort(key=lambda result: (result["app"], result["config"],
+                                     args.backends.index(result["backend"])))
+    compare_configs(results)
+
+    passed = sum(result["status"] == "passed" for result in results)
+    with open(os.path.join(args.builddir, "results.json"), "w") as file:
+        json.dump({"passed": passed, "total": len(results), "results": results}, file, indent=2)
+    write_junit(os.path.join(args.builddir, "junit.xml"), results)
+
+    for result in results:
+        if result["status"] != "passed":
+            print(f"[REGRESS] FAILED {result['app']} config{result['config']} {result['backend']}: "
+                  f"{result['message']} (see {result['directory']})")
+    print(f"[REGRESS] {passed} of {len(results)} jobs passed, summary in {args.builddir}")
+    return 0 if passed == len(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
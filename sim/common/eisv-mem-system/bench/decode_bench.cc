@@ -0,0 +1,121 @@
+// Microbenchmark of the address decode in System::read/write, independent of SystemC and GHDL.
+//
+// Replays a synthetic access stream (sequential instruction fetches from ROM, data accesses to
+// RAM and MMIO devices) against the memory map of the testbench (5 devices) and against the same
+// map with 59 additional MMIO devices.
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "memory.h"
+#include "memory_map.h"
+#include "system.h"
+
+constexpr int ACCESSES = 1 << 22;
+constexpr int ROUNDS = 16;
+
+// Device without any behaviour, so the measurement is dominated by the decode
+class NullDevice : public Device {
+   public:
+    virtual bool write(uint32_t local_address, uint32_t value, uint8_t byte_enable) override {
+        last = local_address ^ value;
+        return true;
+    }
+
+    virtual bool read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) override {
+        value_out = local_address;
+        return true;
+    }
+
+    uint32_t last = 0;
+};
+
+struct Access {
+    uint32_t address;
+    bool write;
+    System::Port port;
+};
+
+// The testbench map with stop device, timer and UART replaced by mmio[0..2], plus additional MMIO
+// devices after the timer
+static void build_map(System& system, Memory& ram, Memory& rom, std::vector<NullDevice>& mmio) {
+    add_testbench_devices(system, &ram, &rom, &mmio[0], &mmio[1], &mmio[2]);
+    for (size_t i = 3; i < mmio.size(); i++) {
+        system.add_device(&mmio[i], 28, TIMER_BASE + (i - 2) * 0x10);
+    }
+}
+
+// One instruction fetch per cycle, every third cycle a data access of which 1/4 go to the timer
+// or the additional MMIO devices
+static std::vector<Access> build_stream(size_t device_count, std::mt19937& gen) {
+    std::vector<Access> stream;
+    std::uniform_int_distribution<uint32_t> percent(0, 99);
+    std::uniform_int_distribution<uint32_t> ram_word(0, (1 << 14) - 1);
+    std::uniform_int_distribution<uint32_t> mmio_device(0, device_count - 5);
+
+    uint32_t pc = 0;
+    while (stream.size() < ACCESSES) {
+        stream.push_back(Access{pc, false, System::PORT_IMEM});
+        pc = percent(gen) < 10 ? (ram_word(gen) << 2) & 0x3ff : (pc + 4) & 0x3ff;
+
+        if (percent(gen) < 33) {
+            uint32_t address = RAM_BASE + (ram_word(gen) << 2);
+            if (percent(gen) < 25) {
+                address = TIMER_BASE + mmio_device(gen) * 0x10;
+            }
+            stream.push_back(Access{address, percent(gen) < 40, System::PORT_DMEM});
+        }
+    }
+    return stream;
+}
+
+static void run(size_t device_count, bool use_dmi) {
+    Memory ram(1 << 14);
+    Memory rom(1 << 8);
+    std::vector<NullDevice> mmio(device_count - 2);
+    System system;
+    build_map(system, ram, rom, mmio);
+
+    System::Dmi rom_dmi;
+    System::Dmi ram_dmi;
+    if (use_dmi) {
+        system.acquire_dmi(ROM_BASE, rom_dmi);
+        system.acquire_dmi(RAM_BASE, ram_dmi);
+    }
+
+    std::mt19937 gen(1);
+    std::vector<Access> stream = build_stream(device_count, gen);
+
+    uint32_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (Access const& access : stream) {
+            if (access.write) {
+                uint32_t value = checksum + access.address;
+                ram_dmi.write(access.address, value, 0b1111) ||
+                    system.write(access.address, value, 0b1111, access.port);
+            } else {
+                uint32_t value;
+                rom_dmi.read(access.address, value) || ram_dmi.read(access.address, value) ||
+                    system.read(access.address, value, 0b1111, access.port);
+                checksum += value;
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double accesses = static_cast<double>(stream.size()) * ROUNDS;
+    printf("%3zu devices, %-7s %8.2f M accesses/s, %6.2f ns/access (checksum %08x)\n",
+           device_count, use_dmi ? "DMI:" : "System:", accesses / elapsed.count() / 1e6,
+           elapsed.count() / accesses * 1e9, checksum);
+}
+
+int main() {
+    for (size_t device_count : {5, 64}) {
+        run(device_count, false);
+        run(device_count, true);
+    }
+    return 0;
+}
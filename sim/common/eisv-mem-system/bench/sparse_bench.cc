@@ -0,0 +1,126 @@
+// Check and benchmark of SparseMemory, independent of SystemC and GHDL.
+//
+// Writes words to pages scattered across a 256 MB window and checks that they read back, that only
+// the written pages are populated, and that the dump (write_to_file, init_from_file) and the
+// checkpoint state (save_state, restore_state) round trip them. Fails with a non-zero exit code.
+// The dump goes to the file given as argument, sparse_bench.bin by default.
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "sparse_memory.h"
+
+constexpr size_t WINDOW_WORDS = (size_t{256} << 20) / sizeof(uint32_t);
+constexpr int PAGES = 1000;
+constexpr int WORDS_PER_PAGE = 16;
+
+struct Write {
+    uint32_t address;
+    uint32_t value;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Non-zero words to random offsets of PAGES random pages, the last write to an address counts
+static std::vector<Write> build_writes(std::mt19937& gen, std::set<size_t>& pages_out) {
+    size_t page_count = WINDOW_WORDS / SparseMemory::PAGE_WORDS;
+    std::uniform_int_distribution<size_t> page(0, page_count - 1);
+    std::uniform_int_distribution<uint32_t> word(0, SparseMemory::PAGE_WORDS - 1);
+    std::uniform_int_distribution<uint32_t> value(1, UINT32_MAX);
+
+    std::vector<Write> writes;
+    while (pages_out.size() < PAGES) {
+        size_t index = page(gen);
+        pages_out.insert(index);
+        for (int i = 0; i < WORDS_PER_PAGE; i++) {
+            uint32_t word_addr = index * SparseMemory::PAGE_WORDS + word(gen);
+            writes.push_back(Write{word_addr * 4, value(gen)});
+        }
+    }
+    return writes;
+}
+
+// Compares every written address with the value last written to it
+static bool verify(char const* what, SparseMemory& memory, std::vector<Write> const& writes,
+                   size_t pages) {
+    bool ok = true;
+    if (memory.populated_pages() != pages) {
+        printf("FAIL %s: %zu populated pages, expected %zu\n", what, memory.populated_pages(),
+               pages);
+        ok = false;
+    }
+
+    // Sorted by address, the last of several writes to the same address is the expected value
+    std::vector<std::pair<uint32_t, uint32_t>> expected;
+    for (Write const& write : writes) {
+        expected.emplace_back(write.address, write.value);
+    }
+    std::stable_sort(expected.begin(), expected.end(),
+                     [](auto const& a, auto const& b) { return a.first < b.first; });
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (i + 1 < expected.size() && expected[i + 1].first == expected[i].first) {
+            continue;
+        }
+        uint32_t value;
+        if (!memory.read(expected[i].first, value, 0b1111) || value != expected[i].second) {
+            printf("FAIL %s: %08x reads %08x, expected %08x\n", what, expected[i].first, value,
+                   expected[i].second);
+            return false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::mt19937 gen(1);
+    std::set<size_t> pages;
+    std::vector<Write> writes = build_writes(gen, pages);
+
+    auto start = std::chrono::steady_clock::now();
+    SparseMemory memory(WINDOW_WORDS);
+    for (Write const& write : writes) {
+        memory.write(write.address, write.value, 0b1111);
+    }
+    // Zeros must not populate anything
+    memory.write((WINDOW_WORDS - 1) * 4, 0, 0b1111);
+    printf("%zu writes to %zu of %zu pages: %.3f ms\n", writes.size(), pages.size(),
+           WINDOW_WORDS / SparseMemory::PAGE_WORDS, seconds_since(start) * 1e3);
+    bool ok = verify("write", memory, writes, pages.size());
+
+    char const* path = argc > 1 ? argv[1] : "sparse_bench.bin";
+    start = std::chrono::steady_clock::now();
+    ok = memory.write_to_file(path) && ok;
+    double dump = seconds_since(start);
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        printf("write_to_file: %.3f ms, %lld MB allocated of %lld MB\n", dump * 1e3,
+               static_cast<long long>(st.st_blocks) * 512 >> 20,
+               static_cast<long long>(st.st_size) >> 20);
+    }
+
+    start = std::chrono::steady_clock::now();
+    SparseMemory loaded(WINDOW_WORDS);
+    ok = loaded.init_from_file(path, 0) && ok;
+    printf("init_from_file: %.3f ms\n", seconds_since(start) * 1e3);
+    ok = verify("init_from_file", loaded, writes, pages.size()) && ok;
+    remove(path);
+
+    std::vector<uint8_t> state;
+    memory.save_state(state);
+    SparseMemory restored(WINDOW_WORDS);
+    ok = restored.restore_state(state) && ok;
+    printf("save_state: %zu KB\n", state.size() >> 10);
+    ok = verify("restore_state", restored, writes, pages.size()) && ok;
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#include "checkpoint.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+constexpr uint64_t SECTION_ALIGNMENT = 4096;
+
+static uint64_t align(uint64_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+static bool write_at(int fd, void const* data, uint64_t size, uint64_t offset) {
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    while (size > 0) {
+        ssize_t count = pwrite(fd, bytes, size, offset);
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= count;
+        offset += count;
+    }
+    return true;
+}
+
+static bool read_at(int fd, void* data, uint64_t size, uint64_t offset) {
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t count = pread(fd, bytes, size, offset);
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= count;
+        offset += count;
+    }
+    return true;
+}
+
+bool Checkpoint::save(char const* path, System& system, CoreState const& core) {
+    std::vector<Device*> const& devices = system.get_devices();
+
+    // Contents are collected first, the section table precedes them
+    std::vector<Section> sections;
+    std::vector<void const*> contents;
+    std::vector<std::vector<uint8_t>> states(devices.size());
+    for (uint32_t i = 0; i < devices.size(); i++) {
+        Device::Dmi dmi;
+        if (devices[i]->get_dmi(dmi) && dmi.readable) {
+            sections.push_back(
+                Section{.device = i, .type = SECTION_MEMORY, .offset = 0, .size = dmi.size});
+            contents.push_back(dmi.data);
+        }
+
+        devices[i]->save_state(states[i]);
+        if (!states[i].empty()) {
+            sections.push_back(Section{
+                .device = i, .type = SECTION_STATE, .offset = 0, .size = states[i].size()});
+            contents.push_back(states[i].data());
+        }
+    }
+
+    uint64_t offset = sizeof(FileHeader) + sections.size() * sizeof(Section);
+    for (Section& section : sections) {
+        offset = section.type == SECTION_MEMORY ? align(offset) : (offset + 7) & ~uint64_t{7};
+        section.offset = offset;
+        offset += section.size;
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.section_count = static_cast<uint32_t>(sections.size());
+    header.cycle = system.get_cycle();
+    header.device_count = static_cast<uint32_t>(devices.size());
+    std::memcpy(header.core, core.words, sizeof(header.core));
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        printf("ERROR: Could not create checkpoint %s\n", path);
+        return false;
+    }
+
+    bool complete = write_at(fd, &header, sizeof(header), 0) &&
+                    write_at(fd, sections.data(), sections.size() * sizeof(Section),
+                             sizeof(header));
+    for (size_t i = 0; i < sections.size() && complete; i++) {
+        complete = write_at(fd, contents[i], sections[i].size, sections[i].offset);
+    }
+    close(fd);
+
+    if (!complete) {
+        printf("ERROR: Could not write checkpoint %s\n", path);
+    }
+    return complete;
+}
+
+bool Checkpoint::restore(char const* path, System& system, CoreState& core_out) {
+    std::vector<Device*> const& devices = system.get_devices();
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("ERROR: Could not open checkpoint %s\n", path);
+        return false;
+    }
+
+    FileHeader header;
+    std::vector<Section> sections;
+    bool valid = read_at(fd, &header, sizeof(header), 0) &&
+                 std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                 header.version == VERSION;
+    if (valid) {
+        sections.resize(header.section_count);
+        valid = read_at(fd, sections.data(), sections.size() * sizeof(Section), sizeof(header));
+    }
+    if (!valid) {
+        printf("ERROR: %s is not a checkpoint of version %u\n", path, VERSION);
+        close(fd);
+        return false;
+    }
+
+    if (header.device_count != devices.size()) {
+        printf("ERROR: Checkpoint %s was saved with %u devices instead of %zu\n", path,
+               header.device_count, devices.size());
+        close(fd);
+        return false;
+    }
+
+    bool complete = true;
+    std::vector<uint8_t> state;
+    for (Section const& section : sections) {
+        if (section.device >= devices.size()) {
+            complete = false;
+        } else if (section.type == SECTION_MEMORY) {
+            complete = devices[section.device]->load_dmi(path, section.offset, section.size);
+        } else {
+            state.resize(section.size);
+            complete = read_at(fd, state.data(), state.size(), section.offset) &&
+                       devices[section.device]->restore_state(state);
+        }
+
+        if (!complete) {
+            printf("ERROR: Could not restore device %u from checkpoint %s\n", section.device,
+                   path);
+            break;
+        }
+    }
+    close(fd);
+
+    if (!complete) {
+        return false;
+    }
+
+    std::memcpy(core_out.words, header.core, sizeof(header.core));
+    system.restore_cycle(header.cycle);
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+
+#include "system.h"
+
+// Architectural state of the core, in the order of the state port of eisv_core
+struct CoreState {
+    static constexpr int PC = 0;  // Followed by x1 to x31
+    static constexpr int CSR_BASE = 32;  // Plus the position in special_csr_t
+    static constexpr int MSTATUS = CSR_BASE + 1;
+    static constexpr int MIE = CSR_BASE + 3;
+    static constexpr int MTVEC = CSR_BASE + 4;
+    static constexpr int MSCRATCH = CSR_BASE + 5;
+    static constexpr int MEPC = CSR_BASE + 6;
+    static constexpr int MCAUSE = CSR_BASE + 7;
+    static constexpr int MTVAL = CSR_BASE + 8;
+    // Performance counters as 32 bit halves, the hpm registers of mhpmcounter3 to mhpmcounter6
+    static constexpr int MCOUNTINHIBIT = CSR_BASE + 10;
+    static constexpr int MCYCLE = CSR_BASE + 11;
+    static constexpr int MCYCLEH = CSR_BASE + 12;
+    static constexpr int MINSTRET = CSR_BASE + 13;
+    static constexpr int MINSTRETH = CSR_BASE + 14;
+    static constexpr int MHPMCOUNTER3 = CSR_BASE + 15;
+    static constexpr int MHPMCOUNTER3H = CSR_BASE + 19;
+    static constexpr int MHPMEVENT3 = CSR_BASE + 23;
+    static constexpr int HPM_COUNTERS = 4;
+    static constexpr int WORDS = MHPMEVENT3 + HPM_COUNTERS;
+
+    uint32_t words[WORDS];
+};
+
+// Snapshot of the core, the System cycle and all devices of a System.
+//
+// File layout: FileHeader, a Section per memory and per device state, then the section contents.
+// Memory sections start at page boundaries, so memories map them copy-on-write when restoring
+// instead of reading them, which makes starting many runs from the same checkpoint cheap.
+class Checkpoint {
+   public:
+    static constexpr char MAGIC[8] = {'E', 'I', 'S', 'V', 'C', 'K', 'P', '\0'};
+    static constexpr uint32_t VERSION = 2;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t section_count;
+        uint64_t cycle;
+        uint32_t device_count;
+        uint32_t core[CoreState::WORDS];
+    };
+
+    enum SectionType : uint32_t { SECTION_MEMORY, SECTION_STATE };
+
+    struct Section {
+        uint32_t device;  // Index into System::get_devices()
+        uint32_t type;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static bool save(char const* path, System& system, CoreState const& core);
+
+    // The System has to be set up with the same devices in the same order as when saving. Has to be
+    // called before any DMI pointer to its memories is acquired.
+    static bool restore(char const* path, System& system, CoreState& core_out);
+};
+
+#endif
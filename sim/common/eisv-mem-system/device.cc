@@ -1,3 +1,51 @@
 #include "device.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+Device::Timing Device::timing() {
+    return TIMING_TICK;
+}
+
 void Device::tick() {}
+
+uint64_t Device::next_wakeup(uint64_t cycle) {
+    return WAKEUP_NEVER;
+}
+
+void Device::wakeup(uint64_t cycle) {}
+
+bool Device::peek(uint32_t local_address, uint32_t& value_out) {
+    return false;
+}
+
+uint64_t Device::quiet_cycles() {
+    return QUIET_FOREVER;
+}
+
+bool Device::get_dmi(Dmi& dmi_out) {
+    return false;
+}
+
+void Device::save_state(std::vector<uint8_t>& state_out) {
+    state_out.clear();
+}
+
+bool Device::restore_state(std::vector<uint8_t> const& state) {
+    return state.empty();
+}
+
+bool Device::load_dmi(char const* path, uint64_t offset, uint64_t size) {
+    Dmi dmi;
+    if (!get_dmi(dmi) || !dmi.writable || dmi.size != size) {
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    bool complete = pread(fd, dmi.data, size, offset) == static_cast<ssize_t>(size);
+    close(fd);
+    return complete;
+}
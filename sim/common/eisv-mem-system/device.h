@@ -2,13 +2,72 @@
 #define DEVICE_H
 
 #include <cstdint>
+#include <limits>
+#include <vector>
 
 class Device {
    public:
+    // Host memory backing a device, which may be accessed directly instead of calling read/write
+    struct Dmi {
+        uint32_t* data;
+        uint32_t size;  // In bytes
+        bool readable;
+        bool writable;
+    };
+
     virtual bool write(uint32_t local_address, uint32_t value, uint8_t byte_enable) = 0;
     virtual bool read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) = 0;
+    // How System advances the device in time
+    enum Timing {
+        TIMING_NONE,    // Only reacts to accesses, neither tick() nor wakeup() are called
+        TIMING_TICK,    // tick() is called every cycle
+        TIMING_WAKEUP,  // wakeup() is called at the cycles requested by next_wakeup()
+    };
+    virtual Timing timing();
+
     virtual void tick();
 
+    // Cycle after the given one at which the device has to be woken up (e.g. because an interrupt
+    // line changes), WAKEUP_NEVER if none. Queried again after every wakeup and every access.
+    virtual uint64_t next_wakeup(uint64_t cycle);
+    virtual void wakeup(uint64_t cycle);
+
+    static constexpr uint64_t WAKEUP_NEVER = std::numeric_limits<uint64_t>::max();
+
+    // Read without side effects (e.g. no popping of receive queues), false if not supported
+    virtual bool peek(uint32_t local_address, uint32_t& value_out);
+
+    // Number of upcoming tick() calls that are guaranteed not to change any signal the device
+    // drives towards the core (e.g. an interrupt line) unless the device is accessed in between
+    virtual uint64_t quiet_cycles();
+
+    // Direct memory interface, false if accesses have to go through read/write. The pointer has to
+    // stay valid for the lifetime of the device.
+    virtual bool get_dmi(Dmi& dmi_out);
+
+    // Checkpoints. The memory behind get_dmi is saved by the checkpoint itself, state_out receives
+    // everything else the device needs to resume (e.g. registers and queues). restore_state gets
+    // back the same bytes and fails if they do not fit the device.
+    virtual void save_state(std::vector<uint8_t>& state_out);
+    virtual bool restore_state(std::vector<uint8_t> const& state);
+
+    // Replaces the memory behind get_dmi with bytes [offset, offset + size) of the file at path.
+    // The default copies them, devices may map the file instead (which invalidates DMI pointers).
+    virtual bool load_dmi(char const* path, uint64_t offset, uint64_t size);
+
+    // Expands a byte enable into a mask with 0xff for every enabled byte
+    static uint32_t byte_enable_mask(uint8_t byte_enable) {
+        uint32_t mask = 0;
+        for (int i = 0; i < 4; i++) {
+            if (byte_enable & (1 << i)) {
+                mask |= 0xffu << (8 * i);
+            }
+        }
+        return mask;
+    }
+
+    static constexpr uint64_t QUIET_FOREVER = std::numeric_limits<uint64_t>::max();
+
    private:
 };
 
@@ -0,0 +1,207 @@
+#include "elf_loader.h"
+
+#include <elf.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+bool ElfImage::find_symbol(char const* name, uint32_t& value_out) const {
+    for (ElfSymbol const& symbol : symbols) {
+        if (symbol.name == name) {
+            value_out = symbol.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool read_file(char const* path, std::vector<uint8_t>& data_out) {
+    std::FILE* in_file = std::fopen(path, "rb");
+    if (!in_file) {
+        return false;
+    }
+
+    std::fseek(in_file, 0, SEEK_END);
+    long size = std::ftell(in_file);
+    std::fseek(in_file, 0, SEEK_SET);
+
+    data_out.resize(size < 0 ? 0 : size);
+    bool complete = fread(data_out.data(), 1, data_out.size(), in_file) == data_out.size();
+    std::fclose(in_file);
+    return size >= 0 && complete;
+}
+
+// True if the structure at offset with the given size lies within the file
+static bool contains(std::vector<uint8_t> const& file, uint64_t offset, uint64_t size) {
+    return offset <= file.size() && size <= file.size() - offset;
+}
+
+// Writes the bytes [address, address + size) within one word through System::write, skipping zeros
+// that are already there so sparse memories are not populated by zero-filling
+static bool place_word(System& system, uint32_t address, uint8_t const* data, uint32_t size) {
+    uint32_t word_address = address & ~3u;
+    uint32_t old_value;
+    if (!system.peek(word_address, old_value)) {
+        return false;
+    }
+
+    uint32_t value = 0;
+    if (data) {
+        memcpy(reinterpret_cast<uint8_t*>(&value) + (address & 3), data, size);
+    }
+    uint8_t byte_enable = ((1 << size) - 1) << (address & 3);
+    if ((old_value & Device::byte_enable_mask(byte_enable)) == value) {
+        return true;
+    }
+    return system.write(word_address, value, byte_enable, System::PORT_OTHER);
+}
+
+// Copies size bytes from data to the memory at address, or zero-fills it if data is nullptr. The
+// range may span several devices. Memories without DMI are written word by word, they are told
+// apart from devices with side effects by supporting peek.
+static bool place(System& system, uint32_t address, uint8_t const* data, uint32_t size) {
+    while (size > 0) {
+        uint32_t chunk;
+        System::Dmi dmi;
+        if (system.acquire_dmi(address, dmi) && dmi.writable && address - dmi.first < dmi.size) {
+            uint32_t offset = address - dmi.first;
+            chunk = std::min(size, dmi.size - offset);
+            uint8_t* target = reinterpret_cast<uint8_t*>(dmi.data) + offset;
+            if (data) {
+                memcpy(target, data, chunk);
+            } else {
+                memset(target, 0, chunk);
+            }
+        } else {
+            // Up to the next 4 KB boundary before looking for DMI again
+            chunk = std::min<uint64_t>(size, 0x1000 - (address & 0xfff));
+            for (uint32_t done = 0; done < chunk;) {
+                uint32_t bytes = std::min(chunk - done, 4 - ((address + done) & 3));
+                if (!place_word(system, address + done, data ? data + done : nullptr, bytes)) {
+                    printf("ERROR: ELF segment at %08x is not backed by memory\n", address + done);
+                    system.release_dmi(dmi);
+                    return false;
+                }
+                done += bytes;
+            }
+        }
+        system.release_dmi(dmi);
+
+        address += chunk;
+        size -= chunk;
+        if (data) {
+            data += chunk;
+        }
+    }
+    return true;
+}
+
+static void read_symbols(std::vector<uint8_t> const& file, Elf32_Ehdr const& header,
+                         std::vector<ElfSymbol>& symbols_out) {
+    if (header.e_shentsize != sizeof(Elf32_Shdr) ||
+        !contains(file, header.e_shoff, uint64_t{header.e_shnum} * sizeof(Elf32_Shdr))) {
+        return;
+    }
+    Elf32_Shdr const* sections = reinterpret_cast<Elf32_Shdr const*>(file.data() + header.e_shoff);
+
+    for (int i = 0; i < header.e_shnum; i++) {
+        Elf32_Shdr const& section = sections[i];
+        if (section.sh_type != SHT_SYMTAB || section.sh_link >= header.e_shnum ||
+            !contains(file, section.sh_offset, section.sh_size)) {
+            continue;
+        }
+
+        Elf32_Shdr const& strings = sections[section.sh_link];
+        if (!contains(file, strings.sh_offset, strings.sh_size)) {
+            continue;
+        }
+        char const* names = reinterpret_cast<char const*>(file.data() + strings.sh_offset);
+
+        Elf32_Sym const* symbols =
+            reinterpret_cast<Elf32_Sym const*>(file.data() + section.sh_offset);
+        for (size_t j = 0; j < section.sh_size / sizeof(Elf32_Sym); j++) {
+            Elf32_Sym const& symbol = symbols[j];
+            int type = ELF32_ST_TYPE(symbol.st_info);
+            if (symbol.st_name == 0 || symbol.st_name >= strings.sh_size ||
+                symbol.st_shndx == SHN_UNDEF || type == STT_SECTION || type == STT_FILE) {
+                continue;
+            }
+
+            symbols_out.push_back(ElfSymbol{
+                .name = std::string(names + symbol.st_name,
+                                    strnlen(names + symbol.st_name,
+                                            strings.sh_size - symbol.st_name)),
+                .value = symbol.st_value,
+                .size = symbol.st_size,
+                .is_function = type == STT_FUNC,
+            });
+        }
+    }
+}
+
+bool load_elf(char const* path, System& system, ElfImage& image_out) {
+    std::vector<uint8_t> file;
+    if (!read_file(path, file)) {
+        printf("ERROR: Could not read ELF file %s\n", path);
+        return false;
+    }
+
+    if (!contains(file, 0, sizeof(Elf32_Ehdr))) {
+        printf("ERROR: %s is too small for an ELF file\n", path);
+        return false;
+    }
+    Elf32_Ehdr header;
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS32 ||
+        header.e_ident[EI_DATA] != ELFDATA2LSB) {
+        printf("ERROR: %s is not a little endian ELF32 file\n", path);
+        return false;
+    }
+    if (header.e_type != ET_EXEC || header.e_machine != EM_RISCV) {
+        printf("ERROR: %s is not a RISC-V executable\n", path);
+        return false;
+    }
+    if (header.e_phentsize != sizeof(Elf32_Phdr) ||
+        !contains(file, header.e_phoff, uint64_t{header.e_phnum} * sizeof(Elf32_Phdr))) {
+        printf("ERROR: %s has invalid program headers\n", path);
+        return false;
+    }
+
+    Elf32_Phdr const* segments = reinterpret_cast<Elf32_Phdr const*>(file.data() + header.e_phoff);
+    for (int i = 0; i < header.e_phnum; i++) {
+        Elf32_Phdr const& segment = segments[i];
+        if (segment.p_type != PT_LOAD || segment.p_memsz == 0) {
+            continue;
+        }
+        if (segment.p_filesz > segment.p_memsz ||
+            !contains(file, segment.p_offset, segment.p_filesz)) {
+            printf("ERROR: %s has an invalid segment at %08x\n", path, segment.p_paddr);
+            return false;
+        }
+
+        if (!place(system, segment.p_paddr, file.data() + segment.p_offset, segment.p_filesz) ||
+            !place(system, segment.p_paddr + segment.p_filesz, nullptr,
+                   segment.p_memsz - segment.p_filesz)) {
+            return false;
+        }
+    }
+
+    image_out.entry = header.e_entry;
+    image_out.symbols.clear();
+    read_symbols(file, header, image_out.symbols);
+    return true;
+}
+
+bool is_elf_file(char const* path) {
+    std::FILE* in_file = std::fopen(path, "rb");
+    if (!in_file) {
+        return false;
+    }
+
+    char magic[SELFMAG];
+    bool elf = fread(magic, 1, SELFMAG, in_file) == SELFMAG && memcmp(magic, ELFMAG, SELFMAG) == 0;
+    std::fclose(in_file);
+    return elf;
+}
@@ -0,0 +1,32 @@
+#ifndef ELF_LOADER_H
+#define ELF_LOADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "system.h"
+
+struct ElfSymbol {
+    std::string name;
+    uint32_t value;
+    uint32_t size;
+    bool is_function;
+};
+
+struct ElfImage {
+    uint32_t entry;
+    std::vector<ElfSymbol> symbols;
+
+    bool find_symbol(char const* name, uint32_t& value_out) const;
+};
+
+// Loads a little endian ELF32 executable. Every PT_LOAD segment is copied to the devices backing
+// its physical address in system, the remainder up to the memory size (.bss) is zero-filled.
+// Segments have to be placed in memories, i.e. devices supporting DMI or peek.
+bool load_elf(char const* path, System& system, ElfImage& image_out);
+
+// True if the file at path starts with the ELF magic
+bool is_elf_file(char const* path);
+
+#endif
@@ -0,0 +1,927 @@
+#include "iss.h"
+
+#include <algorithm>
+#include <climits>
+
+// Handlers in run() are listed in the same order
+enum Op : uint8_t {
+    OP_UNDECODED,
+    OP_ILLEGAL,
+    OP_LUI,
+    OP_AUIPC,
+    OP_JAL,
+    OP_JALR,
+    OP_BEQ,
+    OP_BNE,
+    OP_BLT,
+    OP_BGE,
+    OP_BLTU,
+    OP_BGEU,
+    OP_LB,
+    OP_LH,
+    OP_LW,
+    OP_LBU,
+    OP_LHU,
+    OP_SB,
+    OP_SH,
+    OP_SW,
+    OP_ADDI,
+    OP_SLTI,
+    OP_SLTIU,
+    OP_XORI,
+    OP_ORI,
+    OP_ANDI,
+    OP_SLLI,
+    OP_SRLI,
+    OP_SRAI,
+    OP_ADD,
+    OP_SUB,
+    OP_SLL,
+    OP_SLT,
+    OP_SLTU,
+    OP_XOR,
+    OP_SRL,
+    OP_SRA,
+    OP_OR,
+    OP_AND,
+    OP_MUL,
+    OP_MULH,
+    OP_MULHSU,
+    OP_MULHU,
+    OP_DIV,
+    OP_DIVU,
+    OP_REM,
+    OP_REMU,
+    OP_FENCE,
+    OP_ECALL,
+    OP_EBREAK,
+    OP_MRET,
+    OP_CSRRW,
+    OP_CSRRS,
+    OP_CSRRC,
+    OP_CSRRWI,
+    OP_CSRRSI,
+    OP_CSRRCI,
+    OP_COUNT,
+};
+
+constexpr uint32_t MSTATUS_MIE = 1u << 3;
+constexpr uint32_t MSTATUS_MPIE = 1u << 7;
+constexpr uint32_t MIE_MTIE = 1u << 7;
+constexpr uint32_t MIE_MEIE = 1u << 11;
+
+// Bits of mcountinhibit and the mhpmevent values after reset, as in eisv_csrs
+constexpr uint32_t MCOUNTINHIBIT_MASK = 0x7d;
+constexpr uint32_t HPM_RESET_EVENTS[Iss::HPM_COUNTERS] = {1, 2, 3, 4};
+constexpr uint32_t HPM_EVENTS = 11;
+
+constexpr uint32_t CAUSE_INSTRUCTION_ADDRESS_MISALIGNED = 0;
+constexpr uint32_t CAUSE_ILLEGAL_INSTRUCTION = 2;
+constexpr uint32_t CAUSE_BREAKPOINT = 3;
+constexpr uint32_t CAUSE_LOAD_ADDRESS_MISALIGNED = 4;
+constexpr uint32_t CAUSE_STORE_ADDRESS_MISALIGNED = 6;
+constexpr uint32_t CAUSE_ENVIRONMENT_CALL = 11;
+constexpr uint32_t CAUSE_TIMER_INTERRUPT = (1u << 31) | 7;
+
+// 64 bit counter from its two halves in a CoreState
+static uint64_t state_counter(CoreState const& state, int low, int high) {
+    return (uint64_t{state.words[high]} << 32) | state.words[low];
+}
+
+Iss::Iss(System& system, bool m_extension, bool const& timer_interrupt_pending, bool const& stop)
+    : system(system),
+      m_extension(m_extension),
+      timer_interrupt_pending(timer_interrupt_pending),
+      stop(stop) {
+    reset();
+}
+
+Iss::~Iss() {
+    for (std::unique_ptr<Window>& window : windows) {
+        system.release_dmi(window->dmi);
+    }
+}
+
+void Iss::reset() {
+    pc = 0;
+    std::fill(x, x + 33, 0);
+    mstatus = 0;
+    mie = MIE_MTIE | MIE_MEIE;
+    mtvec = 0;
+    mscratch = 0;
+    mepc = 0;
+    mcause = 0;
+    mtval = 0;
+    mcountinhibit = 0;
+    write_counter(COUNTER_MCYCLE, 0);
+    write_counter(COUNTER_MINSTRET, 0);
+    std::fill(mhpmcounter, mhpmcounter + HPM_COUNTERS, 0);
+    std::copy(HPM_RESET_EVENTS, HPM_RESET_EVENTS + HPM_COUNTERS, mhpmevent);
+}
+
+void Iss::set_state(CoreState const& state) {
+    pc = state.words[CoreState::PC];
+    for (int i = 1; i < 32; i++) {
+        x[i] = state.words[i];
+    }
+    mstatus = state.words[CoreState::MSTATUS] & (MSTATUS_MIE | MSTATUS_MPIE);
+    mie = state.words[CoreState::MIE] & (MIE_MTIE | MIE_MEIE);
+    mtvec = state.words[CoreState::MTVEC];
+    mscratch = state.words[CoreState::MSCRATCH];
+    mepc = state.words[CoreState::MEPC];
+    mcause = state.words[CoreState::MCAUSE] & ((1u << 31) | 0x3f);
+    mtval = state.words[CoreState::MTVAL];
+    mcountinhibit = state.words[CoreState::MCOUNTINHIBIT] & MCOUNTINHIBIT_MASK;
+    write_counter(COUNTER_MCYCLE, state_counter(state, CoreState::MCYCLE, CoreState::MCYCLEH));
+    write_counter(COUNTER_MINSTRET,
+                  state_counter(state, CoreState::MINSTRET, CoreState::MINSTRETH));
+    for (int i = 0; i < HPM_COUNTERS; i++) {
+        mhpmcounter[i] =
+            state_counter(state, CoreState::MHPMCOUNTER3 + i, CoreState::MHPMCOUNTER3H + i);
+        uint32_t event = state.words[CoreState::MHPMEVENT3 + i];
+        mhpmevent[i] = event < HPM_EVENTS ? event : 0;
+    }
+}
+
+CoreState Iss::get_state() const {
+    CoreState state = {};
+    state.words[CoreState::PC] = pc;
+    for (int i = 1; i < 32; i++) {
+        state.words[i] = x[i];
+    }
+    state.words[CoreState::MSTATUS] = mstatus;
+    state.words[CoreState::MIE] = mie;
+    state.words[CoreState::MTVEC] = mtvec;
+    state.words[CoreState::MSCRATCH] = mscratch;
+    state.words[CoreState::MEPC] = mepc;
+    state.words[CoreState::MCAUSE] = mcause;
+    state.words[CoreState::MTVAL] = mtval;
+    state.words[CoreState::MCOUNTINHIBIT] = mcountinhibit;
+    uint64_t mcycle = read_counter(COUNTER_MCYCLE);
+    state.words[CoreState::MCYCLE] = mcycle;
+    state.words[CoreState::MCYCLEH] = mcycle >> 32;
+    uint64_t minstret = read_counter(COUNTER_MINSTRET);
+    state.words[CoreState::MINSTRET] = minstret;
+    state.words[CoreState::MINSTRETH] = minstret >> 32;
+    for (int i = 0; i < HPM_COUNTERS; i++) {
+        state.words[CoreState::MHPMCOUNTER3 + i] = mhpmcounter[i];
+        state.words[CoreState::MHPMCOUNTER3H + i] = mhpmcounter[i] >> 32;
+        state.words[CoreState::MHPMEVENT3 + i] = mhpmevent[i];
+    }
+    return state;
+}
+
+uint64_t Iss::get_instructions() const {
+    return instructions;
+}
+
+void Iss::interrupt(uint32_t cause) {
+    trap(cause, pc);
+}
+
+uint64_t Iss::get_traps() const {
+    return traps;
+}
+
+static uint32_t imm_i(uint32_t instruction) {
+    return static_cast<int32_t>(instruction) >> 20;
+}
+
+static uint32_t imm_s(uint32_t instruction) {
+    return (static_cast<int32_t>(instruction) >> 25 << 5) | ((instruction >> 7) & 0x1f);
+}
+
+static uint32_t imm_b(uint32_t instruction) {
+    return (static_cast<int32_t>(instruction) >> 31 << 12) | (((instruction >> 7) & 1) << 11) |
+           (((instruction >> 25) & 0x3f) << 5) | (((instruction >> 8) & 0xf) << 1);
+}
+
+static uint32_t imm_j(uint32_t instruction) {
+    return (static_cast<int32_t>(instruction) >> 31 << 20) | (instruction & 0xff000) |
+           (((instruction >> 20) & 1) << 11) | (((instruction >> 21) & 0x3ff) << 1);
+}
+
+Iss::Decoded Iss::decode(uint32_t instruction) const {
+    uint32_t opcode = instruction & 0x7f;
+    uint32_t rd = (instruction >> 7) & 0x1f;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+    uint32_t rs1 = (instruction >> 15) & 0x1f;
+    uint32_t rs2 = (instruction >> 20) & 0x1f;
+    uint32_t funct7 = instruction >> 25;
+
+    Decoded decoded = {
+        .op = OP_ILLEGAL,
+        .rd = static_cast<uint8_t>(rd == 0 ? 32 : rd),
+        .rs1 = static_cast<uint8_t>(rs1),
+        .rs2 = static_cast<uint8_t>(rs2),
+        .imm = imm_i(instruction),
+    };
+
+    switch (opcode) {
+        case 0x37:
+            decoded.op = OP_LUI;
+            decoded.imm = instruction & 0xfffff000;
+            break;
+        case 0x17:
+            decoded.op = OP_AUIPC;
+            decoded.imm = instruction & 0xfffff000;
+            break;
+        case 0x6f:
+            decoded.op = OP_JAL;
+            decoded.imm = imm_j(instruction);
+            break;
+        case 0x67:
+            decoded.op = funct3 == 0 ? OP_JALR : OP_ILLEGAL;
+            break;
+        case 0x63: {
+            static constexpr uint8_t BRANCHES[8] = {OP_BEQ,     OP_BNE, OP_ILLEGAL, OP_ILLEGAL,
+                                                    OP_BLT,     OP_BGE, OP_BLTU,    OP_BGEU};
+            decoded.op = BRANCHES[funct3];
+            decoded.imm = imm_b(instruction);
+            break;
+        }
+        case 0x03: {
+            static constexpr uint8_t LOADS[8] = {OP_LB,  OP_LH,  OP_LW,      OP_ILLEGAL,
+                                                 OP_LBU, OP_LHU, OP_ILLEGAL, OP_ILLEGAL};
+            decoded.op = LOADS[funct3];
+            break;
+        }
+        case 0x23: {
+            static constexpr uint8_t STORES[8] = {OP_SB,      OP_SH,      OP_SW,      OP_ILLEGAL,
+                                                  OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL};
+            decoded.op = STORES[funct3];
+            decoded.imm = imm_s(instruction);
+            break;
+        }
+        case 0x13: {
+            static constexpr uint8_t OP_IMMS[8] = {OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU,
+                                                   OP_XORI, OP_SRLI, OP_ORI,  OP_ANDI};
+            decoded.op = OP_IMMS[funct3];
+            if (funct3 == 1) {
+                decoded.op = funct7 == 0 ? OP_SLLI : OP_ILLEGAL;
+            } else if (funct3 == 5) {
+                decoded.op = funct7 == 0 ? OP_SRLI : funct7 == 0x20 ? OP_SRAI : OP_ILLEGAL;
+            }
+            break;
+        }
+        case 0x33: {
+            static constexpr uint8_t OPS[8] = {OP_ADD, OP_SLL, OP_SLT, OP_SLTU,
+                                               OP_XOR, OP_SRL, OP_OR,  OP_AND};
+            static constexpr uint8_t M_OPS[8] = {OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU,
+                                                 OP_DIV, OP_DIVU, OP_REM,    OP_REMU};
+            if (funct7 == 0) {
+                decoded.op = OPS[funct3];
+            } else if (funct7 == 0x20 && (funct3 == 0 || funct3 == 5)) {
+                decoded.op = funct3 == 0 ? OP_SUB : OP_SRA;
+            } else if (funct7 == 1 && m_extension) {
+                decoded.op = M_OPS[funct3];
+            }
+            break;
+        }
+        case 0x0f:
+            decoded.op = funct3 == 0 ? OP_FENCE : OP_ILLEGAL;
+            break;
+        case 0x73: {
+            static constexpr uint8_t CSR_OPS[8] = {OP_ILLEGAL, OP_CSRRW,  OP_CSRRS,  OP_CSRRC,
+                                                   OP_ILLEGAL, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI};
+            decoded.imm = instruction >> 20;
+            if (funct3 != 0) {
+                decoded.op = csr_implemented(decoded.imm) ? CSR_OPS[funct3] : uint8_t{OP_ILLEGAL};
+            } else if (rs1 == 0 && rd == 0) {
+                // Everything else, including WFI, is illegal on eisv_core
+                switch (decoded.imm) {
+                    case 0x000:
+                        decoded.op = OP_ECALL;
+                        break;
+                    case 0x001:
+                        decoded.op = OP_EBREAK;
+                        break;
+                    case 0x302:
+                        decoded.op = OP_MRET;
+                        break;
+                }
+            }
+            break;
+        }
+    }
+    return decoded;
+}
+
+// Same decode as eisv_ctrl_unit
+bool Iss::csr_implemented(uint32_t address) const {
+    // Counters and counter setup, hardwired to zero where there is no counter
+    if ((address & ~0x1fu) == 0xb00 || (address & ~0x1fu) == 0xb80 ||
+        (address & ~0x1fu) == 0x320) {
+        return true;
+    }
+    switch (address) {
+        case 0xf11:  // mvendorid
+        case 0xf12:  // marchid
+        case 0xf13:  // mimpid
+        case 0xf14:  // mhartid
+        case 0xf15:  // mconfigptr
+        case 0x300:  // mstatus
+        case 0x301:  // misa
+        case 0x304:  // mie
+        case 0x305:  // mtvec
+        case 0x310:  // mstatush
+        case 0x340:  // mscratch
+        case 0x341:  // mepc
+        case 0x342:  // mcause
+        case 0x343:  // mtval
+        case 0x344:  // mip
+        case 0x34a:  // mtinst
+        case 0x34b:  // mtval2
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t Iss::read_csr(uint32_t address) const {
+    switch (address) {
+        case 0x300:
+            return mstatus | (1u << 8) | (3u << 11);  // SPP and MPP read as set
+        case 0x301:
+            return (1u << 30) | (1u << 8) | (m_extension << 12);
+        case 0x304:
+            return mie;
+        case 0x305:
+            return mtvec;
+        case 0x340:
+            return mscratch;
+        case 0x341:
+            return mepc;
+        case 0x342:
+            return mcause;
+        case 0x343:
+            return mtval;
+        case 0x344:
+            // eisv_csrs reports the timer interrupt in bit 11 and the external one in bit 7
+            return timer_interrupt_pending << 11;
+        case 0x320:
+            return mcountinhibit;
+        case 0xb00:
+            return read_counter(COUNTER_MCYCLE);
+        case 0xb80:
+            return read_counter(COUNTER_MCYCLE) >> 32;
+        case 0xb02:
+            return read_counter(COUNTER_MINSTRET);
+        case 0xb82:
+            return read_counter(COUNTER_MINSTRET) >> 32;
+        default:
+            if (address >= 0x323 && address < 0x323 + HPM_COUNTERS) {
+                return mhpmevent[address - 0x323];
+            }
+            if (address >= 0xb03 && address < 0xb03 + HPM_COUNTERS) {
+                return mhpmcounter[address - 0xb03];
+            }
+            if (address >= 0xb83 && address < 0xb83 + HPM_COUNTERS) {
+                return mhpmcounter[address - 0xb83] >> 32;
+            }
+            return 0;  // Including mhartid of the only hart
+    }
+}
+
+void Iss::write_csr(uint32_t address, uint32_t value) {
+    switch (address) {
+        case 0x300:
+            mstatus = value & (MSTATUS_MIE | MSTATUS_MPIE);
+            break;
+        case 0x304:
+            mie = value & (MIE_MTIE | MIE_MEIE);
+            break;
+        case 0x305:
+            mtvec = value;
+            break;
+        case 0x340:
+            mscratch = value;
+            break;
+        case 0x341:
+            mepc = value;
+            break;
+        case 0x342:
+            mcause = value & ((1u << 31) | 0x3f);
+            break;
+        case 0x343:
+            mtval = value;
+            break;
+        case 0x320: {
+            uint64_t mcycle = read_counter(COUNTER_MCYCLE);
+            uint64_t minstret = read_counter(COUNTER_MINSTRET);
+            mcountinhibit = value & MCOUNTINHIBIT_MASK;
+            write_counter(COUNTER_MCYCLE, mcycle);
+            write_counter(COUNTER_MINSTRET, minstret);
+            break;
+        }
+        case 0xb00:
+        case 0xb80:
+        case 0xb02:
+        case 0xb82: {
+            int counter = (address & 0x7f) == 0 ? COUNTER_MCYCLE : COUNTER_MINSTRET;
+            uint64_t old = read_counter(counter);
+            if (address & 0x80) {
+                write_counter(counter, (old & 0xffffffffu) | (uint64_t{value} << 32));
+            } else {
+                write_counter(counter, (old & ~uint64_t{0xffffffffu}) | value);
+            }
+            break;
+        }
+        default:
+            if (address >= 0x323 && address < 0x323 + HPM_COUNTERS) {
+                mhpmevent[address - 0x323] = value < HPM_EVENTS ? value : 0;
+            } else if (address >= 0xb03 && address < 0xb03 + HPM_COUNTERS) {
+                uint64_t& counter = mhpmcounter[address - 0xb03];
+                counter = (counter & ~uint64_t{0xffffffffu}) | value;
+            } else if (address >= 0xb83 && address < 0xb83 + HPM_COUNTERS) {
+                uint64_t& counter = mhpmcounter[address - 0xb83];
+                counter = (counter & 0xffffffffu) | (uint64_t{value} << 32);
+            }
+            break;
+    }
+}
+
+// Bit 0 of mcountinhibit inhibits mcycle, bit 2 minstret
+uint64_t Iss::read_counter(int counter) const {
+    bool inhibited = mcountinhibit & (1u << (2 * counter));
+    return inhibited ? counters[counter] : instructions + counters[counter];
+}
+
+void Iss::write_counter(int counter, uint64_t value) {
+    bool inhibited = mcountinhibit & (1u << (2 * counter));
+    counters[counter] = inhibited ? value : value - instructions;
+}
+
+void Iss::execute_csr(Decoded const& decoded, uint32_t operand) {
+    uint32_t old = read_csr(decoded.imm);
+    switch (decoded.op) {
+        case OP_CSRRW:
+        case OP_CSRRWI:
+            write_csr(decoded.imm, operand);
+            break;
+        case OP_CSRRS:
+        case OP_CSRRSI:
+            if (decoded.rs1 != 0) {
+                write_csr(decoded.imm, old | operand);
+            }
+            break;
+        case OP_CSRRC:
+        case OP_CSRRCI:
+            if (decoded.rs1 != 0) {
+                write_csr(decoded.imm, old & ~operand);
+            }
+            break;
+    }
+    x[decoded.rd] = old;
+}
+
+// Only interrupts disable further interrupts on eisv_core, exceptions leave mstatus alone
+void Iss::trap(uint32_t cause, uint32_t epc) {
+    if (cause & (1u << 31)) {
+        mstatus = ((mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0);
+    }
+    mepc = epc;
+    mcause = cause;
+    pc = mtvec;
+    traps++;
+}
+
+void Iss::catch_up() {
+    system.advance(instructions - synced);
+    synced = instructions;
+}
+
+Iss::Window* Iss::find_window(uint32_t address) {
+    for (std::unique_ptr<Window>& window : windows) {
+        if (address - window->dmi.first < window->dmi.size) {
+            return window.get();
+        }
+    }
+
+    // Windows cleared by a change of the memory map are replaced
+    auto stale = [](std::unique_ptr<Window> const& window) { return window->dmi.size == 0; };
+    if (std::any_of(windows.begin(), windows.end(), stale)) {
+        fetch_window = &no_window;
+        data_window = &no_window;
+        windows.erase(std::remove_if(windows.begin(), windows.end(), stale), windows.end());
+    }
+
+    std::unique_ptr<Window> window(new Window);
+    if (!system.acquire_dmi(address, window->dmi)) {
+        return nullptr;
+    }
+    window->decoded.assign(window->dmi.size / 4,
+                           Decoded{.op = OP_UNDECODED, .rd = 0, .rs1 = 0, .rs2 = 0, .imm = 0});
+    windows.push_back(std::move(window));
+    return windows.back().get();
+}
+
+// Device accesses see the System at the current instruction and may change when the next
+// interrupt is due, so the System catches up again after the instruction
+uint32_t Iss::load(uint32_t address) {
+    uint32_t offset = address - data_window->dmi.first;
+    if (offset < data_window->dmi.size) {
+        return data_window->dmi.data[offset >> 2];
+    }
+
+    if (Window* window = find_window(address)) {
+        data_window = window;
+        return window->dmi.data[(address - window->dmi.first) >> 2];
+    }
+
+    catch_up();
+    limit = instructions + 1;
+    uint32_t value = 0;
+    system.read(address & ~3u, value, 0b1111);
+    return value;
+}
+
+void Iss::store(uint32_t address, uint32_t value, uint8_t byte_enable) {
+    uint32_t offset = address - data_window->dmi.first;
+    if (offset >= data_window->dmi.size) {
+        Window* window = find_window(address);
+        data_window = window ? window : &no_window;
+        offset = address - data_window->dmi.first;
+    }
+
+    if (offset < data_window->dmi.size && data_window->dmi.writable) {
+        uint32_t mask = Device::byte_enable_mask(byte_enable);
+        uint32_t& word = data_window->dmi.data[offset >> 2];
+        word = (word & ~mask) | (value & mask);
+        data_window->decoded[offset >> 2].op = OP_UNDECODED;
+        return;
+    }
+
+    catch_up();
+    limit = instructions + 1;
+    system.write(address & ~3u, value, byte_enable);
+}
+
+// Fetches outside of DMI memory are decoded every time, failing ones read as 0 (illegal) like in
+// the testbench
+uint32_t Iss::fetch_uncached(uint32_t address) {
+    catch_up();
+    limit = instructions + 1;
+    uint32_t value = 0;
+    system.read(address, value, 0b1111, System::PORT_IMEM);
+    return value;
+}
+
+Iss::StopReason Iss::run(uint64_t max_instructions, uint64_t stop_pc) {
+    static void* const HANDLERS[OP_COUNT] = {
+        &&op_undecoded, &&op_illegal, &&op_lui,    &&op_auipc,  &&op_jal,    &&op_jalr,
+        &&op_beq,       &&op_bne,     &&op_blt,    &&op_bge,    &&op_bltu,   &&op_bgeu,
+        &&op_lb,        &&op_lh,      &&op_lw,     &&op_lbu,    &&op_lhu,    &&op_sb,
+        &&op_sh,        &&op_sw,      &&op_addi,   &&op_slti,   &&op_sltiu,  &&op_xori,
+        &&op_ori,       &&op_andi,    &&op_slli,   &&op_srli,   &&op_srai,   &&op_add,
+        &&op_sub,       &&op_sll,     &&op_slt,    &&op_sltu,   &&op_xor,    &&op_srl,
+        &&op_sra,       &&op_or,      &&op_and,    &&op_mul,    &&op_mulh,   &&op_mulhsu,
+        &&op_mulhu,     &&op_div,     &&op_divu,   &&op_rem,    &&op_remu,   &&op_fence,
+        &&op_ecall,     &&op_ebreak,  &&op_mret,   &&op_csrrw,  &&op_csrrs,  &&op_csrrc,
+        &&op_csrrwi,    &&op_csrrsi,  &&op_csrrci,
+    };
+
+    uint64_t end = instructions + std::min(max_instructions, UINT64_MAX - instructions);
+    Decoded* d;
+    Decoded uncached;
+    limit = instructions;
+
+// Every handler dispatches the next instruction on its own
+#define DISPATCH()                                          \
+    do {                                                    \
+        if (instructions >= limit) {                        \
+            goto sync;                                      \
+        }                                                   \
+        if (pc == stop_pc) {                                \
+            goto stop_at_pc;                                \
+        }                                                   \
+        uint32_t offset = pc - fetch_window->dmi.first;     \
+        if (offset >= fetch_window->dmi.size) {             \
+            goto fetch;                                     \
+        }                                                   \
+        d = &fetch_window->decoded[offset >> 2];            \
+        goto* HANDLERS[d->op];                              \
+    } while (0)
+
+#define NEXT(next_pc)   \
+    do {                \
+        pc = (next_pc); \
+        instructions++; \
+        DISPATCH();     \
+    } while (0)
+
+#define TRAP(cause)         \
+    do {                    \
+        trap((cause), pc);  \
+        instructions++;     \
+        DISPATCH();         \
+    } while (0)
+
+#define BRANCH(condition)                                            \
+    do {                                                             \
+        uint32_t target = pc + d->imm;                               \
+        if (!(condition)) {                                          \
+            NEXT(pc + 4);                                            \
+        }                                                            \
+        if (target & 3) {                                            \
+            mtval = target;                                          \
+            TRAP(CAUSE_INSTRUCTION_ADDRESS_MISALIGNED);              \
+        }                                                            \
+        NEXT(target);                                                \
+    } while (0)
+
+    DISPATCH();
+
+sync:
+    catch_up();
+    if (stop) {
+        return STOP_FLAG;
+    }
+    if (instructions >= end) {
+        return STOP_INSTRUCTIONS;
+    }
+    if ((mstatus & MSTATUS_MIE) && (mie & MIE_MTIE) && timer_interrupt_pending) {
+        trap(CAUSE_TIMER_INTERRUPT, pc);
+    }
+    {
+        uint64_t quiet = system.quiet_cycles();
+        limit = end - instructions <= quiet ? end : instructions + quiet + 1;
+    }
+    if (pc == stop_pc) {
+        goto stop_at_pc;
+    }
+    DISPATCH();
+
+stop_at_pc:
+    catch_up();
+    return STOP_PC;
+
+fetch:
+    if (Window* window = find_window(pc)) {
+        fetch_window = window;
+        DISPATCH();
+    }
+    fetch_window = &no_window;
+    uncached = decode(fetch_uncached(pc));
+    d = &uncached;
+    goto* HANDLERS[d->op];
+
+op_undecoded:
+    *d = decode(fetch_window->dmi.data[(pc - fetch_window->dmi.first) >> 2]);
+    goto* HANDLERS[d->op];
+
+op_illegal:
+    TRAP(CAUSE_ILLEGAL_INSTRUCTION);
+
+op_lui:
+    x[d->rd] = d->imm;
+    NEXT(pc + 4);
+
+op_auipc:
+    x[d->rd] = pc + d->imm;
+    NEXT(pc + 4);
+
+op_jal: {
+    uint32_t target = pc + d->imm;
+    if (target & 3) {
+        mtval = target;
+        TRAP(CAUSE_INSTRUCTION_ADDRESS_MISALIGNED);
+    }
+    x[d->rd] = pc + 4;
+    NEXT(target);
+}
+
+op_jalr: {
+    // eisv_core does not clear bit 0 of the target, so it traps as misaligned instead
+    uint32_t target = x[d->rs1] + d->imm;
+    if (target & 3) {
+        mtval = target;
+        TRAP(CAUSE_INSTRUCTION_ADDRESS_MISALIGNED);
+    }
+    x[d->rd] = pc + 4;
+    NEXT(target);
+}
+
+op_beq:
+    BRANCH(x[d->rs1] == x[d->rs2]);
+op_bne:
+    BRANCH(x[d->rs1] != x[d->rs2]);
+op_blt:
+    BRANCH(static_cast<int32_t>(x[d->rs1]) < static_cast<int32_t>(x[d->rs2]));
+op_bge:
+    BRANCH(static_cast<int32_t>(x[d->rs1]) >= static_cast<int32_t>(x[d->rs2]));
+op_bltu:
+    BRANCH(x[d->rs1] < x[d->rs2]);
+op_bgeu:
+    BRANCH(x[d->rs1] >= x[d->rs2]);
+
+op_lb: {
+    uint32_t address = x[d->rs1] + d->imm;
+    x[d->rd] = static_cast<int8_t>(load(address) >> (8 * (address & 3)));
+    NEXT(pc + 4);
+}
+
+op_lbu: {
+    uint32_t address = x[d->rs1] + d->imm;
+    x[d->rd] = static_cast<uint8_t>(load(address) >> (8 * (address & 3)));
+    NEXT(pc + 4);
+}
+
+op_lh: {
+    uint32_t address = x[d->rs1] + d->imm;
+    if (address & 1) {
+        mtval = address;
+        TRAP(CAUSE_LOAD_ADDRESS_MISALIGNED);
+    }
+    x[d->rd] = static_cast<int16_t>(load(address) >> (8 * (address & 2)));
+    NEXT(pc + 4);
+}
+
+op_lhu: {
+    uint32_t address = x[d->rs1] + d->imm;
+    if (address & 1) {
+        mtval = address;
+        TRAP(CAUSE_LOAD_ADDRESS_MISALIGNED);
+    }
+    x[d->rd] = static_cast<uint16_t>(load(address) >> (8 * (address & 2)));
+    NEXT(pc + 4);
+}
+
+op_lw: {
+    uint32_t address = x[d->rs1] + d->imm;
+    if (address & 3) {
+        mtval = address;
+        TRAP(CAUSE_LOAD_ADDRESS_MISALIGNED);
+    }
+    x[d->rd] = load(address);
+    NEXT(pc + 4);
+}
+
+op_sb: {
+    uint32_t address = x[d->rs1] + d->imm;
+    uint32_t shift = 8 * (address & 3);
+    store(address, x[d->rs2] << shift, 0b0001 << (address & 3));
+    NEXT(pc + 4);
+}
+
+op_sh: {
+    uint32_t address = x[d->rs1] + d->imm;
+    if (address & 1) {
+        mtval = address;
+        TRAP(CAUSE_STORE_ADDRESS_MISALIGNED);
+    }
+    store(address, x[d->rs2] << (8 * (address & 2)), 0b0011 << (address & 2));
+    NEXT(pc + 4);
+}
+
+op_sw: {
+    uint32_t address = x[d->rs1] + d->imm;
+    if (address & 3) {
+        mtval = address;
+        TRAP(CAUSE_STORE_ADDRESS_MISALIGNED);
+    }
+    store(address, x[d->rs2], 0b1111);
+    NEXT(pc + 4);
+}
+
+op_addi:
+    x[d->rd] = x[d->rs1] + d->imm;
+    NEXT(pc + 4);
+op_slti:
+    x[d->rd] = static_cast<int32_t>(x[d->rs1]) < static_cast<int32_t>(d->imm);
+    NEXT(pc + 4);
+op_sltiu:
+    x[d->rd] = x[d->rs1] < d->imm;
+    NEXT(pc + 4);
+op_xori:
+    x[d->rd] = x[d->rs1] ^ d->imm;
+    NEXT(pc + 4);
+op_ori:
+    x[d->rd] = x[d->rs1] | d->imm;
+    NEXT(pc + 4);
+op_andi:
+    x[d->rd] = x[d->rs1] & d->imm;
+    NEXT(pc + 4);
+op_slli:
+    x[d->rd] = x[d->rs1] << d->rs2;
+    NEXT(pc + 4);
+op_srli:
+    x[d->rd] = x[d->rs1] >> d->rs2;
+    NEXT(pc + 4);
+op_srai:
+    x[d->rd] = static_cast<int32_t>(x[d->rs1]) >> d->rs2;
+    NEXT(pc + 4);
+
+op_add:
+    x[d->rd] = x[d->rs1] + x[d->rs2];
+    NEXT(pc + 4);
+op_sub:
+    x[d->rd] = x[d->rs1] - x[d->rs2];
+    NEXT(pc + 4);
+op_sll:
+    x[d->rd] = x[d->rs1] << (x[d->rs2] & 0x1f);
+    NEXT(pc + 4);
+op_slt:
+    x[d->rd] = static_cast<int32_t>(x[d->rs1]) < static_cast<int32_t>(x[d->rs2]);
+    NEXT(pc + 4);
+op_sltu:
+    x[d->rd] = x[d->rs1] < x[d->rs2];
+    NEXT(pc + 4);
+op_xor:
+    x[d->rd] = x[d->rs1] ^ x[d->rs2];
+    NEXT(pc + 4);
+op_srl:
+    x[d->rd] = x[d->rs1] >> (x[d->rs2] & 0x1f);
+    NEXT(pc + 4);
+op_sra:
+    x[d->rd] = static_cast<int32_t>(x[d->rs1]) >> (x[d->rs2] & 0x1f);
+    NEXT(pc + 4);
+op_or:
+    x[d->rd] = x[d->rs1] | x[d->rs2];
+    NEXT(pc + 4);
+op_and:
+    x[d->rd] = x[d->rs1] & x[d->rs2];
+    NEXT(pc + 4);
+
+op_mul:
+    x[d->rd] = x[d->rs1] * x[d->rs2];
+    NEXT(pc + 4);
+op_mulh:
+    x[d->rd] = (int64_t{static_cast<int32_t>(x[d->rs1])} * static_cast<int32_t>(x[d->rs2])) >> 32;
+    NEXT(pc + 4);
+op_mulhsu:
+    x[d->rd] = (int64_t{static_cast<int32_t>(x[d->rs1])} * int64_t{x[d->rs2]}) >> 32;
+    NEXT(pc + 4);
+op_mulhu:
+    x[d->rd] = (uint64_t{x[d->rs1]} * x[d->rs2]) >> 32;
+    NEXT(pc + 4);
+
+op_div: {
+    int32_t dividend = x[d->rs1];
+    int32_t divisor = x[d->rs2];
+    if (divisor == 0) {
+        x[d->rd] = UINT32_MAX;
+    } else if (dividend == INT32_MIN && divisor == -1) {
+        x[d->rd] = dividend;
+    } else {
+        x[d->rd] = dividend / divisor;
+    }
+    NEXT(pc + 4);
+}
+
+op_divu:
+    x[d->rd] = x[d->rs2] == 0 ? UINT32_MAX : x[d->rs1] / x[d->rs2];
+    NEXT(pc + 4);
+
+op_rem: {
+    int32_t dividend = x[d->rs1];
+    int32_t divisor = x[d->rs2];
+    if (divisor == 0) {
+        x[d->rd] = dividend;
+    } else if (dividend == INT32_MIN && divisor == -1) {
+        x[d->rd] = 0;
+    } else {
+        x[d->rd] = dividend % divisor;
+    }
+    NEXT(pc + 4);
+}
+
+op_remu:
+    x[d->rd] = x[d->rs2] == 0 ? x[d->rs1] : x[d->rs1] % x[d->rs2];
+    NEXT(pc + 4);
+
+op_fence:
+    NEXT(pc + 4);
+
+op_ecall:
+    TRAP(CAUSE_ENVIRONMENT_CALL);
+
+op_ebreak:
+    mtval = pc;
+    TRAP(CAUSE_BREAKPOINT);
+
+// Returning and writing CSRs may enable a pending interrupt
+op_mret:
+    mstatus = ((mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0) | MSTATUS_MPIE;
+    limit = instructions + 1;
+    NEXT(mepc);
+
+op_csrrw:
+op_csrrs:
+op_csrrc:
+    execute_csr(*d, x[d->rs1]);
+    limit = instructions + 1;
+    NEXT(pc + 4);
+
+op_csrrwi:
+op_csrrsi:
+op_csrrci:
+    execute_csr(*d, d->rs1);
+    limit = instructions + 1;
+    NEXT(pc + 4);
+
+#undef BRANCH
+#undef TRAP
+#undef NEXT
+#undef DISPATCH
+}
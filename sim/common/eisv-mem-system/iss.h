@@ -0,0 +1,119 @@
+#ifndef ISS_H
+#define ISS_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "checkpoint.h"
+#include "system.h"
+
+// Instruction set simulator for RV32I_Zicsr (optionally M), running against the devices of a
+// System. It follows the trap and CSR behaviour of eisv_core rather than the letter of the
+// specification where the two differ, so its state can be handed to the RTL core (see CoreState).
+//
+// Instructions are decoded once per word of DMI memory and dispatched through a table of labels
+// (threaded code), stores to decoded words invalidate them. Every instruction takes one cycle.
+// The System is only advanced when a device is accessed or when an interrupt line may change
+// according to System::quiet_cycles.
+class Iss {
+   public:
+    static constexpr uint64_t NO_STOP_PC = UINT64_MAX;
+    static constexpr int HPM_COUNTERS = CoreState::HPM_COUNTERS;  // mhpmcounter3 to mhpmcounter6
+
+    enum StopReason {
+        STOP_INSTRUCTIONS,  // max_instructions were executed
+        STOP_PC,            // The next instruction is at stop_pc
+        STOP_FLAG,          // The stop flag was set by a device
+    };
+
+    // The interrupt line is sampled before every instruction, stop is checked after every device
+    // access
+    Iss(System& system, bool m_extension, bool const& timer_interrupt_pending, bool const& stop);
+    ~Iss();
+
+    Iss(Iss const&) = delete;
+    Iss& operator=(Iss const&) = delete;
+
+    // State after the reset of eisv_core
+    void reset();
+    void set_state(CoreState const& state);
+    CoreState get_state() const;
+
+    // Trapped instructions count as executed
+    StopReason run(uint64_t max_instructions, uint64_t stop_pc = NO_STOP_PC);
+    uint64_t get_instructions() const;
+
+    // Enters the trap handler for an interrupt (mcause) at the current pc, regardless of mie
+    void interrupt(uint32_t cause);
+    // Exceptions and interrupts taken so far
+    uint64_t get_traps() const;
+
+   private:
+    struct Decoded {
+        uint8_t op;
+        uint8_t rd;  // 0 is redirected to a register nobody reads
+        uint8_t rs1;
+        uint8_t rs2;
+        uint32_t imm;  // CSR address for CSR instructions
+    };
+
+    // Decoded words of a DMI range, invalidated by stores through the same range
+    struct Window {
+        System::Dmi dmi;
+        std::vector<Decoded> decoded;
+    };
+
+    Decoded decode(uint32_t instruction) const;
+    Window* find_window(uint32_t address);
+
+    uint32_t load(uint32_t address);  // Word containing the address
+    void store(uint32_t address, uint32_t value, uint8_t byte_enable);
+    uint32_t fetch_uncached(uint32_t address);
+
+    bool csr_implemented(uint32_t address) const;
+    uint32_t read_csr(uint32_t address) const;
+    void write_csr(uint32_t address, uint32_t value);
+    void execute_csr(Decoded const& decoded, uint32_t operand);
+    uint64_t read_counter(int counter) const;
+    void write_counter(int counter, uint64_t value);
+
+    void trap(uint32_t cause, uint32_t epc);
+    void catch_up();
+
+    System& system;
+    bool m_extension;
+    bool const& timer_interrupt_pending;
+    bool const& stop;
+
+    uint32_t pc = 0;
+    uint32_t x[33] = {};  // x[32] receives writes to x0
+    uint32_t mstatus = 0;  // Only MIE and MPIE
+    uint32_t mie = 0;      // Only MTIE and MEIE
+    uint32_t mtvec = 0;
+    uint32_t mscratch = 0;
+    uint32_t mepc = 0;
+    uint32_t mcause = 0;
+    uint32_t mtval = 0;
+
+    // mcycle and minstret both count executed instructions, as every instruction takes one cycle.
+    enum { COUNTER_MCYCLE, COUNTER_MINSTRET };
+    uint32_t mcountinhibit = 0;
+    uint64_t counters[2] = {};  // Value while inhibited, offset to instructions otherwise
+    // There are no pipeline events, the counters only keep their value across a handover
+    uint64_t mhpmcounter[HPM_COUNTERS] = {};
+    uint32_t mhpmevent[HPM_COUNTERS] = {};
+
+    uint64_t instructions = 0;
+    uint64_t traps = 0;
+    uint64_t synced = 0;  // Instructions the System has been advanced for
+    uint64_t limit = 0;   // Instructions after which the System has to catch up
+
+    // Both point to no_window if the last access did not hit DMI memory
+    std::vector<std::unique_ptr<Window>> windows;
+    Window no_window;
+    Window* fetch_window = &no_window;
+    Window* data_window = &no_window;
+};
+
+#endif
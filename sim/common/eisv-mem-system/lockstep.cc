@@ -0,0 +1,171 @@
+#include "lockstep.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+using Retire = TransactionBridge::Retire;
+
+bool Lockstep::ShadowMemory::write(uint32_t local_address, uint32_t value, uint8_t byte_enable) {
+    store_addr = local_address;
+    store_data = value;
+    store_byte_enable = byte_enable;
+
+    if (uint32_t* word = find(local_address)) {
+        uint32_t mask = Device::byte_enable_mask(byte_enable);
+        *word = (*word & ~mask) | (value & mask);
+    }
+    return true;
+}
+
+bool Lockstep::ShadowMemory::read(uint32_t local_address, uint32_t& value_out, uint8_t) {
+    if (uint32_t* word = find(local_address)) {
+        value_out = *word;
+    } else {
+        value_out = 0;
+        replayed = true;
+    }
+    return true;
+}
+
+uint32_t* Lockstep::ShadowMemory::find(uint32_t address) {
+    for (Region& region : regions) {
+        uint32_t offset = address - region.base;
+        if (offset / 4 < region.data.size()) {
+            return &region.data[offset / 4];
+        }
+    }
+    return nullptr;
+}
+
+Lockstep::Lockstep(bool m_extension) : iss(system, m_extension, no_interrupt, no_stop) {
+    // Without DMI every access of the Iss reaches the shadow memory and can be observed
+    system.add_device(&memory, 0, 0);
+}
+
+void Lockstep::add_region(uint32_t base, uint32_t const* data, size_t words) {
+    memory.regions.push_back(ShadowMemory::Region{
+        .base = base,
+        .data = std::vector<uint32_t>(data, data + words),
+    });
+}
+
+void Lockstep::set_state(CoreState const& state) {
+    iss.set_state(state);
+}
+
+uint64_t Lockstep::get_checked() const {
+    return checked;
+}
+
+bool Lockstep::check(Retire const& retire) {
+    history[checked % HISTORY] = retire;
+    checked++;
+
+    // Interrupts are not tied to an instruction, the Iss takes them where the RTL core did
+    if (retire.trap && (retire.rd_value >> 31) != 0) {
+        uint32_t pc = iss.get_state().words[CoreState::PC];
+        if (pc != retire.pc) {
+            return diverged("interrupted pc", retire.pc, pc);
+        }
+        iss.interrupt(retire.rd_value);
+        return true;
+    }
+    return check_instruction(retire);
+}
+
+// Any of the CSR instructions on mip or a counter (mcycle, minstret, mhpmcounter)
+static bool reads_core_csr(uint32_t instruction) {
+    uint32_t csr = instruction >> 20;
+    return (instruction & 0x7f) == 0x73 && ((instruction >> 12) & 0x7) != 0 &&
+           (csr == 0x344 || (csr & ~0x9fu) == 0xb00);
+}
+
+bool Lockstep::check_instruction(Retire const& retire) {
+    CoreState before = iss.get_state();
+    uint32_t pc = before.words[CoreState::PC];
+    if (!retire.trap_return && pc != retire.pc) {
+        return diverged("pc", retire.pc, pc);
+    }
+
+    uint64_t traps = iss.get_traps();
+    memory.replayed = false;
+    memory.store_byte_enable = 0;
+    iss.run(1);
+    CoreState after = iss.get_state();
+
+    bool trapped = iss.get_traps() != traps;
+    if (trapped != retire.trap) {
+        return diverged("trap taken", retire.trap, trapped);
+    }
+
+    if (retire.trap) {
+        if (after.words[CoreState::MCAUSE] != retire.rd_value) {
+            return diverged("mcause", retire.rd_value, after.words[CoreState::MCAUSE]);
+        }
+        return true;
+    }
+
+    if (retire.trap_return) {
+        if (after.words[CoreState::PC] != retire.pc) {
+            return diverged("mret target", retire.pc, after.words[CoreState::PC]);
+        }
+        return true;
+    }
+
+    // Values the Iss cannot know are taken from the RTL core
+    uint32_t* instruction = memory.find(pc);
+    if (retire.rd != 0 && (memory.replayed || (instruction && reads_core_csr(*instruction)))) {
+        after.words[retire.rd] = retire.rd_value;
+        iss.set_state(after);
+    }
+
+    for (int i = 1; i < 32; i++) {
+        uint32_t expected = i == retire.rd ? retire.rd_value : before.words[i];
+        if (after.words[i] != expected) {
+            char what[8];
+            snprintf(what, sizeof(what), "x%d", i);
+            return diverged(what, expected, after.words[i]);
+        }
+    }
+
+    if (memory.store_byte_enable != retire.store_byte_enable) {
+        return diverged("store byte enable", retire.store_byte_enable, memory.store_byte_enable);
+    }
+    if (retire.store_byte_enable != 0) {
+        uint32_t mask = Device::byte_enable_mask(retire.store_byte_enable);
+        if (memory.store_addr != retire.store_addr) {
+            return diverged("store address", retire.store_addr, memory.store_addr);
+        }
+        if ((memory.store_data & mask) != (retire.store_data & mask)) {
+            return diverged("store data", retire.store_data & mask, memory.store_data & mask);
+        }
+    }
+    return true;
+}
+
+bool Lockstep::diverged(char const* what, uint32_t rtl, uint32_t iss_value) {
+    printf("[TB] ERROR Lockstep divergence at event %" PRIu64
+           ": %s is %08x on the RTL core, %08x on the ISS\n",
+           checked, what, rtl, iss_value);
+    printf("[TB] Last events of the RTL core, oldest first:\n");
+    uint64_t first = checked > HISTORY ? checked - HISTORY : 0;
+    for (uint64_t i = first; i < checked; i++) {
+        print_event(history[i % HISTORY]);
+    }
+    return false;
+}
+
+void Lockstep::print_event(Retire const& retire) {
+    if (retire.trap) {
+        printf("[TB]   trap   mepc %08x mcause %08x\n", retire.pc, retire.rd_value);
+    } else if (retire.trap_return) {
+        printf("[TB]   mret   to %08x\n", retire.pc);
+    } else if (retire.store_byte_enable != 0) {
+        printf("[TB]   retire %08x [%08x] = %08x (byte enable %x)\n", retire.pc, retire.store_addr,
+               retire.store_data, retire.store_byte_enable);
+    } else if (retire.rd != 0) {
+        printf("[TB]   retire %08x x%d = %08x\n", retire.pc, retire.rd, retire.rd_value);
+    } else {
+        printf("[TB]   retire %08x\n", retire.pc);
+    }
+}
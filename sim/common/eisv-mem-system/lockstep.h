@@ -0,0 +1,78 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <cstdint>
+#include <vector>
+
+#include "checkpoint.h"
+#include "device.h"
+#include "iss.h"
+#include "system.h"
+#include "transaction_bridge.hh"
+
+// Checks the retire events of the RTL core against an Iss, one instruction at a time.
+//
+// The Iss runs on private copies of the memories mirrored into core_sim, so it sees the memory
+// contents as of its own position in the program and not those of the RTL core, which has already
+// run ahead to the next synchronization point. Loads from anything else (devices) cannot be
+// repeated and take the value the RTL core loaded, as do reads of mip and of the counters.
+// Instructions have to be fetched from the copied memories. Interrupts are taken where the RTL
+// core took them.
+//
+// Compared are the PC of every instruction, all registers after it, its store, the cause of every
+// exception and the target of every mret.
+class Lockstep {
+   public:
+    Lockstep(bool m_extension);
+
+    // Copies the memory at base, the copies are only changed by the Iss from then on
+    void add_region(uint32_t base, uint32_t const* data, size_t words);
+    // Continues from the given state instead of the reset state
+    void set_state(CoreState const& state);
+
+    // False at the first divergence, which is reported together with the preceding events
+    bool check(TransactionBridge::Retire const& retire);
+
+    uint64_t get_checked() const;
+
+   private:
+    // Private memory of the Iss covering the whole address space
+    class ShadowMemory : public Device {
+       public:
+        struct Region {
+            uint32_t base;
+            std::vector<uint32_t> data;
+        };
+
+        bool write(uint32_t local_address, uint32_t value, uint8_t byte_enable) override;
+        bool read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) override;
+
+        // Word in one of the regions, nullptr outside of them
+        uint32_t* find(uint32_t address);
+
+        std::vector<Region> regions;
+
+        // Effects of the last instruction, cleared by the Lockstep before every instruction
+        bool replayed = false;  // A load outside of the regions returned 0
+        uint32_t store_addr = 0;
+        uint32_t store_data = 0;
+        uint8_t store_byte_enable = 0;
+    };
+
+    static constexpr int HISTORY = 8;
+
+    bool diverged(char const* what, uint32_t rtl, uint32_t iss_value);
+    bool check_instruction(TransactionBridge::Retire const& retire);
+    static void print_event(TransactionBridge::Retire const& retire);
+
+    ShadowMemory memory;
+    System system;
+    bool no_interrupt = false;
+    bool no_stop = false;
+    Iss iss;
+
+    uint64_t checked = 0;
+    TransactionBridge::Retire history[HISTORY];
+};
+
+#endif
@@ -2,63 +2,230 @@
 #define SC_INCLUDE_DYNAMIC_PROCESSES  // for sc_spawn
 #include <systemc.h>
 
+#include <cinttypes>
+
 // QuestaSim compile active, create module "main"
 // #include "uart_interface.hh"
 // #include "spi_interface.hh"
+#include "checkpoint.h"
+#include "elf_loader.h"
+#ifndef MTI_SYSTEMC
+#include "iss.h"
+#include "lockstep.h"
+#include "profiler.h"
+#endif
 #include "memory.h"
 #include "sim_wrapper.hh"  // Interface to verilog wrapper
 #include "stop_simulation_device.h"
 #include "system.h"
-#include "timer_device.h"
+#include "testbench.h"
+#include "trace.h"
+#ifndef MTI_SYSTEMC
+#include "transaction_bridge.hh"
+#endif
 #include "uart_device.h"
 
-constexpr size_t ROM_BYTES = 1 << 10;
-constexpr size_t ROM_WORDS = ROM_BYTES >> 2;
+#ifndef MTI_SYSTEMC
+// Predicts the testbench loop below for the lookahead of sim_wrapper
+struct TestbenchPredictor : public sim_wrapper::Predictor {
+    System &system;
+    bool &timer_interrupt_pending_flag;
+
+    TestbenchPredictor(System &system, bool &timer_interrupt_pending_flag)
+        : system(system), timer_interrupt_pending_flag(timer_interrupt_pending_flag) {}
+
+    // Called after the testbench loop handled the current cycle, so the devices already ticked
+    int stable_cycles(sim_wrapper::Inputs const &inputs) override {
+        if (!inputs.rst_n || timer_interrupt_pending_flag != inputs.timer_interrupt_pending) {
+            return 0;
+        }
+        uint64_t quiet = system.quiet_cycles();
+        return quiet >= sim_wrapper::MAX_QUANTUM ? sim_wrapper::MAX_QUANTUM : quiet + 1;
+    }
+
+    bool peek_imem(uint32_t address, uint32_t &value_out) override {
+        return system.peek(address, value_out);
+    }
+};
+
+// Detects a core polling a device register in a loop (e.g. the UART status while waiting for RX
+// data) at the synchronization points of the transaction level loop. Consecutive reads of the same
+// address from the same place, returning the same value after the same number of cycles, without
+// RAM writes or input changes in between, bring the core back into the same state every period.
+// The register file is not part of the signature: a loop that only counts its iterations in a
+// register (e.g. a polling loop with a retry limit) looks the same every period and is skipped as
+// if it never ended, so fast-forwarding is only safe for loops that wait for a device.
+struct SpinDetector {
+    // Identical synchronization points in a row before the core is considered spinning
+    static constexpr int THRESHOLD = 4;
+
+    struct Signature {
+        uint32_t elapsed;
+        uint32_t imem_addr;
+        uint32_t dmem_addr;
+        uint32_t dmem_rdata;
+        bool timer_interrupt_pending;
+
+        bool operator==(Signature const &other) const {
+            return elapsed == other.elapsed && imem_addr == other.imem_addr &&
+                   dmem_addr == other.dmem_addr && dmem_rdata == other.dmem_rdata &&
+                   timer_interrupt_pending == other.timer_interrupt_pending;
+        }
+    };
+
+    Signature last{};
+    int repeats = 0;
+
+    // Period of the loop in cycles once the core is spinning, 0 otherwise. written tells whether
+    // RAM was written since the previous synchronization point.
+    uint32_t update(TransactionBridge::Sync const &sync, TransactionBridge::Run const &run,
+                    bool written) {
+        if (!sync.dmem_read || sync.dmem_write || sync.imem_read || written || !run.rst_n) {
+            repeats = 0;
+            return 0;
+        }
+
+        Signature current{
+            .elapsed = sync.elapsed,
+            .imem_addr = sync.imem_addr,
+            .dmem_addr = sync.dmem_addr,
+            .dmem_rdata = run.dmem_rdata,
+            .timer_interrupt_pending = run.timer_interrupt_pending,
+        };
+        repeats = current == last ? repeats + 1 : 0;
+        last = current;
+        return repeats + 1 >= THRESHOLD ? sync.elapsed : 0;
+    }
+};
+
+// Checkpoints of the transaction level loop, see Checkpoint
+struct CheckpointOptions {
+    char const *save_path = nullptr;
+    uint64_t save_cycle = 0;  // The core is halted at the first sync at or after this cycle
+    char const *restore_path = nullptr;
+};
+
+// Instructions executed by the Iss before the RTL core takes over, see run_iss
+struct IssOptions {
+    uint64_t instructions = 0;
+    char const *until = nullptr;  // Address or ELF symbol at which the RTL core takes over
+    bool m_extension = false;
+
+    bool enabled() const { return instructions > 0 || until != nullptr; }
+};
+
+// Hot spots from the fetch addresses of the pin level loop, see Profiler
+struct ProfileOptions {
+    char const *path = nullptr;  // Flat profile, the folded stacks go to path.folded
+    uint32_t period = 1;         // Cycles per sample
+};
+
+// Command line options of sc_main
+struct TestbenchOptions {
+    bool transaction_level = false;
+    int quantum = 1;  // Cycles per exchange of the pin level loop, see sim_wrapper
+    bool fast_forward = false;
+    bool direct = false;
+    bool lockstep = false;
+    CheckpointOptions checkpoint;
+    IssOptions iss;
+    TestbenchPaths paths;
+    ProfileOptions profile;
+    WaveCaptureOptions wave_capture;
+};
+#endif
+
+#ifdef MTI_SYSTEMC
+// Vector ports of the interface generated by scgenmod -sc_bv (simulate.tcl)
+typedef sc_bv<32> WordSignal;
+typedef sc_bv<4> ByteEnableSignal;
+
+static uint32_t signal_value(sc_bv_base const &value) {
+    return value.to_uint();
+}
+#else
+// Native types of sim_wrapper
+typedef uint32_t WordSignal;
+typedef uint8_t ByteEnableSignal;
+
+static uint32_t signal_value(uint32_t value) {
+    return value;
+}
+#endif
 
-constexpr size_t RAM_BYTES = 1 << 16;
-constexpr size_t RAM_WORDS = RAM_BYTES >> 2;
+struct main : public sc_module, public Testbench {
+    // Cycles the direct kernel runs ahead of SystemC time before it lets time catch up
+    static constexpr uint64_t DIRECT_TIME_QUANTUM = 1024;
 
-struct main : public sc_module {
     sim_wrapper dut;
-    sc_clock clk;
+
+    // Not created for the direct kernel, which advances SystemC time on its own
+    sc_clock *clk = nullptr;
+    sc_signal<bool> clk_off;
+    sc_time const clock_period{10, SC_NS};
+    bool direct = false;
 
     // interface signals to verilog wrapper
     sc_signal<bool> reset;
-    sc_signal<sc_bv<32>> imem_addr;
+    sc_signal<WordSignal> imem_addr;
     sc_signal<bool> imem_ren;
-    sc_signal<sc_bv<32>> imem_rdata;
-    sc_signal<sc_bv<32>> dmem_addr;
+    sc_signal<WordSignal> imem_rdata;
+    sc_signal<WordSignal> dmem_addr;
     sc_signal<bool> dmem_ren;
-    sc_signal<sc_bv<32>> dmem_rdata;
+    sc_signal<WordSignal> dmem_rdata;
     sc_signal<bool> dmem_wen;
-    sc_signal<sc_bv<32>> dmem_wdata;
-    sc_signal<sc_bv<4>> dmem_byte_enable;
+    sc_signal<WordSignal> dmem_wdata;
+    sc_signal<ByteEnableSignal> dmem_byte_enable;
     sc_signal<bool> external_interrupt_pending;
     sc_signal<bool> timer_interrupt_pending;
 
-    bool *stop_criterium;
-    bool *timer_interrupt_pending_flag;
+#ifndef MTI_SYSTEMC
+    TransactionBridge *bridge = nullptr;
+    TestbenchPredictor *predictor = nullptr;
+
+    bool fast_forward = false;
+    uint64_t skipped_cycles = 0;
 
-    Memory *rom;
-    Memory *ram;
+    CheckpointOptions checkpoint;
+    IssOptions iss;
 
-    UartDevice *uart_device;
-    StopSimulationDevice *stop_device;
+    // Core state written to the RTL core instead of resetting it (checkpoint or Iss)
+    bool injected = false;
+    CoreState injected_core;
 
-    System system;
+    // Checks every instruction retired by the RTL core, see Lockstep
+    std::unique_ptr<Lockstep> lockstep;
+    bool diverged = false;
+
+    ProfileOptions profile;
+    std::unique_ptr<Profiler> profiler;
+
+    WaveCaptureOptions wave_capture;
+#endif
 
 #ifdef MTI_SYSTEMC
     main(sc_module_name name)
-        : dut("dut", "sim_wrapper"),
-          clk("clk", 10, SC_NS)
+        : Testbench({}), dut("dut", "sim_wrapper")
 #else
-    main(sc_module_name name, VHSocket vhsock)
-        : dut("dut", vhsock),
-          clk("clk", 10, SC_NS)
+    main(sc_module_name name, VHSocket vhsock, TestbenchOptions const &options)
+        : Testbench(options.paths),
+          dut("dut", vhsock, !options.transaction_level, options.quantum, options.direct),
+          direct(options.direct),
+          fast_forward(options.fast_forward),
+          checkpoint(options.checkpoint),
+          iss(options.iss),
+          lockstep(options.lockstep ? new Lockstep(options.iss.m_extension) : nullptr),
+          profile(options.profile),
+          wave_capture(options.wave_capture)
 #endif
     {
         // connect to verilog wrapper
-        dut.i_eisV_clk(clk);
+        if (direct) {
+            dut.i_eisV_clk(clk_off);
+        } else {
+            clk = new sc_clock("clk", clock_period);
+            dut.i_eisV_clk(*clk);
+        }
         dut.i_eisV_rst_n(reset);
 
         dut.o_imem_addr(imem_addr);
@@ -74,114 +241,405 @@ struct main : public sc_module {
         dut.i_external_interrupt_pending(external_interrupt_pending);
         dut.i_timer_interrupt_pending(timer_interrupt_pending);
 
-        ram = new Memory{RAM_WORDS};
-        system.add_device(ram, 16, 0x10000000);
+#ifndef MTI_SYSTEMC
+        // The image still defines the memory map (e.g. tohost), the checkpoint its contents
+        if (checkpoint.restore_path) {
+            injected = Checkpoint::restore(checkpoint.restore_path, system, injected_core);
+            if (!injected) {
+                exit(1);
+            }
+            printf("[TB] Restored checkpoint %s at cycle %" PRIu64 " (pc %08x)\n",
+                   checkpoint.restore_path, system.get_cycle(), injected_core.words[CoreState::PC]);
+        }
+#endif
 
-        rom = new Memory{ROM_WORDS};
-        system.add_device(rom, 22, 0x00000000);
+        acquire_dmi();
 
-        stop_criterium = new bool(false);
-        stop_device = new StopSimulationDevice(*stop_criterium);
-        system.add_device(stop_device, 30, 0x80000000);
+#ifndef MTI_SYSTEMC
+        if (profile.path) {
+            profiler = std::make_unique<Profiler>(image, rom_dmi, profile.period);
+        }
 
-        timer_interrupt_pending_flag = new bool(false);
-        TimerDevice *timer_device = new TimerDevice(*timer_interrupt_pending_flag, 50);
-        system.add_device(timer_device, 28, 0x80000010);
+        if (wave_capture.path) {
+            start_wave_capture(wave_capture);
+        }
+#endif
 
-        uart_device = new UartDevice("uart_out");
-        system.add_device(uart_device, 28, 0x90000000);
+        // Reset process, the direct kernel derives the reset from its cycle count
+        if (!direct) {
+            sc_spawn([&] {
+                reset.write(false);
+                cout << "[TB] Reset on" << endl;
 
-        uart_device->write_file_to_uart("uart_in");
+                wait(20, SC_NS);
+                reset.write(true);
+                cout << "[TB] Reset off" << endl;
+            });
+        }
 
-        // ---------------------
-        // Start testbench (TB)
-        // ---------------------
+#ifndef MTI_SYSTEMC
+        predictor = new TestbenchPredictor(system, *timer_interrupt_pending_flag);
+        dut.set_predictor(predictor);
 
-        // Memory Initialization (IMEM)
-        if (rom->init_from_file("app/imem.bin", 0)) {
-            cout << "[TB] Initialized Memory with 'app/imem.bin' file" << endl;
-        } else {
-            cout << "[TB] Could not open Memory init file 'app/imem.bin'" << endl;
-#ifndef MTI_SYSTEMC  // Questasim doesn't like exit during elaboration
-            exit(1);
-#endif
+        if (options.transaction_level) {
+            bridge = new TransactionBridge(vhsock, options.lockstep);
+            sc_spawn([&] { run_transaction_level(); });
+            return;
         }
 
-        // Reset process
-        sc_spawn([&] {
-            reset.write(false);
-            cout << "[TB] Reset on" << endl;
-
-            wait(20, SC_NS);
-            reset.write(true);
-            cout << "[TB] Reset off" << endl;
-        });
+        if (direct) {
+            sc_spawn([&] { run_direct(); });
+            return;
+        }
+#endif
 
         // Spawn process to periodically read/write in memory
         sc_spawn([&] {
             while (!*stop_criterium) {
+                // Written values only show on the signals after this process waits
+                uint32_t imem_rdata_value = signal_value(imem_rdata.read());
+                uint32_t dmem_rdata_value = signal_value(dmem_rdata.read());
+
                 if (imem_ren.read() == true) {
-                    uint32_t imem_byte_addr = imem_addr.read().to_int();
-                    uint32_t imem_read_value;
-                    if (system.read(imem_byte_addr, imem_read_value, 0b1111)) {
-                        printf("[TB] Reading IMEM[%08x] => %08x\n", imem_byte_addr,
-                               imem_read_value);
-                    } else {
-                        printf("[TB] WARN IMEM read at %08x is OOB\n", imem_byte_addr);
-                    }
-                    imem_rdata.write(imem_read_value);
+                    imem_rdata_value = imem_read(signal_value(imem_addr.read()));
+                    imem_rdata.write(imem_rdata_value);
+                }
+
+#ifndef MTI_SYSTEMC
+                if (profiler && reset.read()) {
+                    profiler->fetch(signal_value(imem_addr.read()));
                 }
+#endif
 
                 if (dmem_ren.read() == true) {
-                    uint32_t dmem_byte_addr = dmem_addr.read().to_int();
-                    uint32_t dmem_read_value;
-                    if (system.read(dmem_byte_addr, dmem_read_value, 0b1111)) {
-                        printf("[TB] Reading DMEM[%08x] => %08x\n", dmem_byte_addr,
-                               dmem_read_value);
-                    } else {
-                        printf("[TB] WARN DMEM read at %08x is OOB\n", dmem_byte_addr);
-                    }
-                    dmem_rdata.write(dmem_read_value);
+                    dmem_rdata_value = dmem_read(signal_value(dmem_addr.read()));
+                    dmem_rdata.write(dmem_rdata_value);
                 }
 
                 if (dmem_wen.read() == true) {
-                    uint32_t dmem_byte_addr = dmem_addr.read().to_int();
-                    uint32_t dmem_word_addr = dmem_byte_addr >> 2;
-                    uint32_t dmem_write_value = dmem_wdata.read().to_uint();
-
-                    if (system.write(dmem_byte_addr, dmem_write_value,
-                                     dmem_byte_enable.read().to_uint())) {
-                        printf("[TB] Writing DMEM[%08x] <= %08x, %02x\n", dmem_byte_addr,
-                               dmem_write_value, dmem_byte_enable.read().to_uint());
-                    } else {
-                        printf("[TB] WARN DMEM write at %08x is OOB\n", dmem_byte_addr);
-                    }
+                    dmem_write(signal_value(dmem_addr.read()), signal_value(dmem_wdata.read()),
+                               signal_value(dmem_byte_enable.read()));
                 }
 
                 external_interrupt_pending.write(false);
                 timer_interrupt_pending.write(*timer_interrupt_pending_flag);
 
+#ifndef MTI_SYSTEMC
+                if (wave) {
+                    wave->sample(WaveCapture::Sample{
+                        .cycle = system.get_cycle(),
+                        .imem_addr = imem_addr.read(),
+                        .imem_rdata = imem_rdata_value,
+                        .dmem_addr = dmem_addr.read(),
+                        .dmem_rdata = dmem_rdata_value,
+                        .dmem_wdata = dmem_wdata.read(),
+                        .dmem_byte_enable = dmem_byte_enable.read(),
+                        .rst_n = reset.read(),
+                        .imem_ren = imem_ren.read(),
+                        .dmem_ren = dmem_ren.read(),
+                        .dmem_wen = dmem_wen.read(),
+                        .external_interrupt_pending = false,
+                        .timer_interrupt_pending = *timer_interrupt_pending_flag,
+                    });
+                }
+#endif
+
                 system.tick_all();
 
-                wait(clk.posedge_event());  // Wait till end of period
+                wait(clk->posedge_event());  // Wait till end of period
             }
 
-            // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
-            // Interrupt simulaiton
-            // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
-            uint32_t return_value = stop_device->get_return_value();
-            printf("[TB] Program finished with return value %d (%x)!\n", return_value,
-                   return_value);
+            finish();
+        });
+    }
 
-            printf("[TB] Dumping memory to app/dump.bin...\n");
-            if (ram->write_to_file("app/dump.bin")) {
-                printf("[TB] Finished dumping memory to app/dump.bin\n");
-            } else {
-                printf("[TB] Failed dumping memory to app/dump.bin\n");
+#ifndef MTI_SYSTEMC
+    // The pin level loop above as one plain loop: no clock, no reset process and no vhsock thread
+    // in dut, so a cycle costs no context switches and no delta cycles. The ports are bypassed
+    // through sim_wrapper::step, SystemC time follows every DIRECT_TIME_QUANTUM cycles, so modules
+    // added to the testbench still see time advance, only in coarser steps.
+    void run_direct() {
+        // The loop thread above runs once during initialization and once more at the first clock
+        // edge before dut exchanges anything, both times answering the initial outputs
+        system.tick_all();
+
+        sim_wrapper::Outputs outputs{};
+        sim_wrapper::Inputs inputs{};
+        uint64_t cycle = 0;
+        uint64_t behind = 0;
+        printf("[TB] Reset on\n");
+        while (!*stop_criterium) {
+            inputs.rst_n = cycle >= RESET_CYCLES;
+            if (cycle == RESET_CYCLES) {
+                printf("[TB] Reset off\n");
             }
 
-            sc_stop();
-        });
+            if (outputs.imem_ren) {
+                inputs.imem_rdata = imem_read(outputs.imem_addr);
+            }
+
+            if (profiler && inputs.rst_n) {
+                profiler->fetch(outputs.imem_addr);
+            }
+
+            if (outputs.dmem_ren) {
+                inputs.dmem_rdata = dmem_read(outputs.dmem_addr);
+            }
+
+            if (outputs.dmem_wen) {
+                dmem_write(outputs.dmem_addr, outputs.dmem_wdata, outputs.dmem_byte_enable);
+            }
+
+            inputs.external_interrupt_pending = false;
+            inputs.timer_interrupt_pending = *timer_interrupt_pending_flag;
+
+            if (wave) {
+                wave->sample(WaveCapture::Sample{
+                    .cycle = system.get_cycle(),
+                    .imem_addr = outputs.imem_addr,
+                    .imem_rdata = inputs.imem_rdata,
+                    .dmem_addr = outputs.dmem_addr,
+                    .dmem_rdata = inputs.dmem_rdata,
+                    .dmem_wdata = outputs.dmem_wdata,
+                    .dmem_byte_enable = outputs.dmem_byte_enable,
+                    .rst_n = inputs.rst_n,
+                    .imem_ren = outputs.imem_ren,
+                    .dmem_ren = outputs.dmem_ren,
+                    .dmem_wen = outputs.dmem_wen,
+                    .external_interrupt_pending = inputs.external_interrupt_pending,
+                    .timer_interrupt_pending = inputs.timer_interrupt_pending,
+                });
+            }
+
+            system.tick_all();
+
+            outputs = dut.step(inputs);
+            cycle++;
+
+            if (++behind == DIRECT_TIME_QUANTUM) {
+                wait(clock_period * static_cast<double>(behind));
+                behind = 0;
+            }
+        }
+        wait(clock_period * static_cast<double>(behind));
+
+        finish();
+    }
+
+    // Same sequence as the pin level loop (accesses, interrupt lines, tick_all), but the core runs
+    // on its own between synchronization points. These are device accesses and every cycle at
+    // which an interrupt line may change according to System::quiet_cycles.
+    //
+    // With fast_forward, whole periods of a polling loop (see SpinDetector) are skipped up to the
+    // next cycle at which an interrupt line may change, without running the core. The devices are
+    // advanced by the same number of cycles, so mtime and the SystemC time stay consistent.
+    //
+    // A checkpoint is saved at the first sync at which the core is halted after the checkpoint
+    // cycle, the run then continues. A restored run or one started by the Iss begins with the
+    // injected core state instead of the reset state.
+    void run_transaction_level() {
+        if (iss.enabled() && !run_iss()) {
+            finish();
+            return;
+        }
+
+        bridge->add_region(ROM_BASE, rom->get_data(), rom->get_size());
+        bridge->add_region(RAM_BASE, ram->get_data(), ram->get_size());
+
+        uint64_t cycle = 0;
+        uint64_t reset_cycles = RESET_CYCLES;
+        if (injected) {
+            bridge->write_state(0, CoreState::WORDS, injected_core.words);
+            cycle = system.get_cycle();
+            reset_cycles = 0;  // A reset after the state write would clear the CSRs again
+        }
+
+        std::function<void(TransactionBridge::Retire const &)> check_retire;
+        if (lockstep) {
+            lockstep->add_region(ROM_BASE, rom->get_data(), rom->get_size());
+            lockstep->add_region(RAM_BASE, ram->get_data(), ram->get_size());
+            if (injected) {
+                lockstep->set_state(injected_core);
+            }
+            check_retire = [&](TransactionBridge::Retire const &retire) {
+                diverged = diverged || !lockstep->check(retire);
+            };
+        }
+        bool saved = checkpoint.save_path == nullptr;
+
+        bool written = false;
+        auto write_back = [&](uint32_t address, uint32_t value) {
+            system.write(address, value, 0b1111, System::PORT_OTHER);
+            written = true;
+        };
+
+        SpinDetector spin_detector;
+
+        TransactionBridge::Run run{};
+        while (!*stop_criterium) {
+            run.rst_n = cycle >= reset_cycles;
+            run.halt = !saved && cycle >= checkpoint.save_cycle;
+            run.external_interrupt_pending = false;
+            run.timer_interrupt_pending = *timer_interrupt_pending_flag;
+
+            system.tick_all();
+
+            uint64_t quantum = 1;
+            if (*timer_interrupt_pending_flag == run.timer_interrupt_pending) {
+                uint64_t quiet = system.quiet_cycles();
+                quantum = quiet >= TransactionBridge::MAX_QUANTUM ? TransactionBridge::MAX_QUANTUM
+                                                                  : quiet + 2;
+            }
+            if (cycle < reset_cycles) {
+                quantum = std::min(quantum, reset_cycles - cycle);
+            }
+            if (!saved && cycle < checkpoint.save_cycle) {
+                quantum = std::min(quantum, checkpoint.save_cycle - cycle);
+            }
+            run.quantum = quantum;
+
+            written = false;
+            TransactionBridge::Sync sync = bridge->run(run, write_back, check_retire);
+            wait(clock_period * sync.elapsed);
+
+            // Catch up with the cycles the core ran on its own
+            system.advance(sync.elapsed - 1);
+            cycle += sync.elapsed;
+
+            if (diverged) {
+                break;
+            }
+
+            run.imem_rdata_valid = sync.imem_read;
+            if (sync.imem_read) {
+                run.imem_rdata = imem_read(sync.imem_addr);
+            }
+
+            run.dmem_rdata_valid = sync.dmem_read;
+            if (sync.dmem_read) {
+                run.dmem_rdata = dmem_read(sync.dmem_addr);
+            }
+
+            if (sync.dmem_write) {
+                dmem_write(sync.dmem_addr, sync.dmem_wdata, sync.dmem_byte_enable);
+            }
+
+            if (run.halt && sync.halted) {
+                save_checkpoint(checkpoint.save_path);
+                saved = true;
+            }
+
+            uint32_t period = spin_detector.update(sync, run, written);
+            if (fast_forward && period > 0) {
+                if (system.quiet_cycles() == Device::QUIET_FOREVER) {
+                    printf("[TB] WARN Core polls %08x at %08x without pending device events, "
+                           "stopping\n",
+                           sync.dmem_addr, sync.imem_addr);
+                    break;
+                }
+                cycle += skip_periods(period);
+            }
+        }
+
+        finish();
+    }
+
+    // Runs the program on the Iss from the reset or restored state until the configured number of
+    // instructions or the configured address is reached. Returns false if the program stopped
+    // before, otherwise the Iss state is injected into the RTL core.
+    bool run_iss() {
+        uint64_t stop_pc = Iss::NO_STOP_PC;
+        if (iss.until) {
+            char *end;
+            stop_pc = strtoull(iss.until, &end, 0);
+            uint32_t symbol;
+            if (*end != '\0' && image.find_symbol(iss.until, symbol)) {
+                stop_pc = symbol;
+            } else if (*end != '\0') {
+                printf("[TB] WARN Unknown symbol %s, the ISS runs until the program stops\n",
+                       iss.until);
+                stop_pc = Iss::NO_STOP_PC;
+            }
+        }
+        uint64_t max_instructions = iss.instructions > 0 ? iss.instructions : UINT64_MAX;
+
+        uint64_t start_cycle = system.get_cycle();
+        Iss core(system, iss.m_extension, *timer_interrupt_pending_flag, *stop_criterium);
+        if (injected) {
+            core.set_state(injected_core);
+        } else {
+            core.reset();
+        }
+        Iss::StopReason reason = core.run(max_instructions, stop_pc);
+
+        // The Iss advances the devices, SystemC time follows like for skipped polling loops
+        uint64_t elapsed = system.get_cycle() - start_cycle;
+        wait(clock_period * static_cast<double>(elapsed));
+
+        if (reason == Iss::STOP_FLAG) {
+            printf("[TB] Program stopped in the ISS after %" PRIu64 " instructions\n",
+                   core.get_instructions());
+            return false;
+        }
+
+        injected_core = core.get_state();
+        injected = true;
+        printf("[TB] ISS executed %" PRIu64 " instructions, switching to RTL at pc %08x "
+               "(cycle %" PRIu64 ")\n",
+               core.get_instructions(), injected_core.words[CoreState::PC], system.get_cycle());
+        return true;
+    }
+
+    void save_checkpoint(char const *path) {
+        CoreState core;
+        bridge->read_state(0, CoreState::WORDS, core.words);
+        if (Checkpoint::save(path, system, core)) {
+            printf("[TB] Saved checkpoint %s at cycle %" PRIu64 " (pc %08x)\n", path,
+                   system.get_cycle(), core.words[CoreState::PC]);
+        }
+    }
+
+    // Skips as many periods of a polling loop as possible before the next device event and
+    // returns the number of skipped cycles
+    uint64_t skip_periods(uint32_t period) {
+        uint64_t skip = system.quiet_cycles() / period * period;
+        if (skip > 0) {
+            system.advance(skip);
+            wait(clock_period * static_cast<double>(skip));
+            skipped_cycles += skip;
+        }
+        return skip;
+    }
+#endif
+
+    void finish() {
+        // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+        // Interrupt simulaiton
+        // +++++++++++++++++++++++++++++++++++++++++++++++++++++++
+        print_results();
+#ifndef MTI_SYSTEMC
+        if (fast_forward) {
+            printf("[TB] Fast-forwarded %" PRIu64 " cycles of polling loops\n", skipped_cycles);
+        }
+        if (lockstep) {
+            printf("[TB] Lockstep checked %" PRIu64 " events%s\n", lockstep->get_checked(),
+                   diverged ? " until the divergence" : " without divergence");
+        }
+        if (profiler) {
+            profiler->print_summary(5);
+            if (profiler->write(profile.path)) {
+                printf("[TB] Wrote profile to %s and %s.folded\n", profile.path, profile.path);
+            }
+        }
+        if (wave) {
+            wave->finish();
+        }
+#endif
+
+        dump_memory();
+
+        Trace::close();
+        sc_stop();
     }
 };
 
@@ -194,12 +652,145 @@ int sc_main(int argc, char *argv[]) {
         return 1;
     }
 
-    VHSocket vhsock(argv[1], 103, 67);
+    TestbenchOptions options;
+    int core_sim_args = 0;  // Position of "--"
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            // The rest is for core_sim running in this process, "--" becomes its argv[0]
+            core_sim_args = i;
+            argv[i] = const_cast<char *>("core_sim");
+            break;
+        } else if (strcmp(argv[i], "--transaction-level") == 0) {
+            options.transaction_level = true;
+        } else if (strcmp(argv[i], "--fast-forward") == 0) {
+            options.fast_forward = true;
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            options.direct = true;
+        } else if (strcmp(argv[i], "--lockstep") == 0) {
+            options.lockstep = true;
+        } else if (strncmp(argv[i], "--quantum=", 10) == 0) {
+            options.quantum = atoi(argv[i] + 10);
+            if (options.quantum < 1 || options.quantum > sim_wrapper::MAX_QUANTUM) {
+                printf("Quantum has to be between 1 and %d\n", sim_wrapper::MAX_QUANTUM);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--save-checkpoint=", 18) == 0) {
+            options.checkpoint.save_path = argv[i] + 18;
+        } else if (strncmp(argv[i], "--checkpoint-cycle=", 19) == 0) {
+            options.checkpoint.save_cycle = strtoull(argv[i] + 19, nullptr, 0);
+        } else if (strncmp(argv[i], "--restore-checkpoint=", 21) == 0) {
+            options.checkpoint.restore_path = argv[i] + 21;
+        } else if (strncmp(argv[i], "--iss-instructions=", 19) == 0) {
+            options.iss.instructions = strtoull(argv[i] + 19, nullptr, 0);
+        } else if (strncmp(argv[i], "--iss-until=", 12) == 0) {
+            options.iss.until = argv[i] + 12;
+        } else if (strncmp(argv[i], "--isa=", 6) == 0) {
+            options.iss.m_extension = strchr(argv[i] + 6, 'm') != nullptr;
+        } else if (strncmp(argv[i], "--image=", 8) == 0) {
+            options.paths.image = argv[i] + 8;
+        } else if (strncmp(argv[i], "--uart-in=", 10) == 0) {
+            options.paths.uart_in = argv[i] + 10;
+        } else if (strncmp(argv[i], "--uart-out=", 11) == 0) {
+            options.paths.uart_out = argv[i] + 11;
+        } else if (strncmp(argv[i], "--dump=", 7) == 0) {
+            options.paths.dump = argv[i] + 7;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            options.profile.path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--profile-period=", 17) == 0) {
+            options.profile.period = strtoul(argv[i] + 17, nullptr, 0);
+            if (options.profile.period < 1) {
+                printf("Profile period has to be at least 1\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--wave-capture=", 15) == 0) {
+            options.wave_capture.path = argv[i] + 15;
+        } else if (strncmp(argv[i], "--wave-pc=", 10) == 0) {
+            options.wave_capture.pc = argv[i] + 10;
+        } else if (strncmp(argv[i], "--wave-window=", 14) == 0) {
+            if (!parse_wave_window(argv[i] + 14, options.wave_capture)) {
+                printf("Wave window has to be <first cycle>:<last cycle>\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--wave-pre=", 11) == 0) {
+            options.wave_capture.pre = strtoul(argv[i] + 11, nullptr, 0);
+        } else if (strncmp(argv[i], "--wave-post=", 12) == 0) {
+            options.wave_capture.post = strtoul(argv[i] + 12, nullptr, 0);
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            if (!Trace::parse_level(argv[i] + 8, Trace::level)) {
+                printf("Trace level has to be none, warn or access\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--trace-file=", 13) == 0) {
+            if (!Trace::open_binary(argv[i] + 13)) {
+                printf("Could not open trace file %s\n", argv[i] + 13);
+                return 1;
+            }
+        } else {
+            printf("Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (options.fast_forward && !options.transaction_level) {
+        printf("Fast-forwarding requires --transaction-level\n");
+        return 1;
+    }
+
+    if ((options.checkpoint.save_path || options.checkpoint.restore_path) &&
+        !options.transaction_level) {
+        printf("Checkpoints require --transaction-level\n");
+        return 1;
+    }
+
+    if (options.iss.enabled() && !options.transaction_level) {
+        printf("The ISS requires --transaction-level\n");
+        return 1;
+    }
+
+    if (options.lockstep && !options.transaction_level) {
+        printf("Lockstep checking requires --transaction-level\n");
+        return 1;
+    }
+
+    if (options.profile.path && options.transaction_level) {
+        printf("Profiling requires the pin level loop (no --transaction-level)\n");
+        return 1;
+    }
+
+    if (options.wave_capture.path && options.transaction_level) {
+        printf("Wave capture requires the pin level loop (no --transaction-level)\n");
+        return 1;
+    }
+
+    int in_buffer_words = sim_wrapper::IN_BUFFER_WORDS;
+    int out_buffer_words = sim_wrapper::OUT_BUFFER_WORDS;
+    if (options.transaction_level) {
+        in_buffer_words = TransactionBridge::in_buffer_words(options.lockstep);
+        out_buffer_words = TransactionBridge::out_buffer_words(options.lockstep);
+    } else if (options.quantum > 1) {
+        in_buffer_words = sim_wrapper::LOOKAHEAD_IN_BUFFER_WORDS;
+        out_buffer_words = sim_wrapper::lookahead_out_buffer_words(options.quantum);
+    }
+
+#ifdef GHDL_INPROC
+    if (!core_sim_args) {
+        printf("Missing core_sim arguments after --\n");
+        return 1;
+    }
+    VHSocket::start_inproc(argc - core_sim_args, argv + core_sim_args);
+#else
+    if (core_sim_args) {
+        printf("Running core_sim in this process requires eisv-mem-system-inproc\n");
+        return 1;
+    }
+#endif
+
+    VHSocket vhsock(argv[1], in_buffer_words, out_buffer_words);
 
-    std::unique_ptr<main> tb = std::make_unique<main>("main", vhsock);
+    std::unique_ptr<main> tb = std::make_unique<main>("main", vhsock, options);
 
     sc_start();
 
-    return 0;
+    return tb->diverged ? 1 : 0;
 }
 #endif
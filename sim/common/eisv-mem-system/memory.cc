@@ -1,23 +1,111 @@
 #include "memory.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
 #include <cstdio>
+#include <cstdlib>
+#include <new>
 #include <random>
 
-Memory::Memory(size_t size) : memory(size, 0) {}
+// Anonymous pages are zero and only backed by RAM once written
+static uint32_t* map_anonymous(size_t bytes) {
+    void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return data == MAP_FAILED ? nullptr : static_cast<uint32_t*>(data);
+}
+
+static std::string real_path(char const* path) {
+    char resolved[PATH_MAX];
+    return realpath(path, resolved) ? std::string(resolved) : std::string();
+}
+
+Memory::Memory(size_t size) : size(size) {
+    memory = map_anonymous(size * sizeof(uint32_t));
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+}
+
+Memory::~Memory() {
+    unmap();
+}
+
+void Memory::unmap() {
+    munmap(memory, size * sizeof(uint32_t));
+    memory = nullptr;
+    shared_path.clear();
+}
+
+bool Memory::map_from_file(char const* path, uint64_t offset) {
+    return map(path, false, offset);
+}
+
+bool Memory::map_to_file(char const* path) {
+    return map(path, true, 0);
+}
+
+bool Memory::map(char const* path, bool shared, uint64_t offset) {
+    size_t bytes = size * sizeof(uint32_t);
+    int fd = shared ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    uint32_t* data = nullptr;
+    if (shared) {
+        if (ftruncate(fd, bytes) == 0) {
+            void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            data = mapped == MAP_FAILED ? nullptr : static_cast<uint32_t*>(mapped);
+        }
+    } else {
+        // Only the pages covered by the file are mapped from it, accessing pages of a file mapping
+        // beyond its end would raise SIGBUS
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && offset % sysconf(_SC_PAGESIZE) == 0) {
+            data = map_anonymous(bytes);
+            size_t file_bytes =
+                std::min<uint64_t>(std::max<int64_t>(file_stat.st_size - offset, 0), bytes);
+            if (data && file_bytes > 0 &&
+                mmap(data, file_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+                     offset) == MAP_FAILED) {
+                munmap(data, bytes);
+                data = nullptr;
+            }
+        }
+    }
+    close(fd);
+
+    if (!data) {
+        return false;
+    }
+
+    unmap();
+    memory = data;
+    if (shared) {
+        shared_path = real_path(path);
+    }
+    return true;
+}
 
 bool Memory::init_from_file(char const* path, int offset) {
     std::ifstream ifile(path, std::ios::binary);
-    if (!ifile.is_open()) {
+    if (!ifile.is_open() || offset < 0) {
         return false;
     }
-
-    while (!ifile.eof() && offset < memory.size()) {
-        uint32_t value;
-        ifile.read(reinterpret_cast<char*>(&value), sizeof(value));
-        memory[offset] = value;
-        offset++;
+    size_t word_offset = static_cast<size_t>(offset);
+    if (word_offset > size) {
+        return false;
     }
 
+    // Reads up to the end of the file or the memory, a trailing partial word keeps its upper bytes
+    ifile.read(reinterpret_cast<char*>(memory + word_offset),
+               (size - word_offset) * sizeof(uint32_t));
+
     ifile.close();
     return true;
 }
@@ -27,18 +115,22 @@ void Memory::init_random() {
     std::mt19937 gen(rd());
     std::uniform_int_distribution<uint32_t> dis;
 
-    for (int i = 0; i < memory.size(); i++) {
+    for (size_t i = 0; i < size; i++) {
         memory[i] = dis(gen);
     }
 }
 
 bool Memory::write_to_file(char const* path) {
+    if (!shared_path.empty() && real_path(path) == shared_path) {
+        return true;
+    }
+
     std::FILE* out_file = std::fopen(path, "w");
     if (!out_file) {
         return false;
     }
 
-    fwrite(memory.data(), sizeof(uint32_t), memory.size(), out_file);
+    fwrite(memory, sizeof(uint32_t), size, out_file);
 
     std::fflush(out_file);
     std::fclose(out_file);
@@ -46,24 +138,23 @@ bool Memory::write_to_file(char const* path) {
     return true;
 }
 
+uint32_t const* Memory::get_data() const {
+    return memory;
+}
+
+size_t Memory::get_size() const {
+    return size;
+}
+
 bool Memory::write(uint32_t local_address, uint32_t value, uint8_t byte_enable) {
     size_t word_addr = local_address >> 2;
 
-    if (word_addr >= memory.size()) {
+    if (word_addr >= size) {
         return false;
     }
 
-    uint32_t new_value = memory[word_addr];
-    for (int i = 0; i < 4; i++) {
-        uint32_t mask = (0xff << (8 * i));
-
-        if (byte_enable & (1 << i)) {
-            new_value &= ~mask;
-            new_value |= value & mask;
-        }
-    }
-
-    memory[word_addr] = new_value;
+    uint32_t mask = byte_enable_mask(byte_enable);
+    memory[word_addr] = (memory[word_addr] & ~mask) | (value & mask);
 
     return true;
 }
@@ -71,19 +162,34 @@ bool Memory::write(uint32_t local_address, uint32_t value, uint8_t byte_enable)
 bool Memory::read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) {
     size_t word_addr = local_address >> 2;
 
-    if (word_addr >= memory.size()) {
+    if (word_addr >= size) {
         return false;
     }
 
-    uint32_t word_read = memory[word_addr];
+    // Always returns the full word, the core selects the bytes itself
+    value_out = memory[word_addr];
 
-    uint32_t value = 0;
-    for (int i = 0; i < 4; i++) {
-        value |= word_read & (0xff << (8 * i));
-    }
-    // printf("Read %08x from IMEM at %08x\n", word_read, word_addr);
+    return true;
+}
 
-    value_out = value;
+Device::Timing Memory::timing() {
+    return TIMING_NONE;
+}
+
+bool Memory::peek(uint32_t local_address, uint32_t& value_out) {
+    return read(local_address, value_out, 0b1111);
+}
 
+bool Memory::load_dmi(char const* path, uint64_t offset, uint64_t size) {
+    return size == this->size * sizeof(uint32_t) && map_from_file(path, offset);
+}
+
+bool Memory::get_dmi(Dmi& dmi_out) {
+    dmi_out = Dmi{
+        .data = memory,
+        .size = static_cast<uint32_t>(size * sizeof(uint32_t)),
+        .readable = true,
+        .writable = true,
+    };
     return true;
-}
\ No newline at end of file
+}
@@ -4,24 +4,55 @@
 #include <cstddef>
 #include <fstream>
 #include <iomanip>
-#include <vector>
+#include <string>
 
 #include "device.h"
 
+// Word addressed memory. The backing store is an anonymous mapping by default, so pages are only
+// allocated when they are first written, or alternatively a mapped image file.
 class Memory : public Device {
    public:
     Memory(size_t size);
+    ~Memory();
+
+    Memory(Memory const&) = delete;
+    Memory& operator=(Memory const&) = delete;
 
     bool init_from_file(char const* path, int offset);
     void init_random();
 
+    // Both replace the contents and the backing store, so they have to be called before any DMI
+    // pointer to the memory is handed out.
+
+    // Maps the image at path copy-on-write as initial contents, writes never reach the file. Pages
+    // are read on first access. The image may start at a page aligned offset into the file.
+    bool map_from_file(char const* path, uint64_t offset = 0);
+
+    // Backs the zeroed memory by the file at path, which is created or truncated and reflects all
+    // writes immediately
+    bool map_to_file(char const* path);
+
+    // Dumping to the file the memory is backed by (map_to_file) does not copy anything
     bool write_to_file(char const* path);
 
+    uint32_t const* get_data() const;
+    size_t get_size() const;
+
     virtual bool write(uint32_t local_address, uint32_t value, uint8_t byte_enable) override;
     virtual bool read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) override;
+    virtual Timing timing() override;
+    virtual bool peek(uint32_t local_address, uint32_t& value_out) override;
+    virtual bool get_dmi(Dmi& dmi_out) override;
+    // Maps the checkpoint copy-on-write, so restoring does not read untouched pages
+    virtual bool load_dmi(char const* path, uint64_t offset, uint64_t size) override;
 
    private:
-    std::vector<uint32_t> memory;
+    bool map(char const* path, bool shared, uint64_t offset);
+    void unmap();
+
+    uint32_t* memory;
+    size_t size;  // In words
+    std::string shared_path;
 };
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef MEMORY_MAP_H
+#define MEMORY_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "system.h"
+
+constexpr size_t ROM_BYTES = 1 << 10;
+constexpr size_t ROM_WORDS = ROM_BYTES >> 2;
+
+constexpr size_t RAM_BYTES = 1 << 16;
+constexpr size_t RAM_WORDS = RAM_BYTES >> 2;
+
+constexpr uint32_t ROM_BASE = 0x00000000;
+constexpr uint32_t RAM_BASE = 0x10000000;
+constexpr uint32_t STOP_DEVICE_BASE = 0x80000000;
+constexpr uint32_t TIMER_BASE = 0x80000010;
+constexpr uint32_t UART_BASE = 0x90000000;
+
+// Memory map of the testbench, shared with bench/decode_bench.cc so that the benchmark decodes
+// the same segments
+inline void add_testbench_devices(System &system, Device *ram, Device *rom, Device *stop_device,
+                                  Device *timer_device, Device *uart_device) {
+    system.add_device(ram, 16, RAM_BASE);
+    system.add_device(rom, 22, ROM_BASE);
+    system.add_device(stop_device, 28, STOP_DEVICE_BASE);
+    system.add_device(timer_device, 28, TIMER_BASE);
+    system.add_device(uart_device, 28, UART_BASE);
+}
+
+#endif
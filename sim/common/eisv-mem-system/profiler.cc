@@ -0,0 +1,240 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <map>
+
+// Hottest addresses listed in the flat profile
+constexpr size_t HOT_ADDRESSES = 32;
+
+static std::string const UNKNOWN_NAME = "[unknown]";
+
+static bool is_link(uint32_t reg) {
+    return reg == 1 || reg == 5;
+}
+
+Profiler::Profiler(ElfImage const& image, System::Dmi const& rom, uint32_t period)
+    : rom(rom),
+      period(period),
+      countdown(period),
+      functions(rom.size / 4, UNKNOWN),
+      samples(rom.size / 4, 0),
+      nodes{Node{.function = UNKNOWN, .parent = -1, .children = {}}} {
+    // Labels (e.g. in crt0.S) extend up to the next symbol, functions with a size take precedence
+    std::vector<ElfSymbol const*> symbols;
+    for (ElfSymbol const& symbol : image.symbols) {
+        if (symbol.value - rom.first < rom.size && (symbol.is_function || symbol.size == 0)) {
+            symbols.push_back(&symbol);
+        }
+    }
+    std::stable_sort(symbols.begin(), symbols.end(),
+                     [](ElfSymbol const* a, ElfSymbol const* b) { return a->value < b->value; });
+
+    for (size_t i = 0; i < symbols.size(); i++) {
+        if (symbols[i]->is_function) {
+            continue;
+        }
+        uint32_t end = i + 1 < symbols.size() ? symbols[i + 1]->value - rom.first : rom.size;
+        for (uint32_t offset = symbols[i]->value - rom.first; offset < end; offset += 4) {
+            functions[offset / 4] = names.size();
+        }
+        names.push_back(symbols[i]->name);
+    }
+    for (ElfSymbol const* symbol : symbols) {
+        if (!symbol->is_function) {
+            continue;
+        }
+        uint32_t end = std::min<uint64_t>(uint64_t{symbol->value - rom.first} + symbol->size,
+                                          rom.size);
+        for (uint32_t offset = symbol->value - rom.first; offset < end; offset += 4) {
+            functions[offset / 4] = names.size();
+        }
+        names.push_back(symbol->name);
+    }
+}
+
+int Profiler::function_at(uint32_t pc) const {
+    uint32_t index = (pc - rom.first) >> 2;
+    return index < functions.size() ? functions[index] : UNKNOWN;
+}
+
+std::string const& Profiler::function_name(int function) const {
+    return function == UNKNOWN ? UNKNOWN_NAME : names[function];
+}
+
+int Profiler::child(int parent, int function) {
+    auto it = nodes[parent].children.find(function);
+    if (it != nodes[parent].children.end()) {
+        return it->second;
+    }
+    int index = nodes.size();
+    nodes.push_back(Node{.function = function, .parent = parent, .children = {}});
+    nodes[parent].children[function] = index;
+    return index;
+}
+
+void Profiler::jump(uint32_t from, uint32_t to) {
+    uint32_t index = (from - rom.first) >> 2;
+    if (index >= rom.size / 4) {
+        return;
+    }
+    uint32_t instruction = rom.data[index];
+    uint32_t opcode = instruction & 0x7f;
+    uint32_t rd = (instruction >> 7) & 0x1f;
+    uint32_t rs1 = (instruction >> 15) & 0x1f;
+
+    bool call;
+    bool ret;
+    if (opcode == 0x6f) {  // jal
+        // Traps and mret can also interrupt the fetch at a jal, only its own target counts
+        uint32_t offset = ((instruction >> 31) ? 0xfff00000 : 0) | (instruction & 0x000ff000) |
+                          ((instruction >> 9) & 0x800) | ((instruction >> 20) & 0x7fe);
+        call = is_link(rd) && from + offset == to;
+        ret = false;
+    } else if (opcode == 0x67) {  // jalr
+        call = is_link(rd);
+        ret = is_link(rs1) && (!is_link(rd) || rs1 != rd);
+    } else {
+        return;
+    }
+
+    if (ret && !stack.empty()) {
+        node = stack.back();
+        stack.pop_back();
+    }
+    if (call) {
+        stack.push_back(node);
+        if (stack.size() < MAX_DEPTH) {
+            // The caller may not be on the stack yet, e.g. after a tail call or in a trap handler
+            int caller = function_at(from);
+            if (caller != nodes[node].function) {
+                node = child(node, caller);
+            }
+            node = child(node, function_at(to));
+        }
+    }
+}
+
+void Profiler::sample(uint32_t pc) {
+    uint32_t index = (pc - rom.first) >> 2;
+    if (index < samples.size()) {
+        samples[index]++;
+    } else {
+        outside++;
+    }
+
+    uint64_t key = (uint64_t{static_cast<uint32_t>(node)} << 32) |
+                   static_cast<uint32_t>(function_at(pc));
+    if (key != last_key) {
+        last_key = key;
+        last_count = &stack_samples[key];
+    }
+    (*last_count)++;
+}
+
+std::string Profiler::stack_of(int node, int leaf) const {
+    std::vector<int> frames;
+    for (int i = node; i > 0; i = nodes[i].parent) {
+        frames.push_back(nodes[i].function);
+    }
+    if (frames.empty() || frames.front() != leaf) {
+        frames.insert(frames.begin(), leaf);
+    }
+
+    std::string stack;
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+        if (!stack.empty()) {
+            stack += ';';
+        }
+        stack += function_name(*it);
+    }
+    return stack;
+}
+
+std::vector<std::pair<int, uint64_t>> Profiler::function_totals() const {
+    std::map<int, uint64_t> totals;
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (samples[i] != 0) {
+            totals[functions[i]] += samples[i];
+        }
+    }
+    std::vector<std::pair<int, uint64_t>> sorted(totals.begin(), totals.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](auto const& a, auto const& b) { return a.second > b.second; });
+    return sorted;
+}
+
+bool Profiler::write(char const* path) const {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("[TB] WARN Could not write profile %s\n", path);
+        return false;
+    }
+
+    uint64_t total = outside;
+    for (uint64_t count : samples) {
+        total += count;
+    }
+    double percent = total ? 100.0 / total : 0.0;
+
+    fprintf(file, "# %" PRIu64 " samples of the fetch address, one every %u cycles\n", total,
+            period);
+    fprintf(file, "#  samples       %%  function\n");
+    for (auto const& [function, count] : function_totals()) {
+        fprintf(file, "%10" PRIu64 "  %5.1f%%  %s\n", count, count * percent,
+                function_name(function).c_str());
+    }
+    if (outside != 0) {
+        fprintf(file, "%10" PRIu64 "  %5.1f%%  [outside of the ROM]\n", outside, outside * percent);
+    }
+
+    std::vector<uint32_t> hot;
+    for (uint32_t i = 0; i < samples.size(); i++) {
+        if (samples[i] != 0) {
+            hot.push_back(i);
+        }
+    }
+    std::stable_sort(hot.begin(), hot.end(),
+                     [&](uint32_t a, uint32_t b) { return samples[a] > samples[b]; });
+    hot.resize(std::min(hot.size(), HOT_ADDRESSES));
+
+    fprintf(file, "\n#  address   samples       %%  function\n");
+    for (uint32_t index : hot) {
+        fprintf(file, "  %08x %9" PRIu64 "  %5.1f%%  %s\n", rom.first + index * 4, samples[index],
+                samples[index] * percent, function_name(functions[index]).c_str());
+    }
+    fclose(file);
+
+    std::map<std::string, uint64_t> folded;
+    for (auto const& [key, count] : stack_samples) {
+        folded[stack_of(key >> 32, static_cast<int32_t>(key))] += count;
+    }
+
+    std::string folded_path = std::string(path) + ".folded";
+    file = fopen(folded_path.c_str(), "w");
+    if (!file) {
+        printf("[TB] WARN Could not write profile %s\n", folded_path.c_str());
+        return false;
+    }
+    for (auto const& [stack, count] : folded) {
+        fprintf(file, "%s %" PRIu64 "\n", stack.c_str(), count);
+    }
+    fclose(file);
+    return true;
+}
+
+void Profiler::print_summary(int count) const {
+    uint64_t total = outside;
+    for (uint64_t samples_at : samples) {
+        total += samples_at;
+    }
+    printf("[TB] Hottest functions:\n");
+    for (auto const& [function, samples_in] : function_totals()) {
+        if (count-- == 0) {
+            break;
+        }
+        printf("[TB]   %5.1f%%  %s\n", total ? 100.0 * samples_in / total : 0.0,
+               function_name(function).c_str());
+    }
+}
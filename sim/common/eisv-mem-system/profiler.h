@@ -0,0 +1,84 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "elf_loader.h"
+#include "system.h"
+
+// Hot spots of the program from the fetch address of every cycle (or every period-th cycle),
+// counted in a flat array over the ROM and attributed to the functions of the ELF image.
+//
+// Calls and returns are recognized from the jal/jalr register conventions of the RISC-V
+// specification: a jump linking x1 or x5 is a call, a jalr through x1 or x5 not linking them is a
+// return. A jump is seen as a fetch that does not follow the previous one, eisv_core fetches the
+// jump itself until it is resolved. Traps are not calls, their handlers appear on top of the
+// interrupted function.
+class Profiler {
+   public:
+    // rom has to stay valid, it is used to decode the jumps
+    Profiler(ElfImage const& image, System::Dmi const& rom, uint32_t period);
+
+    // Called every cycle with the current fetch address
+    void fetch(uint32_t pc) {
+        if (pc != last_pc) {
+            if (pc != last_pc + 4) {
+                jump(last_pc, pc);
+            }
+            last_pc = pc;
+        }
+        if (--countdown == 0) {
+            countdown = period;
+            sample(pc);
+        }
+    }
+
+    // Flat profile (functions, then the hottest addresses) to path and the folded stacks (one
+    // "caller;callee count" line per stack, for flamegraph.pl and speedscope) to path.folded
+    bool write(char const* path) const;
+
+    // Functions with the most samples, at most count
+    void print_summary(int count) const;
+
+   private:
+    static constexpr int MAX_DEPTH = 64;
+    static constexpr int UNKNOWN = -1;  // Function of addresses outside of all symbols
+
+    struct Node {
+        int function;
+        int parent;
+        std::unordered_map<int, int> children;
+    };
+
+    int function_at(uint32_t pc) const;
+    std::string const& function_name(int function) const;
+    int child(int node, int function);
+    void jump(uint32_t from, uint32_t to);
+    void sample(uint32_t pc);
+    std::string stack_of(int node, int leaf) const;
+    std::vector<std::pair<int, uint64_t>> function_totals() const;
+
+    System::Dmi const& rom;
+    uint32_t period;
+    uint32_t countdown;
+    uint32_t last_pc = 0;
+
+    std::vector<std::string> names;
+    std::vector<int> functions;     // Per ROM word
+    std::vector<uint64_t> samples;  // Per ROM word
+    uint64_t outside = 0;           // Samples outside of the ROM
+
+    std::vector<Node> nodes;  // Call tree, node 0 is the root without function
+    std::vector<int> stack;   // Nodes to return to
+    int node = 0;
+
+    // Samples per (call tree node, function of the sampled address)
+    std::unordered_map<uint64_t, uint64_t> stack_samples;
+    uint64_t last_key = UINT64_MAX;
+    uint64_t* last_count = nullptr;
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "sparse_memory.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+SparseMemory::SparseMemory(size_t size)
+    : size(size), pages((size + PAGE_WORDS - 1) >> PAGE_WORDS_SHIFT) {}
+
+uint32_t* SparseMemory::find_page(size_t page_index, bool allocate) {
+    if (page_index == hot_index) {
+        return hot_page;
+    }
+
+    std::unique_ptr<uint32_t[]>& page = pages[page_index];
+    if (!page) {
+        if (!allocate) {
+            return nullptr;
+        }
+        page.reset(new uint32_t[PAGE_WORDS]());
+    }
+
+    hot_index = page_index;
+    hot_page = page.get();
+    return hot_page;
+}
+
+bool SparseMemory::init_from_file(char const* path, int offset) {
+    if (offset < 0) {
+        return false;
+    }
+    size_t word_offset = static_cast<size_t>(offset);
+    if (word_offset > size) {
+        return false;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    off_t end = std::min<off_t>(lseek(fd, 0, SEEK_END), (size - word_offset) * sizeof(uint32_t));
+    std::vector<uint32_t> chunk(PAGE_WORDS);
+    off_t position = 0;
+    while (position < end) {
+        // Holes of sparse files (e.g. from write_to_file) are skipped without reading them
+        off_t data_start = lseek(fd, position, SEEK_DATA);
+        if (data_start == -1) {
+            if (errno == ENXIO) {
+                break;
+            }
+            data_start = position;
+        }
+        off_t data_end = lseek(fd, data_start, SEEK_HOLE);
+        data_end = data_end == -1 ? end : std::min(data_end, end);
+        position = data_start & ~off_t{3};
+
+        while (position < data_end) {
+            size_t bytes = std::min<off_t>(PAGE_WORDS * sizeof(uint32_t), data_end - position);
+            ssize_t count = pread(fd, chunk.data(), bytes, position);
+            if (count <= 0) {
+                close(fd);
+                return count == 0;
+            }
+            // A trailing partial word keeps its upper bytes zero
+            std::fill(reinterpret_cast<uint8_t*>(chunk.data()) + count,
+                      reinterpret_cast<uint8_t*>(chunk.data() + PAGE_WORDS), 0);
+
+            size_t words = (static_cast<size_t>(count) + 3) / 4;
+            size_t word_addr = word_offset + position / sizeof(uint32_t);
+            for (size_t i = 0; i < words; i++, word_addr++) {
+                uint32_t* page = find_page(word_addr >> PAGE_WORDS_SHIFT, chunk[i] != 0);
+                if (page) {
+                    page[word_addr & (PAGE_WORDS - 1)] = chunk[i];
+                }
+            }
+            position += count;
+        }
+    }
+
+    close(fd);
+    return true;
+}
+
+bool SparseMemory::write_to_file(char const* path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    bool complete = ftruncate(fd, size * sizeof(uint32_t)) == 0;
+    for (size_t i = 0; i < pages.size() && complete; i++) {
+        if (!pages[i]) {
+            continue;
+        }
+        size_t words = std::min(PAGE_WORDS, size - (i << PAGE_WORDS_SHIFT));
+        ssize_t bytes = words * sizeof(uint32_t);
+        complete = pwrite(fd, pages[i].get(), bytes, (i << PAGE_WORDS_SHIFT) * 4) == bytes;
+    }
+
+    close(fd);
+    return complete;
+}
+
+size_t SparseMemory::get_size() const {
+    return size;
+}
+
+size_t SparseMemory::populated_pages() const {
+    return std::count_if(pages.begin(), pages.end(),
+                         [](std::unique_ptr<uint32_t[]> const& page) { return bool(page); });
+}
+
+bool SparseMemory::write(uint32_t local_address, uint32_t value, uint8_t byte_enable) {
+    size_t word_addr = local_address >> 2;
+
+    if (word_addr >= size) {
+        return false;
+    }
+
+    // Writing zeros to an unpopulated page does not change anything
+    uint32_t mask = byte_enable_mask(byte_enable);
+    uint32_t* page = find_page(word_addr >> PAGE_WORDS_SHIFT, (value & mask) != 0);
+    if (page) {
+        uint32_t& word = page[word_addr & (PAGE_WORDS - 1)];
+        word = (word & ~mask) | (value & mask);
+    }
+
+    return true;
+}
+
+bool SparseMemory::read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) {
+    size_t word_addr = local_address >> 2;
+
+    if (word_addr >= size) {
+        return false;
+    }
+
+    uint32_t* page = find_page(word_addr >> PAGE_WORDS_SHIFT, false);
+    value_out = page ? page[word_addr & (PAGE_WORDS - 1)] : 0;
+
+    return true;
+}
+
+Device::Timing SparseMemory::timing() {
+    return TIMING_NONE;
+}
+
+bool SparseMemory::peek(uint32_t local_address, uint32_t& value_out) {
+    return read(local_address, value_out, 0b1111);
+}
+
+constexpr size_t PAGE_STATE_BYTES = sizeof(uint64_t) + SparseMemory::PAGE_WORDS * sizeof(uint32_t);
+
+void SparseMemory::save_state(std::vector<uint8_t>& state_out) {
+    state_out.resize(populated_pages() * PAGE_STATE_BYTES);
+    uint8_t* out = state_out.data();
+    for (uint64_t i = 0; i < pages.size(); i++) {
+        if (!pages[i]) {
+            continue;
+        }
+        std::memcpy(out, &i, sizeof(i));
+        std::memcpy(out + sizeof(i), pages[i].get(), PAGE_WORDS * sizeof(uint32_t));
+        out += PAGE_STATE_BYTES;
+    }
+}
+
+bool SparseMemory::restore_state(std::vector<uint8_t> const& state) {
+    if (state.size() % PAGE_STATE_BYTES != 0) {
+        return false;
+    }
+
+    for (std::unique_ptr<uint32_t[]>& page : pages) {
+        page.reset();
+    }
+    hot_index = SIZE_MAX;
+    hot_page = nullptr;
+
+    for (uint8_t const* in = state.data(); in != state.data() + state.size();
+         in += PAGE_STATE_BYTES) {
+        uint64_t index;
+        std::memcpy(&index, in, sizeof(index));
+        if (index >= pages.size()) {
+            return false;
+        }
+        std::memcpy(find_page(index, true), in + sizeof(index), PAGE_WORDS * sizeof(uint32_t));
+    }
+    return true;
+}
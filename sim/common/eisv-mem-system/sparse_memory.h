@@ -0,0 +1,49 @@
+#ifndef SPARSE_MEMORY_H
+#define SPARSE_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "device.h"
+
+// Word addressed memory for large, mostly empty address windows. Pages of 4 KB are allocated on
+// the first write of a non-zero value, unpopulated pages read as zero.
+class SparseMemory : public Device {
+   public:
+    static constexpr int PAGE_WORDS_SHIFT = 10;
+    static constexpr size_t PAGE_WORDS = size_t{1} << PAGE_WORDS_SHIFT;
+
+    SparseMemory(size_t size);
+
+    // Only pages receiving non-zero words from the file are populated
+    bool init_from_file(char const* path, int offset);
+
+    // Writes a file of the full memory size, unpopulated pages are left as holes
+    bool write_to_file(char const* path);
+
+    size_t get_size() const;
+    size_t populated_pages() const;
+
+    virtual bool write(uint32_t local_address, uint32_t value, uint8_t byte_enable) override;
+    virtual bool read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) override;
+    virtual Timing timing() override;
+    virtual bool peek(uint32_t local_address, uint32_t& value_out) override;
+    // Only populated pages are saved, each as its index followed by its words
+    virtual void save_state(std::vector<uint8_t>& state_out) override;
+    virtual bool restore_state(std::vector<uint8_t> const& state) override;
+
+   private:
+    // nullptr if the page is not populated and allocate is false
+    uint32_t* find_page(size_t page_index, bool allocate);
+
+    size_t size;  // In words
+    std::vector<std::unique_ptr<uint32_t[]>> pages;
+
+    // Page of the last access, most accesses hit the same page again
+    size_t hot_index = SIZE_MAX;
+    uint32_t* hot_page = nullptr;
+};
+
+#endif
@@ -1,11 +1,54 @@
 #include "stop_simulation_device.h"
 
+#include <cinttypes>
 #include <cstdio>
 #include <fstream>
 
+// CSR addresses, the high halves are at + 0x80
+constexpr uint32_t MCYCLE = 0xb00;
+constexpr uint32_t MINSTRET = 0xb02;
+constexpr uint32_t MHPMCOUNTER3 = 0xb03;
+constexpr uint32_t MHPMEVENT3 = 0x323;
+constexpr int HPM_COUNTERS = 4;
+
+// Events selected by mhpmevent, in the order of hpm_event_t in eisv_types_pkg
+struct HpmEvent {
+    char const* name;
+    bool stall;  // Counts cycles lost for retiring instructions
+};
+
+static HpmEvent const HPM_EVENTS[] = {
+    {"none", false},
+    {"load-use stalls", true},
+    {"CSR stalls", true},
+    {"jump bubbles", true},
+    {"flush bubbles", true},
+    {"taken jumps", false},
+    {"multiplications", false},
+    {"divisions", false},
+    {"loads", false},
+    {"stores", false},
+    {"traps", false},
+};
+constexpr uint32_t NUM_HPM_EVENTS = sizeof(HPM_EVENTS) / sizeof(HPM_EVENTS[0]);
+
 StopSimulationDevice::StopSimulationDevice(bool& stop_requested) : stop_requested(stop_requested) {}
 
 bool StopSimulationDevice::write(uint32_t local_address, uint32_t value, uint8_t byte_enable) {
+    switch (local_address & ~3u) {
+        case CSR_ADDRESS:
+            csr_address = value;
+            return true;
+        case CSR_VALUE:
+            csrs[csr_address] = value;
+            return true;
+        case WAVE_TRIGGER:
+            if (wave_trigger) {
+                wave_trigger(value);
+            }
+            return true;
+    }
+
     stop_requested = true;
 
     return_value = value;
@@ -17,6 +60,70 @@ bool StopSimulationDevice::read(uint32_t local_address, uint32_t& value_out, uin
     return false;
 }
 
+Device::Timing StopSimulationDevice::timing() {
+    return TIMING_NONE;
+}
+
 uint32_t StopSimulationDevice::get_return_value() const {
     return return_value;
 }
+
+void StopSimulationDevice::set_wave_trigger(std::function<void(uint32_t)> wave_trigger) {
+    this->wave_trigger = wave_trigger;
+}
+
+bool StopSimulationDevice::get_csr(uint32_t address, uint32_t& value_out) const {
+    auto it = csrs.find(address);
+    if (it == csrs.end()) {
+        return false;
+    }
+    value_out = it->second;
+    return true;
+}
+
+uint64_t StopSimulationDevice::get_counter(uint32_t address) const {
+    uint32_t low = 0;
+    uint32_t high = 0;
+    get_csr(address, low);
+    get_csr(address + 0x80, high);
+    return (uint64_t{high} << 32) | low;
+}
+
+void StopSimulationDevice::print_performance() const {
+    if (!csrs.count(MCYCLE) || !csrs.count(MINSTRET)) {
+        return;
+    }
+    uint64_t cycles = get_counter(MCYCLE);
+    uint64_t instructions = get_counter(MINSTRET);
+    double per_instruction = instructions ? 1.0 / instructions : 0.0;
+
+    printf("[TB] Performance counters:\n");
+    printf("[TB]   %-16s %12" PRIu64 "\n", "cycles", cycles);
+    printf("[TB]   %-16s %12" PRIu64 "  CPI %.3f\n", "instructions", instructions,
+           cycles * per_instruction);
+
+    // Stalls and bubbles are shown as their share of the CPI, the rest is pipeline fill and
+    // whatever no counter was selected for
+    uint64_t lost = 0;
+    for (int i = 0; i < HPM_COUNTERS; i++) {
+        uint32_t event = 0;
+        if (!get_csr(MHPMEVENT3 + i, event) || event == 0 || event >= NUM_HPM_EVENTS) {
+            continue;
+        }
+        uint64_t count = get_counter(MHPMCOUNTER3 + i);
+        if (HPM_EVENTS[event].stall) {
+            lost += count;
+            printf("[TB]   %-16s %12" PRIu64 "  CPI +%.3f (%.1f%% of cycles)\n",
+                   HPM_EVENTS[event].name, count, count * per_instruction,
+                   cycles ? 100.0 * count / cycles : 0.0);
+        } else {
+            printf("[TB]   %-16s %12" PRIu64 "  %.3f per instruction\n", HPM_EVENTS[event].name,
+                   count, count * per_instruction);
+        }
+    }
+    if (lost > 0 && cycles >= instructions + lost) {
+        uint64_t other = cycles - instructions - lost;
+        printf("[TB]   %-16s %12" PRIu64 "  CPI +%.3f (%.1f%% of cycles)\n", "other", other,
+               other * per_instruction, cycles ? 100.0 * other / cycles : 0.0);
+    }
+}
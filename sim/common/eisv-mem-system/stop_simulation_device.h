@@ -1,20 +1,48 @@
 #ifndef STOP_SIMULATION_DEVICE_H
 #define STOP_SIMULATION_DEVICE_H
 
+#include <functional>
+#include <map>
+
 #include "device.h"
 
+// Stops the simulation when the program writes its return value to RETURN_VALUE. Before that the
+// program may report CSRs such as the performance counters (see app/crt0.S) by writing the CSR
+// address to CSR_ADDRESS and then its value to CSR_VALUE. A write to WAVE_TRIGGER triggers the
+// wave capture (see WaveCapture), if there is one.
 class StopSimulationDevice : public Device {
    public:
+    static constexpr uint32_t RETURN_VALUE = 0x0;
+    static constexpr uint32_t CSR_ADDRESS = 0x4;
+    static constexpr uint32_t CSR_VALUE = 0x8;
+    static constexpr uint32_t WAVE_TRIGGER = 0xc;
+
     StopSimulationDevice(bool& stop_requested);
 
     virtual bool write(uint32_t local_address, uint32_t value, uint8_t byte_enable) override;
     virtual bool read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) override;
+    virtual Timing timing() override;
 
     uint32_t get_return_value() const;
 
+    // Called with the written value on writes to WAVE_TRIGGER
+    void set_wave_trigger(std::function<void(uint32_t)> wave_trigger);
+
+    // False if the program did not report the CSR
+    bool get_csr(uint32_t address, uint32_t& value_out) const;
+    // CPI and the events of the performance counters, nothing if they were not reported
+    void print_performance() const;
+
    private:
+    uint64_t get_counter(uint32_t address) const;
+
     uint32_t return_value;
     bool& stop_requested;
+
+    uint32_t csr_address = 0;
+    std::map<uint32_t, uint32_t> csrs;
+
+    std::function<void(uint32_t)> wave_trigger;
 };
 
 #endif
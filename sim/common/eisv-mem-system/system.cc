@@ -1,52 +1,336 @@
 #include "system.h"
 
+#include <algorithm>
+
 #include "cstdio"
 
-void System::add_device(Device* device, int prefix_length, uint32_t addr_prefix) {
+// Ranges of a page above which find_range switches from a linear to a binary search
+constexpr int LINEAR_SEARCH_RANGES = 4;
+
+static uint32_t segment_mask(int prefix_length) {
+    return ~static_cast<uint32_t>((uint64_t{1} << (32 - prefix_length)) - 1);
+}
+
+System::System() : page_table(PAGES, Page{0, 0}) {
+    std::fill(last_hit, last_hit + NUM_PORTS, nullptr);
+}
+
+bool System::add_device(Device* device, int prefix_length, uint32_t addr_prefix) {
+    if (prefix_length < 0 || prefix_length > 32) {
+        printf("ERROR: Invalid prefix length %d for device at %08x\n", prefix_length, addr_prefix);
+        return false;
+    }
+
+    uint32_t prefix_mask = segment_mask(prefix_length);
+    if ((addr_prefix & ~prefix_mask) != 0) {
+        printf("ERROR: Address prefix %08x/%d has bits set outside the prefix\n", addr_prefix,
+               prefix_length);
+        return false;
+    }
+
+    for (Segment const& segment : memory_map) {
+        uint32_t common_mask = segment_mask(std::min(prefix_length, segment.prefix_length));
+        if ((addr_prefix & common_mask) != (segment.addr_prefix & common_mask)) {
+            continue;
+        }
+
+        if (prefix_length == segment.prefix_length) {
+            printf("ERROR: Segment %08x/%d is already mapped\n", addr_prefix, prefix_length);
+            return false;
+        }
+
+        printf("INFO: Segment %08x/%d overlaps segment %08x/%d, the longer prefix wins\n",
+               addr_prefix, prefix_length, segment.addr_prefix, segment.prefix_length);
+    }
+
+    // A device mapped at several segments is still only advanced once per cycle
+    int slot = -1;
+    auto same_device = [&](Segment const& segment) { return segment.device == device; };
+    auto registered = std::find_if(memory_map.begin(), memory_map.end(), same_device);
+    bool first_segment = registered == memory_map.end();
+    if (!first_segment) {
+        slot = registered->slot;
+    } else if (device->timing() == Device::TIMING_TICK) {
+        ticked.push_back(device);
+    } else if (device->timing() == Device::TIMING_WAKEUP) {
+        slot = scheduled.size();
+        scheduled.push_back(Scheduled{device, Device::WAKEUP_NEVER});
+    }
+    if (first_segment) {
+        devices.push_back(device);
+    }
+
     memory_map.push_back(Segment{
         .prefix_length = prefix_length,
         .addr_prefix = addr_prefix,
         .device = device,
+        .slot = slot,
     });
+    build_page_table();
+
+    if (first_segment && slot != -1) {
+        reschedule(slot);
+    }
+    return true;
 }
 
-bool System::write(uint32_t global_address, uint32_t value, uint8_t byte_enable) {
-    Segment segment;
-    uint32_t local_address;
-    if (map_address(global_address, segment, local_address)) {
-        return segment.device->write(local_address, value, byte_enable);
+bool System::write(uint32_t global_address, uint32_t value, uint8_t byte_enable, Port port) {
+    Range const* range = map_address(global_address, port);
+    if (range) {
+        bool success =
+            range->device->write(global_address & range->local_mask, value, byte_enable);
+        if (range->slot != -1) {
+            reschedule(range->slot);
+        }
+        return success;
     }
 
     printf("WARN: Write to unmapped memory at %08x\n", global_address);
     return false;
 }
 
-bool System::read(uint32_t global_address, uint32_t& value_out, uint8_t byte_enable) {
-    Segment segment;
-    uint32_t local_address;
-    if (map_address(global_address, segment, local_address)) {
-        return segment.device->read(local_address, value_out, byte_enable);
+bool System::read(uint32_t global_address, uint32_t& value_out, uint8_t byte_enable, Port port) {
+    Range const* range = map_address(global_address, port);
+    if (range) {
+        bool success =
+            range->device->read(global_address & range->local_mask, value_out, byte_enable);
+        if (range->slot != -1) {
+            reschedule(range->slot);
+        }
+        return success;
     }
 
     printf("WARN: Read from unmapped memory at %08x\n", global_address);
     return false;
 }
 
-bool System::map_address(uint32_t global_address, Segment& segment_out,
-                         uint32_t& local_address_out) {
-    for (Segment& segment : memory_map) {
-        uint32_t prefix_mask = ~((1 << (32 - segment.prefix_length)) - 1);
-        if ((global_address & prefix_mask) == segment.addr_prefix) {
-            segment_out = segment;
-            local_address_out = global_address & ~prefix_mask;
-            return true;
-        }
+bool System::peek(uint32_t global_address, uint32_t& value_out, Port port) {
+    Range const* range = map_address(global_address, port);
+    if (range) {
+        return range->device->peek(global_address & range->local_mask, value_out);
     }
+
     return false;
 }
 
+System::Range const* System::map_address(uint32_t global_address, Port port) {
+    Range const* range = last_hit[port];
+    if (range == nullptr || global_address - range->first > range->span) {
+        range = find_range(global_address);
+        if (range != nullptr) {
+            last_hit[port] = range;
+        }
+    }
+    return range;
+}
+
+System::Range const* System::find_range(uint32_t global_address) const {
+    Page page = page_table[global_address >> PAGE_SHIFT];
+    Range const* first = ranges.data() + page.first;
+    Range const* last = first + page.count;
+
+    if (page.count > LINEAR_SEARCH_RANGES) {
+        // Ranges are sorted and disjoint, so only the last one starting at or before the address
+        // can contain it
+        first = std::upper_bound(first, last, global_address,
+                                 [](uint32_t address, Range const& range) {
+                                     return address < range.first;
+                                 });
+        if (first == ranges.data() + page.first) {
+            return nullptr;
+        }
+        first--;
+        last = first + 1;
+    }
+
+    for (Range const* range = first; range != last; range++) {
+        if (global_address - range->first <= range->span) {
+            return range;
+        }
+    }
+    return nullptr;
+}
+
+bool System::acquire_dmi(uint32_t global_address, Dmi& dmi) {
+    release_dmi(dmi);
+
+    Range const* range = find_range(global_address);
+    Device::Dmi device_dmi;
+    if (range == nullptr || !range->device->get_dmi(device_dmi) || !device_dmi.readable) {
+        return false;
+    }
+
+    // The range may only cover a part of the device (nested segments) or more than its memory
+    uint32_t local_first = range->first & range->local_mask;
+    uint64_t local_end =
+        std::min<uint64_t>(uint64_t{local_first} + range->span + 1, device_dmi.size);
+    if (local_first % 4 != 0 || local_first >= local_end) {
+        return false;
+    }
+
+    dmi = Dmi{
+        .data = device_dmi.data + local_first / 4,
+        .first = range->first,
+        .size = static_cast<uint32_t>(local_end - local_first) & ~3u,
+        .writable = device_dmi.writable,
+    };
+    dmi_handles.push_back(&dmi);
+    return true;
+}
+
+void System::release_dmi(Dmi& dmi) {
+    dmi_handles.erase(std::remove(dmi_handles.begin(), dmi_handles.end(), &dmi), dmi_handles.end());
+    dmi = Dmi{};
+}
+
+// Splits the address space at every segment boundary, assigns each piece to the longest prefix
+// covering it and indexes the resulting ranges by page
+void System::build_page_table() {
+    std::vector<uint64_t> bounds;
+    for (Segment const& segment : memory_map) {
+        bounds.push_back(segment.addr_prefix);
+        bounds.push_back(segment.addr_prefix + (uint64_t{1} << (32 - segment.prefix_length)));
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    ranges.clear();
+    Segment const* previous = nullptr;
+    for (size_t i = 0; i + 1 < bounds.size(); i++) {
+        uint32_t first = bounds[i];
+        Segment const* owner = nullptr;
+        for (Segment const& segment : memory_map) {
+            if ((first & segment_mask(segment.prefix_length)) == segment.addr_prefix &&
+                (owner == nullptr || segment.prefix_length > owner->prefix_length)) {
+                owner = &segment;
+            }
+        }
+
+        if (owner == nullptr) {
+            previous = nullptr;
+            continue;
+        }
+
+        uint32_t span = bounds[i + 1] - bounds[i] - 1;
+        if (owner == previous) {
+            ranges.back().span += span + 1;
+        } else {
+            ranges.push_back(Range{
+                .first = first,
+                .span = span,
+                .local_mask = ~segment_mask(owner->prefix_length),
+                .device = owner->device,
+                .slot = owner->slot,
+            });
+        }
+        previous = owner;
+    }
+
+    std::fill(page_table.begin(), page_table.end(), Page{0, 0});
+    for (size_t i = 0; i < ranges.size(); i++) {
+        uint32_t first_page = ranges[i].first >> PAGE_SHIFT;
+        uint32_t last_page = (ranges[i].first + ranges[i].span) >> PAGE_SHIFT;
+        for (uint32_t page = first_page; page <= last_page; page++) {
+            if (page_table[page].count == 0) {
+                page_table[page].first = i;
+            }
+            page_table[page].count++;
+        }
+    }
+
+    // Cached ranges and granted pointers may no longer match the map
+    std::fill(last_hit, last_hit + NUM_PORTS, nullptr);
+    for (Dmi* dmi : dmi_handles) {
+        *dmi = Dmi{};
+    }
+    dmi_handles.clear();
+}
+
 void System::tick_all() {
-    for (Segment segment : memory_map) {
-        segment.device->tick();
+    for (Device* device : ticked) {
+        device->tick();
+    }
+
+    if (++cycle >= next_event) {
+        run_events();
+    }
+}
+
+void System::advance(uint64_t cycles) {
+    if (!ticked.empty()) {
+        for (uint64_t i = 0; i < cycles; i++) {
+            tick_all();
+        }
+        return;
+    }
+
+    uint64_t target = cycle + cycles;
+    while (next_event <= target) {
+        cycle = next_event;
+        run_events();
+    }
+    cycle = target;
+}
+
+uint64_t System::quiet_cycles() {
+    uint64_t quiet = next_event - cycle - 1;
+    for (Device* device : ticked) {
+        quiet = std::min(quiet, device->quiet_cycles());
+    }
+    return quiet;
+}
+
+uint64_t const& System::get_cycle() const {
+    return cycle;
+}
+
+std::vector<Device*> const& System::get_devices() const {
+    return devices;
+}
+
+void System::restore_cycle(uint64_t restored_cycle) {
+    cycle = restored_cycle;
+    events = decltype(events)();
+    for (size_t slot = 0; slot < scheduled.size(); slot++) {
+        scheduled[slot].wakeup = Device::WAKEUP_NEVER;
+        reschedule(slot);
+    }
+    update_next_event();
+}
+
+// Queries the next wakeup of a device after it was accessed or woken up
+void System::reschedule(int slot) {
+    Scheduled& entry = scheduled[slot];
+    // Wakeups can only happen in the future
+    uint64_t wakeup = std::max(entry.device->next_wakeup(cycle), cycle + 1);
+    if (wakeup != entry.wakeup) {
+        entry.wakeup = wakeup;
+        if (wakeup != Device::WAKEUP_NEVER) {
+            events.push(Event{wakeup, slot});
+        }
+    }
+    update_next_event();
+}
+
+void System::update_next_event() {
+    while (!events.empty() && events.top().cycle != scheduled[events.top().slot].wakeup) {
+        events.pop();
+    }
+    next_event = events.empty() ? Device::WAKEUP_NEVER : events.top().cycle;
+}
+
+// Wakes up all devices due at the current cycle
+void System::run_events() {
+    while (!events.empty() && events.top().cycle <= cycle) {
+        Event event = events.top();
+        events.pop();
+        if (event.cycle != scheduled[event.slot].wakeup) {
+            continue;
+        }
+
+        scheduled[event.slot].wakeup = Device::WAKEUP_NEVER;
+        scheduled[event.slot].device->wakeup(cycle);
+        reschedule(event.slot);
     }
+    update_next_event();
 }
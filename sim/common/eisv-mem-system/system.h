@@ -2,6 +2,8 @@
 #define SYSTEM_H
 
 #include <cstdint>
+#include <functional>
+#include <queue>
 #include <vector>
 
 #include "device.h"
@@ -11,20 +13,132 @@ class System {
         int prefix_length;
         uint32_t addr_prefix;
         Device* device;
+        int slot;  // Index into scheduled for TIMING_WAKEUP devices, -1 otherwise
     };
 
+    // Contiguous address range [first, first + span] decoded to a single segment
+    struct Range {
+        uint32_t first;
+        uint32_t span;
+        uint32_t local_mask;
+        Device* device;
+        int slot;
+    };
+
+    struct Scheduled {
+        Device* device;
+        uint64_t wakeup;
+    };
+
+    // Entries whose cycle differs from the wakeup of their slot are stale and skipped
+    struct Event {
+        uint64_t cycle;
+        int slot;
+
+        bool operator>(Event const& other) const { return cycle > other.cycle; }
+    };
+
+    // Ranges overlapping a page are ranges[first, first + count)
+    struct Page {
+        uint16_t first;
+        uint16_t count;
+    };
+
+    static constexpr int PAGE_SHIFT = 20;
+    static constexpr uint32_t PAGES = 1u << (32 - PAGE_SHIFT);
+
    public:
-    void add_device(Device* device, int prefix_length, uint32_t addr_prefix);
+    // Every port keeps the range of its last access, so consecutive accesses to the same device
+    // do not go through the page table
+    enum Port { PORT_IMEM, PORT_DMEM, PORT_OTHER, NUM_PORTS };
+
+    // Direct access to the host memory behind a range of global addresses, granted by
+    // acquire_dmi. System clears the handle (size 0) when the memory map changes, after which all
+    // accesses fail and have to go through read/write again.
+    struct Dmi {
+        uint32_t* data = nullptr;
+        uint32_t first = 0;
+        uint32_t size = 0;  // In bytes
+        bool writable = false;
 
-    bool write(uint32_t global_address, uint32_t value, uint8_t byte_enable);
-    bool read(uint32_t global_address, uint32_t& value_out, uint8_t byte_enable);
+        bool read(uint32_t global_address, uint32_t& value_out) const {
+            uint32_t offset = global_address - first;
+            if (offset >= size) {
+                return false;
+            }
+            value_out = data[offset >> 2];
+            return true;
+        }
 
+        bool write(uint32_t global_address, uint32_t value, uint8_t byte_enable) const {
+            uint32_t offset = global_address - first;
+            if (offset >= size || !writable) {
+                return false;
+            }
+            uint32_t mask = Device::byte_enable_mask(byte_enable);
+            data[offset >> 2] = (data[offset >> 2] & ~mask) | (value & mask);
+            return true;
+        }
+    };
+
+    System();
+
+    // Fails if the segment has the same prefix as an existing one. Nested segments are allowed,
+    // the longest prefix wins independent of the order the devices are added in.
+    bool add_device(Device* device, int prefix_length, uint32_t addr_prefix);
+
+    bool write(uint32_t global_address, uint32_t value, uint8_t byte_enable,
+               Port port = PORT_DMEM);
+    bool read(uint32_t global_address, uint32_t& value_out, uint8_t byte_enable,
+              Port port = PORT_DMEM);
+    bool peek(uint32_t global_address, uint32_t& value_out, Port port = PORT_OTHER);
+
+    // Fills dmi with the largest directly accessible range around global_address. The handle has
+    // to stay alive until release_dmi or the destruction of the System.
+    bool acquire_dmi(uint32_t global_address, Dmi& dmi);
+    void release_dmi(Dmi& dmi);
+
+    // Advances all devices by one cycle. Only TIMING_TICK devices are called every cycle, if there
+    // are none and no wakeup is due this is a single comparison.
     void tick_all();
+    // Same as calling tick_all() cycles times, but skips directly from wakeup to wakeup if no
+    // device needs ticks
+    void advance(uint64_t cycles);
+    uint64_t quiet_cycles();
+
+    // Number of cycles advanced so far, for devices deriving their state from time
+    uint64_t const& get_cycle() const;
+
+    // Every device once, in the order they were first added
+    std::vector<Device*> const& get_devices() const;
+
+    // Continues at a restored cycle, after the devices got their state back. All pending wakeups
+    // are dropped and queried again.
+    void restore_cycle(uint64_t restored_cycle);
 
    private:
-    bool map_address(uint32_t global_address, Segment& segment_out, uint32_t& local_address_out);
+    Range const* map_address(uint32_t global_address, Port port);
+    Range const* find_range(uint32_t global_address) const;
+    void build_page_table();
+
+    void reschedule(int slot);
+    void update_next_event();
+    void run_events();
 
     std::vector<Segment> memory_map;
+    std::vector<Device*> devices;
+
+    std::vector<Range> ranges;
+    std::vector<Page> page_table;
+    Range const* last_hit[NUM_PORTS];
+
+    std::vector<Dmi*> dmi_handles;
+
+    uint64_t cycle = 0;
+    std::vector<Device*> ticked;
+    std::vector<Scheduled> scheduled;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    uint64_t next_event = Device::WAKEUP_NEVER;
 };
 
 #endif
@@ -0,0 +1,141 @@
+#include "testbench.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include "timer_device.h"
+#include "trace.h"
+
+Testbench::Testbench(TestbenchPaths const &paths) : paths(paths) {
+    ram = new Memory{RAM_WORDS};
+    // Makes the dump at the end of the simulation free, falls back to copying it out then
+    if (!ram->map_to_file(paths.dump)) {
+        printf("[TB] WARN Could not map RAM to %s\n", paths.dump);
+    }
+    rom = new Memory{ROM_WORDS};
+
+    stop_criterium = new bool(false);
+    stop_device = new StopSimulationDevice(*stop_criterium);
+
+    timer_interrupt_pending_flag = new bool(false);
+    TimerDevice *timer_device =
+        new TimerDevice(*timer_interrupt_pending_flag, 50, system.get_cycle());
+
+    uart_device = new UartDevice(paths.uart_out);
+
+    add_testbench_devices(system, ram, rom, stop_device, timer_device, uart_device);
+
+    uart_device->write_file_to_uart(paths.uart_in);
+
+    // ---------------------
+    // Start testbench (TB)
+    // ---------------------
+
+    // Memory Initialization, app/imem.elf takes precedence over the raw app/imem.bin image
+    char const *image_path = paths.image;
+    if (!image_path) {
+        image_path = is_elf_file("app/imem.elf") ? "app/imem.elf" : "app/imem.bin";
+    }
+    if (load_image(image_path)) {
+        printf("[TB] Initialized Memory with '%s' file\n", image_path);
+    } else {
+        printf("[TB] Could not open Memory init file '%s'\n", image_path);
+#ifndef MTI_SYSTEMC  // Questasim doesn't like exit during elaboration
+        exit(1);
+#endif
+    }
+}
+
+void Testbench::acquire_dmi() {
+    system.acquire_dmi(ROM_BASE, rom_dmi);
+    system.acquire_dmi(RAM_BASE, ram_dmi);
+}
+
+void Testbench::start_wave_capture(WaveCaptureOptions const &options) {
+    wave = std::make_unique<WaveCapture>(options, image);
+    stop_device->set_wave_trigger([this](uint32_t value) {
+        printf("[TB] Program triggered the wave capture with %08x\n", value);
+        wave->trigger(system.get_cycle(), "stop device");
+    });
+}
+
+bool Testbench::load_image(char const *path) {
+    if (!is_elf_file(path)) {
+        return rom->map_from_file(path);
+    }
+
+    if (!load_elf(path, system, image)) {
+        return false;
+    }
+
+    if (image.entry != ROM_BASE) {
+        printf("[TB] WARN Entry point %08x of %s is not the reset vector %08x\n", image.entry, path,
+               ROM_BASE);
+    }
+
+    // Programs written for riscv-tests style environments stop by writing to tohost
+    uint32_t tohost;
+    if (image.find_symbol("tohost", tohost) && system.add_device(stop_device, 30, tohost)) {
+        printf("[TB] Mapped stop device to tohost at %08x\n", tohost);
+    }
+    return true;
+}
+
+uint32_t Testbench::imem_read(uint32_t imem_byte_addr) {
+    uint32_t imem_read_value = 0;
+    if (rom_dmi.read(imem_byte_addr, imem_read_value) ||
+        system.read(imem_byte_addr, imem_read_value, 0b1111, System::PORT_IMEM)) {
+        TRACE(TRACE_ACCESS, TRACE_IMEM_READ, imem_byte_addr, imem_read_value, 0b1111);
+    } else {
+        TRACE(TRACE_WARN, TRACE_IMEM_READ_OOB, imem_byte_addr, 0, 0b1111);
+        if (wave) {
+            wave->trigger(system.get_cycle(), "out of bounds instruction fetch");
+        }
+    }
+    return imem_read_value;
+}
+
+uint32_t Testbench::dmem_read(uint32_t dmem_byte_addr) {
+    uint32_t dmem_read_value = 0;
+    if (ram_dmi.read(dmem_byte_addr, dmem_read_value) ||
+        rom_dmi.read(dmem_byte_addr, dmem_read_value) ||
+        system.read(dmem_byte_addr, dmem_read_value, 0b1111)) {
+        TRACE(TRACE_ACCESS, TRACE_DMEM_READ, dmem_byte_addr, dmem_read_value, 0b1111);
+    } else {
+        TRACE(TRACE_WARN, TRACE_DMEM_READ_OOB, dmem_byte_addr, 0, 0b1111);
+        if (wave) {
+            wave->trigger(system.get_cycle(), "out of bounds read");
+        }
+    }
+    return dmem_read_value;
+}
+
+void Testbench::dmem_write(uint32_t dmem_byte_addr, uint32_t dmem_write_value,
+                           uint8_t byte_enable) {
+    if (ram_dmi.write(dmem_byte_addr, dmem_write_value, byte_enable) ||
+        system.write(dmem_byte_addr, dmem_write_value, byte_enable)) {
+        TRACE(TRACE_ACCESS, TRACE_DMEM_WRITE, dmem_byte_addr, dmem_write_value, byte_enable);
+    } else {
+        TRACE(TRACE_WARN, TRACE_DMEM_WRITE_OOB, dmem_byte_addr, dmem_write_value, byte_enable);
+        if (wave) {
+            wave->trigger(system.get_cycle(), "out of bounds write");
+        }
+    }
+}
+
+void Testbench::print_results() {
+    uint32_t return_value = stop_device->get_return_value();
+    printf("[TB] Program finished with return value %d (%x)!\n", return_value, return_value);
+    printf("[TB] Simulated %" PRIu64 " cycles\n", system.get_cycle());
+    stop_device->print_performance();
+}
+
+void Testbench::dump_memory() {
+    printf("[TB] Dumping memory to %s...\n", paths.dump);
+    if (ram->write_to_file(paths.dump)) {
+        printf("[TB] Finished dumping memory to %s\n", paths.dump);
+    } else {
+        printf("[TB] Failed dumping memory to %s\n", paths.dump);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef TESTBENCH_H
+#define TESTBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "elf_loader.h"
+#include "memory.h"
+#include "memory_map.h"
+#include "stop_simulation_device.h"
+#include "system.h"
+#include "uart_device.h"
+#include "wave_capture.h"
+
+// Cycles the reset is held active by the transaction level loop and the Verilator driver
+constexpr uint64_t RESET_CYCLES = 2;
+
+// Files the testbench reads and writes, so that several simulations can run side by side
+struct TestbenchPaths {
+    char const *image = nullptr;  // app/imem.elf if it is an ELF file, app/imem.bin otherwise
+    char const *uart_in = "uart_in";
+    char const *uart_out = "uart_out";
+    char const *dump = "app/dump.bin";
+};
+
+// The simulated system (memories and devices) and the memory ports of the core, independent of
+// how the core is simulated: main.cc connects it to core_sim through SystemC, sim/verilator to a
+// Verilator model.
+struct Testbench {
+    bool *stop_criterium;
+    bool *timer_interrupt_pending_flag;
+
+    Memory *rom;
+    Memory *ram;
+
+    UartDevice *uart_device;
+    StopSimulationDevice *stop_device;
+
+    System system;
+    ElfImage image;
+
+    // Direct access to ROM and RAM, bypassing the address decode of system
+    System::Dmi rom_dmi;
+    System::Dmi ram_dmi;
+
+    TestbenchPaths paths;
+
+    // Only set if enabled, out of bounds accesses trigger it like the stop device
+    std::unique_ptr<WaveCapture> wave;
+
+    // Sets up the devices and loads the image, exits if that fails (except in QuestaSim)
+    Testbench(TestbenchPaths const &paths);
+
+    // Only after loading the image (or restoring a checkpoint), which may change the memory map
+    void acquire_dmi();
+
+    // Only after loading the image, which may define the trigger PC
+    void start_wave_capture(WaveCaptureOptions const &options);
+
+    // ELF images are placed according to their program headers, raw images (objcopy -O binary)
+    // are mapped copy-on-write into the ROM
+    bool load_image(char const *path);
+
+    uint32_t imem_read(uint32_t imem_byte_addr);
+    uint32_t dmem_read(uint32_t dmem_byte_addr);
+    void dmem_write(uint32_t dmem_byte_addr, uint32_t dmem_write_value, uint8_t byte_enable);
+
+    // Return value, simulated cycles and performance counters of the finished program
+    void print_results();
+    void dump_memory();
+};
+
+#endif
@@ -1,35 +1,80 @@
 #include "timer_device.h"
 
 #include <cstdio>
+#include <cstring>
 
-TimerDevice::TimerDevice(bool &timer_interrupt_pending, uint32_t ticks_per_mtime_tick)
+// Everything but the deadline, which follows from the rest
+struct TimerState {
+    uint64_t mtime_base;
+    uint64_t base_cycle;
+    uint64_t base_ticks;
+    uint64_t mtimecmp;
+    uint64_t timer_interrupt_pending;
+};
+
+TimerDevice::TimerDevice(bool &timer_interrupt_pending, uint32_t ticks_per_mtime_tick,
+                         uint64_t const &cycle)
     : timer_interrupt_pending(timer_interrupt_pending),
-      ticks_per_mtime_tick(ticks_per_mtime_tick) {}
+      ticks_per_mtime_tick(ticks_per_mtime_tick),
+      cycle(cycle) {
+    base_cycle = cycle;
+    update_deadline();
+}
+
+uint64_t TimerDevice::mtime_at(uint64_t cycle) const {
+    return mtime_base + (base_ticks + (cycle - base_cycle)) / ticks_per_mtime_tick;
+}
+
+// Keeps the progress towards the next increment, like the prescaler of a real timer
+void TimerDevice::set_mtime(uint64_t value) {
+    base_ticks = (base_ticks + (cycle - base_cycle)) % ticks_per_mtime_tick;
+    base_cycle = cycle;
+    mtime_base = value;
+}
+
+// First cycle at which mtime >= mtimecmp holds, only changes when either of them is written
+void TimerDevice::update_deadline() {
+    if (mtimecmp <= mtime_base) {
+        deadline = base_cycle;
+        return;
+    }
+
+    uint64_t increments = mtimecmp - mtime_base;
+    if (increments > (WAKEUP_NEVER - base_cycle) / ticks_per_mtime_tick) {
+        deadline = WAKEUP_NEVER;
+        return;
+    }
+    deadline = base_cycle + increments * ticks_per_mtime_tick - base_ticks;
+}
 
 bool TimerDevice::write(uint32_t local_address, uint32_t value, uint8_t byte_enable) {
     size_t word_addr = local_address >> 2;
+    uint64_t mtime = mtime_at(cycle);
 
     switch (word_addr) {
         case 0:
-            mtime = (mtime & 0x00000000ffffffff) | value;
+            set_mtime((mtime & 0xffffffff00000000) | value);
             break;
         case 1:
-            mtime = (mtime & 0xffffffff00000000) | ((uint64_t)value << 32);
+            set_mtime((mtime & 0x00000000ffffffff) | ((uint64_t)value << 32));
+            break;
         case 2:
-            mtimecmp = (mtimecmp & 0x00000000ffffffff) | value;
+            mtimecmp = (mtimecmp & 0xffffffff00000000) | value;
             break;
         case 3:
-            mtimecmp = (mtimecmp & 0xffffffff00000000) | ((uint64_t)value << 32);
+            mtimecmp = (mtimecmp & 0x00000000ffffffff) | ((uint64_t)value << 32);
             break;
         default:
             return false;
     }
 
+    update_deadline();
     return true;
 }
 
 bool TimerDevice::read(uint32_t local_address, uint32_t &value_out, uint8_t byte_enable) {
     size_t word_addr = local_address >> 2;
+    uint64_t mtime = mtime_at(cycle);
 
     switch (word_addr) {
         case 0:
@@ -51,12 +96,48 @@ bool TimerDevice::read(uint32_t local_address, uint32_t &value_out, uint8_t byte
     return true;
 }
 
-void TimerDevice::tick() {
-    ticks++;
-    if (ticks >= ticks_per_mtime_tick) {
-        mtime++;
-        ticks = 0;
+Device::Timing TimerDevice::timing() {
+    return TIMING_WAKEUP;
+}
+
+// The interrupt line follows mtime >= mtimecmp one cycle after a change of either
+uint64_t TimerDevice::next_wakeup(uint64_t cycle) {
+    bool pending = cycle + 1 >= deadline;
+    if (pending != timer_interrupt_pending) {
+        return cycle + 1;
     }
+    // Once set the line stays set until mtime or mtimecmp is written
+    return pending ? WAKEUP_NEVER : deadline;
+}
+
+void TimerDevice::wakeup(uint64_t cycle) {
+    timer_interrupt_pending = cycle >= deadline;
+}
 
-    timer_interrupt_pending = mtime >= mtimecmp;
+void TimerDevice::save_state(std::vector<uint8_t> &state_out) {
+    TimerState state = {
+        .mtime_base = mtime_base,
+        .base_cycle = base_cycle,
+        .base_ticks = base_ticks,
+        .mtimecmp = mtimecmp,
+        .timer_interrupt_pending = timer_interrupt_pending,
+    };
+    state_out.resize(sizeof(state));
+    std::memcpy(state_out.data(), &state, sizeof(state));
+}
+
+bool TimerDevice::restore_state(std::vector<uint8_t> const &state) {
+    TimerState restored;
+    if (state.size() != sizeof(restored)) {
+        return false;
+    }
+    std::memcpy(&restored, state.data(), sizeof(restored));
+
+    mtime_base = restored.mtime_base;
+    base_cycle = restored.base_cycle;
+    base_ticks = restored.base_ticks;
+    mtimecmp = restored.mtimecmp;
+    timer_interrupt_pending = restored.timer_interrupt_pending;
+    update_deadline();
+    return true;
 }
@@ -3,21 +3,40 @@
 
 #include "device.h"
 
+// mtime is derived from the cycle counter of the System, so the device only has to be woken up
+// when the interrupt line changes
 class TimerDevice : public Device {
    public:
-    TimerDevice(bool& timer_interrupt_pending, uint32_t ticks_per_mtime_tick);
+    TimerDevice(bool& timer_interrupt_pending, uint32_t ticks_per_mtime_tick,
+                uint64_t const& cycle);
 
     virtual bool write(uint32_t local_address, uint32_t value, uint8_t byte_enable) override;
     virtual bool read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) override;
-    virtual void tick() override;
+    virtual Timing timing() override;
+    virtual uint64_t next_wakeup(uint64_t cycle) override;
+    virtual void wakeup(uint64_t cycle) override;
+    virtual void save_state(std::vector<uint8_t>& state_out) override;
+    virtual bool restore_state(std::vector<uint8_t> const& state) override;
 
    private:
-    uint64_t mtime;
-    uint64_t mtimecmp;
+    uint64_t mtime_at(uint64_t cycle) const;
+    void set_mtime(uint64_t value);
+    void update_deadline();
+
+    // mtime was mtime_base at base_cycle, with base_ticks of the next increment already elapsed
+    uint64_t mtime_base = 0;
+    uint64_t base_cycle = 0;
+    uint64_t base_ticks = 0;
+
+    // The interrupt is pending from reset until software programs the comparator: crt0.S only
+    // sets mtime to 25, its trap handler then moves mtimecmp 1000 ticks past mtime on every timer
+    // interrupt, starting with the one taken as soon as interrupts are enabled
+    uint64_t mtimecmp = 0;
+    uint64_t deadline = WAKEUP_NEVER;
     bool& timer_interrupt_pending;
 
     uint32_t ticks_per_mtime_tick;
-    uint32_t ticks;
+    uint64_t const& cycle;
 };
 
 #endif
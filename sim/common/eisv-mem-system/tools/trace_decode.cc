@@ -0,0 +1,43 @@
+// Renders a binary trace written by eisv-mem-system --trace-file=<path> as the text the testbench
+// prints without a trace file.
+
+#include <cstdio>
+#include <cstring>
+
+#include "trace.h"
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        printf("Usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    std::FILE* in_file = std::fopen(argv[1], "rb");
+    if (!in_file) {
+        printf("Could not open trace file %s\n", argv[1]);
+        return 1;
+    }
+
+    Trace::FileHeader header;
+    if (fread(&header, sizeof(header), 1, in_file) != 1 ||
+        memcmp(header.magic, Trace::MAGIC, sizeof(Trace::MAGIC)) != 0) {
+        printf("%s is not a trace file\n", argv[1]);
+        return 1;
+    }
+    if (header.version != Trace::VERSION || header.record_size != sizeof(Trace::Record)) {
+        printf("Unsupported trace version %u (record size %u)\n", header.version,
+               header.record_size);
+        return 1;
+    }
+
+    Trace::Record records[4096];
+    size_t count;
+    while ((count = fread(records, sizeof(Trace::Record), 4096, in_file)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            Trace::print(stdout, records[i]);
+        }
+    }
+
+    std::fclose(in_file);
+    return 0;
+}
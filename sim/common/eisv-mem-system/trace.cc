@@ -0,0 +1,130 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// Time the writer thread sleeps if the ring is empty
+constexpr auto WRITER_IDLE = std::chrono::milliseconds(1);
+
+TraceLevel Trace::level = TRACE_WARN;
+
+bool Trace::binary = false;
+std::FILE* Trace::file = nullptr;
+std::vector<Trace::Record> Trace::ring;
+std::atomic<uint64_t> Trace::head{0};
+std::atomic<uint64_t> Trace::tail{0};
+std::atomic<bool> Trace::closing{false};
+std::thread Trace::writer;
+
+bool Trace::open_binary(char const* path) {
+    file = std::fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    FileHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.record_size = sizeof(Record);
+    fwrite(&header, sizeof(header), 1, file);
+
+    ring.resize(RING_RECORDS);
+    binary = true;
+    writer = std::thread(write_loop);
+
+    // Also flush the trace if the simulation ends through exit()
+    std::atexit(close);
+    return true;
+}
+
+void Trace::close() {
+    if (!binary) {
+        return;
+    }
+
+    closing.store(true, std::memory_order_release);
+    writer.join();
+    std::fclose(file);
+    file = nullptr;
+    binary = false;
+}
+
+void Trace::push(Record const& record) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    while (h - tail.load(std::memory_order_acquire) >= RING_RECORDS) {
+        std::this_thread::yield();
+    }
+    ring[h % RING_RECORDS] = record;
+    head.store(h + 1, std::memory_order_release);
+}
+
+void Trace::write_loop() {
+    while (true) {
+        bool last = closing.load(std::memory_order_acquire);
+        if (drain() == 0) {
+            if (last) {
+                break;
+            }
+            std::this_thread::sleep_for(WRITER_IDLE);
+        }
+    }
+    std::fflush(file);
+}
+
+// Writes all records available in the ring, returns their number
+size_t Trace::drain() {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    uint64_t count = h - t;
+
+    while (t != h) {
+        size_t offset = t % RING_RECORDS;
+        size_t chunk = std::min<uint64_t>(h - t, RING_RECORDS - offset);
+        fwrite(&ring[offset], sizeof(Record), chunk, file);
+        t += chunk;
+        tail.store(t, std::memory_order_release);
+    }
+    return count;
+}
+
+void Trace::print(std::FILE* out, Record const& record) {
+    switch (record.event) {
+        case TRACE_IMEM_READ:
+            fprintf(out, "[TB] Reading IMEM[%08x] => %08x\n", record.address, record.value);
+            break;
+        case TRACE_DMEM_READ:
+            fprintf(out, "[TB] Reading DMEM[%08x] => %08x\n", record.address, record.value);
+            break;
+        case TRACE_DMEM_WRITE:
+            fprintf(out, "[TB] Writing DMEM[%08x] <= %08x, %02x\n", record.address, record.value,
+                    record.byte_enable);
+            break;
+        case TRACE_IMEM_READ_OOB:
+            fprintf(out, "[TB] WARN IMEM read at %08x is OOB\n", record.address);
+            break;
+        case TRACE_DMEM_READ_OOB:
+            fprintf(out, "[TB] WARN DMEM read at %08x is OOB\n", record.address);
+            break;
+        case TRACE_DMEM_WRITE_OOB:
+            fprintf(out, "[TB] WARN DMEM write at %08x is OOB\n", record.address);
+            break;
+        default:
+            fprintf(out, "[TB] Unknown trace event %d\n", record.event);
+            break;
+    }
+}
+
+bool Trace::parse_level(char const* name, TraceLevel& level_out) {
+    if (strcmp(name, "none") == 0) {
+        level_out = TRACE_NONE;
+    } else if (strcmp(name, "warn") == 0) {
+        level_out = TRACE_WARN;
+    } else if (strcmp(name, "access") == 0) {
+        level_out = TRACE_ACCESS;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Tracing of the memory accesses of the testbench.
+//
+// Events above TRACE_MAX_LEVEL are removed at compile time (e.g. -DTRACE_MAX_LEVEL=0 for no
+// tracing at all), the remaining ones are filtered by Trace::level at run time. Events are either
+// printed as text right away or appended to a binary trace file by a background thread, which can
+// be converted to the same text with the trace_decode tool.
+
+enum TraceLevel { TRACE_NONE = 0, TRACE_WARN = 1, TRACE_ACCESS = 2 };
+
+#ifndef TRACE_MAX_LEVEL
+#define TRACE_MAX_LEVEL TRACE_ACCESS
+#endif
+
+enum TraceEvent : uint8_t {
+    TRACE_IMEM_READ,
+    TRACE_DMEM_READ,
+    TRACE_DMEM_WRITE,
+    TRACE_IMEM_READ_OOB,
+    TRACE_DMEM_READ_OOB,
+    TRACE_DMEM_WRITE_OOB,
+};
+
+#define TRACE(trace_level, event, address, value, byte_enable)            \
+    do {                                                                  \
+        if constexpr ((trace_level) <= TRACE_MAX_LEVEL) {                 \
+            if ((trace_level) <= Trace::level) {                          \
+                Trace::record((event), (address), (value), (byte_enable)); \
+            }                                                             \
+        }                                                                 \
+    } while (0)
+
+class Trace {
+   public:
+    // Binary trace file layout: FileHeader followed by Records
+    static constexpr char MAGIC[8] = {'E', 'I', 'S', 'V', 'T', 'R', 'C', '\0'};
+    static constexpr uint32_t VERSION = 1;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+    };
+
+    struct Record {
+        uint8_t event;
+        uint8_t byte_enable;
+        uint16_t reserved;
+        uint32_t address;
+        uint32_t value;
+    };
+
+    static TraceLevel level;
+
+    // Without open_binary, events are printed to stdout
+    static bool open_binary(char const* path);
+    static void close();
+
+    static void record(TraceEvent event, uint32_t address, uint32_t value, uint8_t byte_enable) {
+        Record record{event, byte_enable, 0, address, value};
+        if (binary) {
+            push(record);
+        } else {
+            print(stdout, record);
+        }
+    }
+
+    static void print(std::FILE* out, Record const& record);
+
+    static bool parse_level(char const* name, TraceLevel& level_out);
+
+   private:
+    // Single producer (simulation) single consumer (writer thread) ring
+    static constexpr size_t RING_RECORDS = 1 << 16;
+
+    static void push(Record const& record);
+    static void write_loop();
+    static size_t drain();
+
+    static bool binary;
+    static std::FILE* file;
+    static std::vector<Record> ring;
+    static std::atomic<uint64_t> head;
+    static std::atomic<uint64_t> tail;
+    static std::atomic<bool> closing;
+    static std::thread writer;
+};
+
+#endif
@@ -78,7 +78,32 @@ bool UartDevice::read(uint32_t local_address, uint32_t& value_out, uint8_t byte_
     return true;
 }
 
-void UartDevice::tick() {}
+Device::Timing UartDevice::timing() {
+    return TIMING_NONE;
+}
+
+// Control bits followed by the pending receive data
+void UartDevice::save_state(std::vector<uint8_t>& state_out) {
+    state_out.clear();
+    state_out.push_back((control_rx_en << CONTROL_RX_EN) | (control_tx_en << CONTROL_TX_EN));
+    for (std::queue<uint8_t> pending = write_data; !pending.empty(); pending.pop()) {
+        state_out.push_back(pending.front());
+    }
+}
+
+bool UartDevice::restore_state(std::vector<uint8_t> const& state) {
+    if (state.empty()) {
+        return false;
+    }
+
+    control_rx_en = (state[0] >> CONTROL_RX_EN) & 0x01;
+    control_tx_en = (state[0] >> CONTROL_TX_EN) & 0x01;
+    write_data = std::queue<uint8_t>();
+    for (size_t i = 1; i < state.size(); i++) {
+        write_data.push(state[i]);
+    }
+    return true;
+}
 
 void UartDevice::write_char_to_uart(uint8_t c) {
     write_data.push(c);
@@ -13,7 +13,9 @@ class UartDevice : public Device {
 
     virtual bool write(uint32_t local_address, uint32_t value, uint8_t byte_enable) override;
     virtual bool read(uint32_t local_address, uint32_t& value_out, uint8_t byte_enable) override;
-    virtual void tick() override;
+    virtual Timing timing() override;
+    virtual void save_state(std::vector<uint8_t>& state_out) override;
+    virtual bool restore_state(std::vector<uint8_t> const& state) override;
 
     void write_char_to_uart(uint8_t c);
     void write_string_to_uart(char const* str);
@@ -22,10 +24,10 @@ class UartDevice : public Device {
    private:
     std::queue<uint8_t> write_data;
 
-    std::FILE* out_file;
+    std::FILE* out_file = nullptr;
 
-    bool control_rx_en;
-    bool control_tx_en;
+    bool control_rx_en = false;
+    bool control_tx_en = false;
 };
 
 #endif
@@ -0,0 +1,189 @@
+#include "wave_capture.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Same clock as the SystemC testbench
+constexpr uint64_t CYCLE_NS = 10;
+
+struct WaveSignal {
+    char const* name;
+    int width;
+    uint32_t (*value)(WaveCapture::Sample const& sample);
+};
+
+// VCD identifiers are '"' + index, '!' is the clock
+static WaveSignal const SIGNALS[] = {
+    {"rst_n", 1, [](WaveCapture::Sample const& s) -> uint32_t { return s.rst_n; }},
+    {"imem_addr", 32, [](WaveCapture::Sample const& s) -> uint32_t { return s.imem_addr; }},
+    {"imem_ren", 1, [](WaveCapture::Sample const& s) -> uint32_t { return s.imem_ren; }},
+    {"imem_rdata", 32, [](WaveCapture::Sample const& s) -> uint32_t { return s.imem_rdata; }},
+    {"dmem_addr", 32, [](WaveCapture::Sample const& s) -> uint32_t { return s.dmem_addr; }},
+    {"dmem_ren", 1, [](WaveCapture::Sample const& s) -> uint32_t { return s.dmem_ren; }},
+    {"dmem_rdata", 32, [](WaveCapture::Sample const& s) -> uint32_t { return s.dmem_rdata; }},
+    {"dmem_wen", 1, [](WaveCapture::Sample const& s) -> uint32_t { return s.dmem_wen; }},
+    {"dmem_wdata", 32, [](WaveCapture::Sample const& s) -> uint32_t { return s.dmem_wdata; }},
+    {"dmem_byte_enable", 4,
+     [](WaveCapture::Sample const& s) -> uint32_t { return s.dmem_byte_enable; }},
+    {"external_interrupt_pending", 1,
+     [](WaveCapture::Sample const& s) -> uint32_t { return s.external_interrupt_pending; }},
+    {"timer_interrupt_pending", 1,
+     [](WaveCapture::Sample const& s) -> uint32_t { return s.timer_interrupt_pending; }},
+};
+constexpr size_t NUM_SIGNALS = sizeof(SIGNALS) / sizeof(SIGNALS[0]);
+
+static bool ends_with(std::string const& text, char const* suffix) {
+    std::string end(suffix);
+    return text.size() >= end.size() &&
+           text.compare(text.size() - end.size(), end.size(), end) == 0;
+}
+
+static void write_value(FILE* file, WaveSignal const& signal, uint32_t value, char id) {
+    if (signal.width == 1) {
+        fprintf(file, "%u%c\n", value, id);
+        return;
+    }
+    char bits[33];
+    int length = 0;
+    for (int bit = signal.width - 1; bit >= 0; bit--) {
+        if (length > 0 || (value >> bit) & 1 || bit == 0) {
+            bits[length++] = '0' + ((value >> bit) & 1);
+        }
+    }
+    bits[length] = '\0';
+    fprintf(file, "b%s %c\n", bits, id);
+}
+
+static void write_vcd(FILE* file, std::vector<WaveCapture::Sample> const& samples) {
+    fprintf(file, "$version EIS-V testbench wave capture $end\n");
+    fprintf(file, "$timescale 1ns $end\n");
+    fprintf(file, "$scope module eisv $end\n");
+    fprintf(file, "$var wire 1 ! clk $end\n");
+    for (size_t i = 0; i < NUM_SIGNALS; i++) {
+        fprintf(file, "$var wire %d %c %s $end\n", SIGNALS[i].width, '"' + static_cast<int>(i),
+                SIGNALS[i].name);
+    }
+    fprintf(file, "$upscope $end\n$enddefinitions $end\n");
+
+    uint32_t last[NUM_SIGNALS];
+    for (size_t s = 0; s < samples.size(); s++) {
+        fprintf(file, "#%" PRIu64 "\n1!\n", samples[s].cycle * CYCLE_NS);
+        for (size_t i = 0; i < NUM_SIGNALS; i++) {
+            uint32_t value = SIGNALS[i].value(samples[s]);
+            if (s == 0 || value != last[i]) {
+                write_value(file, SIGNALS[i], value, '"' + i);
+                last[i] = value;
+            }
+        }
+        fprintf(file, "#%" PRIu64 "\n0!\n", samples[s].cycle * CYCLE_NS + CYCLE_NS / 2);
+    }
+}
+
+bool parse_wave_window(char const* text, WaveCaptureOptions& options) {
+    char* end;
+    options.window_start = strtoull(text, &end, 0);
+    if (*end != ':') {
+        return false;
+    }
+    options.window_end = strtoull(end + 1, &end, 0);
+    return *end == '\0' && options.window_end > options.window_start;
+}
+
+WaveCapture::WaveCapture(WaveCaptureOptions const& options, ElfImage const& image)
+    : options(options), ring(options.pre) {
+    if (options.pc) {
+        char* end;
+        trigger_pc = strtoull(options.pc, &end, 0);
+        uint32_t symbol;
+        if (*end != '\0' && image.find_symbol(options.pc, symbol)) {
+            trigger_pc = symbol;
+        } else if (*end != '\0') {
+            printf("[TB] WARN Unknown symbol %s, the wave capture does not trigger on a PC\n",
+                   options.pc);
+            trigger_pc = NO_PC;
+        }
+    }
+}
+
+void WaveCapture::trigger(uint64_t cycle, char const* reason, uint64_t end_cycle) {
+    if (triggered || written) {
+        return;
+    }
+    triggered = true;
+    this->end_cycle = end_cycle > 0 ? end_cycle : cycle + options.post;
+    printf("[TB] Wave capture triggered by %s at cycle %" PRIu64 "\n", reason, cycle);
+
+    window.reserve(ring.size() + options.post + 1);
+    if (ring_full) {
+        window.insert(window.end(), ring.begin() + ring_next, ring.end());
+    }
+    window.insert(window.end(), ring.begin(), ring.begin() + ring_next);
+    ring = {};
+}
+
+void WaveCapture::record(Sample const& sample) {
+    if (triggered) {
+        window.push_back(sample);
+        if (sample.cycle >= end_cycle) {
+            write();
+        }
+        return;
+    }
+
+    if (ring.empty()) {
+        return;
+    }
+    ring[ring_next] = sample;
+    ring_next++;
+    if (ring_next == ring.size()) {
+        ring_next = 0;
+        ring_full = true;
+    }
+}
+
+void WaveCapture::finish() {
+    if (written) {
+        return;
+    }
+    if (!triggered) {
+        printf("[TB] Wave capture was not triggered, nothing written to %s\n", options.path);
+        return;
+    }
+    write();
+}
+
+bool WaveCapture::write() {
+    written = true;
+    if (window.empty()) {
+        return false;
+    }
+
+    // gzip and vcd2fst (GTKWave) are run as separate programs instead of linking their libraries
+    std::string path = options.path;
+    bool gzip = ends_with(path, ".gz");
+    bool fst = ends_with(path, ".fst");
+    std::string vcd_path = fst ? path + ".vcd" : path;
+    FILE* file = gzip ? popen(("gzip -c > '" + path + "'").c_str(), "w")
+                      : fopen(vcd_path.c_str(), "w");
+    if (!file) {
+        printf("[TB] ERROR Could not open wave capture %s\n", path.c_str());
+        return false;
+    }
+    write_vcd(file, window);
+    int status = gzip ? pclose(file) : fclose(file);
+    if (fst && status == 0) {
+        status = std::system(("vcd2fst '" + vcd_path + "' '" + path + "' > /dev/null").c_str());
+        remove(vcd_path.c_str());
+    }
+    if (status != 0) {
+        printf("[TB] ERROR Writing wave capture %s failed\n", path.c_str());
+        return false;
+    }
+
+    printf("[TB] Wrote wave capture of cycles %" PRIu64 " to %" PRIu64 " to %s\n",
+           window.front().cycle, window.back().cycle, path.c_str());
+    window = {};
+    return true;
+}
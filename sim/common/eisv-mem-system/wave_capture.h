@@ -0,0 +1,90 @@
+#ifndef WAVE_CAPTURE_H
+#define WAVE_CAPTURE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "elf_loader.h"
+
+struct WaveCaptureOptions {
+    char const* path = nullptr;  // .vcd, .vcd.gz (through gzip) or .fst (through vcd2fst)
+    char const* pc = nullptr;    // Address or ELF symbol whose fetch triggers the capture
+    uint64_t window_start = 0;   // Cycle window that triggers the capture, if window_end > 0
+    uint64_t window_end = 0;
+    uint32_t pre = 1000;   // Cycles kept before the trigger
+    uint32_t post = 1000;  // Cycles captured after the trigger
+};
+
+// Parses "<first cycle>:<last cycle>" into the window of options
+bool parse_wave_window(char const* text, WaveCaptureOptions& options);
+
+// Waveform of the signals between core and testbench around a trigger, instead of a wave of the
+// whole run. The last pre cycles are kept in a ring buffer, once triggered the following post
+// cycles are added and the window is written as VCD. Triggers are a fetch from the configured
+// PC, the start of the configured cycle window and trigger() (out of bounds accesses and writes
+// to StopSimulationDevice::WAVE_TRIGGER), only the first one counts.
+class WaveCapture {
+   public:
+    // The signals as the testbench sees them at the rising edge of a cycle: the outputs of the
+    // core from the previous cycle and the inputs the testbench answers with
+    struct Sample {
+        uint64_t cycle;
+        uint32_t imem_addr;
+        uint32_t imem_rdata;
+        uint32_t dmem_addr;
+        uint32_t dmem_rdata;
+        uint32_t dmem_wdata;
+        uint8_t dmem_byte_enable;
+        bool rst_n;
+        bool imem_ren;
+        bool dmem_ren;
+        bool dmem_wen;
+        bool external_interrupt_pending;
+        bool timer_interrupt_pending;
+    };
+
+    // Resolves the PC trigger in the symbols of image
+    WaveCapture(WaveCaptureOptions const& options, ElfImage const& image);
+
+    // Called every cycle of the pin level loop
+    void sample(Sample const& sample) {
+        if (written) {
+            return;
+        }
+        if (!triggered) {
+            if (sample.imem_ren && sample.imem_addr == trigger_pc) {
+                trigger(sample.cycle, "PC");
+            } else if (options.window_end > 0 && sample.cycle == options.window_start) {
+                trigger(sample.cycle, "cycle window", options.window_end);
+            }
+        }
+        record(sample);
+    }
+
+    // Triggers at cycle, the capture then ends post cycles later or at end_cycle if given
+    void trigger(uint64_t cycle, char const* reason, uint64_t end_cycle = 0);
+
+    // Writes a window cut short by the end of the simulation
+    void finish();
+
+   private:
+    static constexpr uint64_t NO_PC = UINT64_MAX;
+
+    void record(Sample const& sample);
+    bool write();
+
+    WaveCaptureOptions options;
+    uint64_t trigger_pc = NO_PC;
+
+    // Samples before the trigger, ring_next is the oldest once the ring is full
+    std::vector<Sample> ring;
+    size_t ring_next = 0;
+    bool ring_full = false;
+
+    bool triggered = false;
+    bool written = false;
+    uint64_t end_cycle = 0;
+    std::vector<Sample> window;
+};
+
+#endif
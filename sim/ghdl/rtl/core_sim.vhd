@@ -16,7 +16,16 @@ library eisv;
 entity core_sim is
     generic (
         VHSOCK_NAME : c_string_t;
-        HART_ID : integer := 0
+        HART_ID : integer := 0;
+        -- Serve memory accesses from a local mirror and only synchronize with SystemC for device
+        -- accesses and interrupt line changes instead of exchanging all signals every cycle
+        TRANSACTION_LEVEL : boolean := false;
+        -- Maximum number of cycles exchanged per message, cycles beyond the first one are only
+        -- used if the core behaves as predicted by the SystemC side (see sim_wrapper.hh)
+        QUANTUM : positive := 1;
+        -- Report every retired instruction and trap to SystemC for lockstep checking (transaction
+        -- level only), which enlarges the messages to batch the reports
+        LOCKSTEP : boolean := false
     );
 end entity;
 
@@ -37,6 +46,34 @@ architecture rtl of core_sim is
     signal external_interrupt_pending : std_ulogic;
     signal timer_interrupt_pending : std_ulogic;
 
+    -- Architectural state port, only used by the transaction level bridge
+    signal state_halt : std_ulogic := '0';
+    signal state_halted : std_ulogic;
+    signal state_sel : std_ulogic_vector(5 downto 0) := (others => '0');
+    signal state_wen : std_ulogic := '0';
+    signal state_wdata : std_ulogic_vector(31 downto 0) := (others => '0');
+    signal state_rdata : std_ulogic_vector(31 downto 0);
+
+    -- Retire port, only used in lockstep mode
+    signal retire_valid : std_ulogic;
+    signal retire_trap : std_ulogic;
+    signal retire_trap_return : std_ulogic;
+    signal retire_pc : std_ulogic_vector(31 downto 0);
+    signal retire_rd : std_ulogic_vector(4 downto 0);
+    signal retire_rd_value : std_ulogic_vector(31 downto 0);
+    signal retire_store_addr : std_ulogic_vector(31 downto 0);
+    signal retire_store_data : std_ulogic_vector(31 downto 0);
+    signal retire_store_byte_enable : std_ulogic_vector(3 downto 0);
+
+    -- Message size of the transaction level bridge in words
+    function tl_words(lockstep : boolean) return natural is
+    begin
+        if lockstep then
+            return 128;
+        end if;
+        return 16;
+    end function;
+
 begin
 
     core_wrapper_inst : entity eisv.eisv_core_wrapper
@@ -56,7 +93,22 @@ begin
             dmem_wdata_o => dmem_wdata,
             dmem_byte_enable_o => dmem_byte_enable,
             external_interrupt_pending_i => external_interrupt_pending,
-            timer_interrupt_pending_i => timer_interrupt_pending
+            timer_interrupt_pending_i => timer_interrupt_pending,
+            state_halt_i => state_halt,
+            state_halted_o => state_halted,
+            state_sel_i => state_sel,
+            state_wen_i => state_wen,
+            state_wdata_i => state_wdata,
+            state_rdata_o => state_rdata,
+            retire_valid_o => retire_valid,
+            retire_trap_o => retire_trap,
+            retire_trap_return_o => retire_trap_return,
+            retire_pc_o => retire_pc,
+            retire_rd_o => retire_rd,
+            retire_rd_value_o => retire_rd_value,
+            retire_store_addr_o => retire_store_addr,
+            retire_store_data_o => retire_store_data,
+            retire_store_byte_enable_o => retire_store_byte_enable
         );
 
     clock : process is
@@ -67,78 +119,581 @@ begin
         wait for 5 ns;
     end process;
 
-    vhsock : process is
-        variable sock : vhsock_handle_ptr_t;
+    pin_level_gen : if not TRANSACTION_LEVEL and QUANTUM = 1 generate
+        vhsock : process is
+            variable sock : vhsock_handle_ptr_t;
 
-        variable ob_idx : integer;
-        variable ib_idx : integer;
+            variable i : integer := 0;
 
-        variable i : integer := 0;
-    begin
-        sock := vhsock_create;
-
-        sock.name(VHSOCK_NAME'left to VHSOCK_NAME'right) := VHSOCK_NAME;
-        sock.name(VHSOCK_NAME'right+1 to 31) := (others => nul);
-
-        -- Memory layout for input and output buffers:
-        -- Input: rst_n | imem_rdata | dmem_rdata | external_interrupt_pending | timer_interrupt_pending
-        -- Input Length: 1 + 32 + 32 + 1 + 1 = 67
-        -- Output: imem_addr | imem_ren | dmem_addr |
-        --         dmem_ren | dmem_wen | dmem_wdata
-        --         dmem_byte_enable
-        -- Output Length: 32 + 1 + 32 + 1 + 1 + 32 + 4 = 103
-        sock.in_buffer_size := 67;
-        sock.in_buffer := new std_ulogic_vector(sock.in_buffer_size - 1 downto 0);
-        sock.out_buffer_size := 103;
-        sock.out_buffer := new std_ulogic_vector(sock.out_buffer_size - 1 downto 0);
-        vhsock_init(sock.all);
-
-        while true loop
-            wait until rising_edge(clk);
-            wait for 1 ps;
-
-            -- Receive data for next clock cycle
-            vhsock_recv(sock.all);
-
-            -- Copy received data to signals
-            ib_idx := sock.in_buffer_size - 1;
-            rst_n <= sock.in_buffer(ib_idx);
-            ib_idx := ib_idx - 1;
-            imem_rdata <= sock.in_buffer(ib_idx downto ib_idx - 31);
-            ib_idx := ib_idx - 32;
-            dmem_rdata <= sock.in_buffer(ib_idx downto ib_idx - 31);
-            ib_idx := ib_idx - 32;
-            external_interrupt_pending <= sock.in_buffer(ib_idx);
-            ib_idx := ib_idx - 1;
-            timer_interrupt_pending <= sock.in_buffer(ib_idx);
-            ib_idx := ib_idx - 1;
-
-            assert ib_idx = -1 report "ib_idx" severity failure;
-
-            wait for 1 ps;
-
-            -- Copy current state into out buffer
-            ob_idx := sock.out_buffer_size - 1;
-            sock.out_buffer(ob_idx downto ob_idx - 31) := imem_addr;
-            ob_idx := ob_idx - 32;
-            sock.out_buffer(ob_idx) := imem_ren;
-            ob_idx := ob_idx - 1;
-            sock.out_buffer(ob_idx downto ob_idx - 31) := dmem_addr;
-            ob_idx := ob_idx - 32;
-            sock.out_buffer(ob_idx) := dmem_ren;
-            ob_idx := ob_idx - 1;
-            sock.out_buffer(ob_idx) := dmem_wen;
-            ob_idx := ob_idx - 1;
-            sock.out_buffer(ob_idx downto ob_idx - 31) := dmem_wdata;
-            ob_idx := ob_idx - 32;
-            sock.out_buffer(ob_idx downto ob_idx - 3) := dmem_byte_enable;
-            ob_idx := ob_idx - 4;
-            assert ob_idx = -1 report "ob_idx" severity failure;
-
-            -- Send data
-            vhsock_send(sock.all);
-        end loop;
+            constant IN_BUFFER_SIZE : natural := 96;
+            constant OUT_BUFFER_SIZE : natural := 128;
 
-    end process;
+            -- Buffer index of bit b in word w, word 0 is the leftmost word of the buffer
+            function ib(w : natural; b : natural) return natural is
+            begin
+                return IN_BUFFER_SIZE - 32 * (w + 1) + b;
+            end function;
+
+            function ob(w : natural; b : natural) return natural is
+            begin
+                return OUT_BUFFER_SIZE - 32 * (w + 1) + b;
+            end function;
+        begin
+            sock := vhsock_create;
+
+            sock.name(VHSOCK_NAME'left to VHSOCK_NAME'right) := VHSOCK_NAME;
+            sock.name(VHSOCK_NAME'right+1 to 31) := (others => nul);
+
+            -- Memory layout for input and output buffers, every field starts on a 32 bit word
+            -- boundary so vhsock.c can transmit each word as one packed uint32_t:
+            -- Input:  word 0: 29 x '0' | rst_n | external_interrupt_pending | timer_interrupt_pending
+            --         word 1: imem_rdata
+            --         word 2: dmem_rdata
+            -- Input Length: 3 * 32 = 96 (IN_BUFFER_SIZE)
+            -- Output: word 0: imem_addr
+            --         word 1: dmem_addr
+            --         word 2: dmem_wdata
+            --         word 3: 25 x '0' | imem_ren | dmem_ren | dmem_wen | dmem_byte_enable
+            -- Output Length: 4 * 32 = 128 (OUT_BUFFER_SIZE)
+            sock.in_buffer_size := IN_BUFFER_SIZE;
+            sock.in_buffer := new std_ulogic_vector(sock.in_buffer_size - 1 downto 0);
+            sock.out_buffer_size := OUT_BUFFER_SIZE;
+            sock.out_buffer := new std_ulogic_vector(sock.out_buffer_size - 1 downto 0);
+            sock.out_buffer.all := (others => '0');
+            vhsock_init(sock.all);
+
+            while true loop
+                wait until rising_edge(clk);
+                wait for 1 ps;
+
+                -- Receive data for next clock cycle
+                vhsock_recv(sock.all);
+
+                -- Copy received data to signals
+                rst_n <= sock.in_buffer(ib(0, 2));
+                external_interrupt_pending <= sock.in_buffer(ib(0, 1));
+                timer_interrupt_pending <= sock.in_buffer(ib(0, 0));
+                imem_rdata <= sock.in_buffer(ib(1, 31) downto ib(1, 0));
+                dmem_rdata <= sock.in_buffer(ib(2, 31) downto ib(2, 0));
+
+                wait for 1 ps;
+
+                -- Copy current state into out buffer
+                sock.out_buffer(ob(0, 31) downto ob(0, 0)) := imem_addr;
+                sock.out_buffer(ob(1, 31) downto ob(1, 0)) := dmem_addr;
+                sock.out_buffer(ob(2, 31) downto ob(2, 0)) := dmem_wdata;
+                sock.out_buffer(ob(3, 6)) := imem_ren;
+                sock.out_buffer(ob(3, 5)) := dmem_ren;
+                sock.out_buffer(ob(3, 4)) := dmem_wen;
+                sock.out_buffer(ob(3, 3) downto ob(3, 0)) := dmem_byte_enable;
+
+                -- Send data
+                vhsock_send(sock.all);
+            end loop;
+
+        end process;
+    end generate;
+
+    lookahead_gen : if not TRANSACTION_LEVEL and QUANTUM > 1 generate
+        vhsock : process is
+            variable sock : vhsock_handle_ptr_t;
+
+            constant RECORD_WORDS : natural := 5;
+            constant IN_BUFFER_SIZE : natural := 32 * (1 + RECORD_WORDS * QUANTUM);
+            constant OUT_BUFFER_SIZE : natural := 160;
+
+            variable first : boolean := true;
+            variable count : natural := 0;
+            variable pos : natural := 0;
+            variable matches : boolean;
+            variable expected : std_ulogic_vector(31 downto 0);
+            variable control : std_ulogic_vector(31 downto 0);
+
+            -- Outputs sampled in the previous cycle
+            variable last_imem_addr : std_ulogic_vector(31 downto 0);
+            variable last_imem_ren : std_ulogic;
+            variable last_dmem_addr : std_ulogic_vector(31 downto 0);
+            variable last_dmem_ren : std_ulogic;
+            variable last_dmem_wen : std_ulogic;
+            variable last_dmem_wdata : std_ulogic_vector(31 downto 0);
+            variable last_dmem_byte_enable : std_ulogic_vector(3 downto 0);
+
+            function ib(w : natural; b : natural) return natural is
+            begin
+                return IN_BUFFER_SIZE - 32 * (w + 1) + b;
+            end function;
+
+            function ob(w : natural; b : natural) return natural is
+            begin
+                return OUT_BUFFER_SIZE - 32 * (w + 1) + b;
+            end function;
+
+            -- Word w of record r
+            impure function get_record(r : natural; w : natural) return std_ulogic_vector is
+            begin
+                return sock.in_buffer(ib(1 + RECORD_WORDS * r + w, 31) downto
+                                      ib(1 + RECORD_WORDS * r + w, 0));
+            end function;
+        begin
+            sock := vhsock_create;
+
+            sock.name(VHSOCK_NAME'left to VHSOCK_NAME'right) := VHSOCK_NAME;
+            sock.name(VHSOCK_NAME'right+1 to 31) := (others => nul);
+
+            -- Input:  word 0: number of records
+            --         RECORD_WORDS words per record:
+            --         expected imem_addr | expected control (6: imem_ren, 5: dmem_ren, 4: dmem_wen) |
+            --         29 x '0' & rst_n & external_interrupt_pending & timer_interrupt_pending |
+            --         imem_rdata | dmem_rdata
+            -- Input Length: 32 * (1 + RECORD_WORDS * QUANTUM) (IN_BUFFER_SIZE)
+            -- Output: words 0 - 3 as without lookahead, outputs of the cycle before the exchange
+            --         word 4: number of records applied since the previous exchange
+            -- Output Length: 5 * 32 = 160 (OUT_BUFFER_SIZE)
+            sock.in_buffer_size := IN_BUFFER_SIZE;
+            sock.in_buffer := new std_ulogic_vector(sock.in_buffer_size - 1 downto 0);
+            sock.out_buffer_size := OUT_BUFFER_SIZE;
+            sock.out_buffer := new std_ulogic_vector(sock.out_buffer_size - 1 downto 0);
+            sock.out_buffer.all := (others => '0');
+            vhsock_init(sock.all);
+
+            while true loop
+                wait until rising_edge(clk);
+                wait for 1 ps;
+
+                -- Records after the first one are only applied if the core behaved as predicted
+                matches := false;
+                if pos < count then
+                    expected := get_record(pos, 0);
+                    control := get_record(pos, 1);
+                    matches := last_imem_ren = control(6) and last_dmem_ren = control(5) and
+                               last_dmem_wen = control(4) and
+                               (control(6) = '0' or last_imem_addr = expected);
+                end if;
+
+                if not matches then
+                    if not first then
+                        sock.out_buffer(ob(0, 31) downto ob(0, 0)) := last_imem_addr;
+                        sock.out_buffer(ob(1, 31) downto ob(1, 0)) := last_dmem_addr;
+                        sock.out_buffer(ob(2, 31) downto ob(2, 0)) := last_dmem_wdata;
+                        sock.out_buffer(ob(3, 6)) := last_imem_ren;
+                        sock.out_buffer(ob(3, 5)) := last_dmem_ren;
+                        sock.out_buffer(ob(3, 4)) := last_dmem_wen;
+                        sock.out_buffer(ob(3, 3) downto ob(3, 0)) := last_dmem_byte_enable;
+                        sock.out_buffer(ob(4, 31) downto ob(4, 0)) :=
+                            std_ulogic_vector(to_unsigned(pos, 32));
+                        vhsock_send(sock.all);
+                    end if;
+                    first := false;
+
+                    vhsock_recv(sock.all);
+                    count := to_integer(unsigned(sock.in_buffer(ib(0, 31) downto ib(0, 0))));
+                    pos := 0;
+                end if;
+
+                control := get_record(pos, 2);
+                rst_n <= control(2);
+                external_interrupt_pending <= control(1);
+                timer_interrupt_pending <= control(0);
+                imem_rdata <= get_record(pos, 3);
+                dmem_rdata <= get_record(pos, 4);
+                pos := pos + 1;
+
+                wait for 1 ps;
+
+                last_imem_addr := imem_addr;
+                last_imem_ren := imem_ren;
+                last_dmem_addr := dmem_addr;
+                last_dmem_ren := dmem_ren;
+                last_dmem_wen := dmem_wen;
+                last_dmem_wdata := dmem_wdata;
+                last_dmem_byte_enable := dmem_byte_enable;
+            end loop;
+        end process;
+    end generate;
+
+    transaction_level_gen : if TRANSACTION_LEVEL generate
+        vhsock : process is
+            variable sock : vhsock_handle_ptr_t;
+
+            constant TL_WORDS : natural := tl_words(LOCKSTEP);
+            constant TL_BUFFER_SIZE : natural := 32 * TL_WORDS;
+            constant MAX_REGIONS : natural := 4;
+            constant LOG_SIZE : natural := 256;
+            constant DATA_HEADER_WORDS : natural := 4;
+            constant LOG_ENTRIES_PER_MSG : natural := (TL_WORDS - 2) / 2;
+            constant STATE_HEADER_WORDS : natural := 3;
+            constant RETIRE_WORDS : natural := 4;
+            constant RETIRE_LOG_SIZE : natural := (TL_WORDS - 2) / RETIRE_WORDS;
+
+            -- Commands (SystemC -> GHDL), word 0
+            constant CMD_REGION : natural := 1;
+            constant CMD_DATA : natural := 2;
+            constant CMD_RUN : natural := 3;
+            constant CMD_CONTINUE : natural := 4;
+            constant CMD_STATE_READ : natural := 5;
+            constant CMD_STATE_WRITE : natural := 6;
+
+            -- Messages (GHDL -> SystemC), word 0
+            constant MSG_ACK : natural := 1;
+            constant MSG_WRITE_LOG : natural := 2;
+            constant MSG_SYNC : natural := 3;
+            constant MSG_STATE : natural := 4;
+            constant MSG_RETIRE_LOG : natural := 5;
+
+            type word_array_t is array (natural range <>) of std_ulogic_vector(31 downto 0);
+            type word_array_ptr_t is access word_array_t;
+            type boolean_array_ptr_t is access boolean_vector;
+
+            -- Mirror of a memory on the SystemC side
+            type region_t is record
+                base : unsigned(31 downto 0);
+                words : natural;
+                data : word_array_ptr_t;
+                dirty : boolean_array_ptr_t;
+            end record;
+            type region_array_t is array (0 to MAX_REGIONS - 1) of region_t;
+
+            -- Mirror words written since the last flush, each word is logged once
+            type log_entry_t is record
+                region : natural;
+                offset : natural;
+            end record;
+            type log_t is array (0 to LOG_SIZE - 1) of log_entry_t;
+
+            variable regions : region_array_t;
+            variable region_count : natural := 0;
+            variable log : log_t;
+            variable log_count : natural := 0;
+            variable retire_log : word_array_t(0 to RETIRE_WORDS * RETIRE_LOG_SIZE - 1);
+            variable retire_count : natural := 0;
+
+            variable cmd : natural;
+            variable quantum : natural;
+            variable elapsed : natural;
+            variable found : boolean;
+            variable region : natural;
+            variable offset : natural;
+            variable word : std_ulogic_vector(31 downto 0);
+            variable imem_remote : boolean;
+            variable dmem_read_remote : boolean;
+            variable dmem_write_remote : boolean;
+            variable state_written : boolean := false;
+
+            -- Buffer index of bit b in word w, word 0 is the leftmost word of the buffer
+            function idx(w : natural; b : natural) return natural is
+            begin
+                return TL_BUFFER_SIZE - 32 * (w + 1) + b;
+            end function;
+
+            impure function get_word(w : natural) return std_ulogic_vector is
+            begin
+                return sock.in_buffer(idx(w, 31) downto idx(w, 0));
+            end function;
+
+            impure function get_natural(w : natural) return natural is
+            begin
+                return to_integer(unsigned(get_word(w)));
+            end function;
+
+            procedure put(w : natural; value : std_ulogic_vector(31 downto 0)) is
+            begin
+                sock.out_buffer(idx(w, 31) downto idx(w, 0)) := value;
+            end procedure;
+
+            procedure put(w : natural; value : natural) is
+            begin
+                put(w, std_ulogic_vector(to_unsigned(value, 32)));
+            end procedure;
+
+            procedure lookup(addr : std_ulogic_vector(31 downto 0)) is
+                variable distance : unsigned(31 downto 0);
+            begin
+                found := false;
+                if is_x(addr) then
+                    return;
+                end if;
+                for i in 0 to region_count - 1 loop
+                    distance := unsigned(addr) - regions(i).base;
+                    if unsigned(addr) >= regions(i).base and
+                       to_integer(distance(31 downto 2)) < regions(i).words then
+                        found := true;
+                        region := i;
+                        offset := to_integer(distance(31 downto 2));
+                        return;
+                    end if;
+                end loop;
+            end procedure;
+
+            -- Sends the log in messages of LOG_ENTRIES_PER_MSG entries, each answered by
+            -- CMD_CONTINUE: a full log takes 37 round trips (5 with LOCKSTEP). The answers are
+            -- needed because the inproc transport only has one buffer per direction and both
+            -- sides have to alternate, see vhsock_inproc.h.
+            procedure flush_log is
+                variable n : natural := 0;
+                variable entry : log_entry_t;
+            begin
+                for i in 0 to log_count - 1 loop
+                    entry := log(i);
+                    put(2 + 2 * n, std_ulogic_vector(regions(entry.region).base +
+                                                     shift_left(to_unsigned(entry.offset, 32), 2)));
+                    put(3 + 2 * n, regions(entry.region).data(entry.offset));
+                    regions(entry.region).dirty(entry.offset) := false;
+                    n := n + 1;
+
+                    if n = LOG_ENTRIES_PER_MSG or i = log_count - 1 then
+                        put(0, MSG_WRITE_LOG);
+                        put(1, n);
+                        vhsock_send(sock.all);
+                        vhsock_recv(sock.all);
+                        assert get_natural(0) = CMD_CONTINUE report "cmd" severity failure;
+                        n := 0;
+                    end if;
+                end loop;
+                log_count := 0;
+            end procedure;
+
+            procedure flush_retire_log is
+            begin
+                if retire_count = 0 then
+                    return;
+                end if;
+                put(0, MSG_RETIRE_LOG);
+                put(1, retire_count);
+                for i in 0 to RETIRE_WORDS * retire_count - 1 loop
+                    put(2 + i, retire_log(i));
+                end loop;
+                vhsock_send(sock.all);
+                vhsock_recv(sock.all);
+                assert get_natural(0) = CMD_CONTINUE report "cmd" severity failure;
+                retire_count := 0;
+            end procedure;
+
+            -- Records the event reported by the retire port in the last cycle
+            procedure log_retire is
+                variable control : std_ulogic_vector(31 downto 0) := (others => '0');
+            begin
+                if (retire_valid or retire_trap or retire_trap_return) /= '1' then
+                    return;
+                end if;
+
+                control(0) := retire_valid;
+                control(1) := retire_trap;
+                control(2) := retire_trap_return;
+                control(12 downto 8) := retire_rd;
+                control(19 downto 16) := retire_store_byte_enable;
+                retire_log(RETIRE_WORDS * retire_count) := control;
+                retire_log(RETIRE_WORDS * retire_count + 1) := retire_pc;
+                -- Stores never write a register
+                if retire_store_byte_enable /= "0000" then
+                    retire_log(RETIRE_WORDS * retire_count + 2) := retire_store_addr;
+                else
+                    retire_log(RETIRE_WORDS * retire_count + 2) := retire_rd_value;
+                end if;
+                retire_log(RETIRE_WORDS * retire_count + 3) := retire_store_data;
+                retire_count := retire_count + 1;
+
+                if retire_count = RETIRE_LOG_SIZE then
+                    flush_retire_log;
+                end if;
+            end procedure;
+
+            procedure apply_run is
+                variable control : std_ulogic_vector(31 downto 0);
+            begin
+                assert get_natural(0) = CMD_RUN report "cmd" severity failure;
+                control := get_word(1);
+                rst_n <= control(2);
+                external_interrupt_pending <= control(1);
+                timer_interrupt_pending <= control(0);
+                if control(8) = '1' then
+                    imem_rdata <= get_word(3);
+                end if;
+                if control(9) = '1' then
+                    dmem_rdata <= get_word(4);
+                end if;
+                state_halt <= control(10);
+                state_wen <= '0';
+                quantum := get_natural(2);
+                elapsed := 0;
+            end procedure;
+
+            -- Writes the state words one per cycle with the core held in reset, see eisv_core
+            procedure write_state is
+            begin
+                rst_n <= '0';
+                if not state_written then
+                    state_wen <= '0';
+                    wait until rising_edge(clk);
+                    state_written := true;
+                end if;
+
+                state_wen <= '1';
+                for i in 0 to get_natural(2) - 1 loop
+                    state_sel <= std_ulogic_vector(to_unsigned(get_natural(1) + i, 6));
+                    state_wdata <= get_word(STATE_HEADER_WORDS + i);
+                    wait until rising_edge(clk);
+                end loop;
+            end procedure;
+
+            -- Answers state reads of a halted core until the next run command
+            procedure receive_run is
+            begin
+                vhsock_recv(sock.all);
+                while get_natural(0) = CMD_STATE_READ loop
+                    for i in 0 to get_natural(2) - 1 loop
+                        state_sel <= std_ulogic_vector(to_unsigned(get_natural(1) + i, 6));
+                        wait for 1 ps;
+                        put(2 + i, state_rdata);
+                    end loop;
+                    put(0, MSG_STATE);
+                    put(1, get_natural(2));
+                    vhsock_send(sock.all);
+                    vhsock_recv(sock.all);
+                end loop;
+                apply_run;
+            end procedure;
+        begin
+            sock := vhsock_create;
+
+            sock.name(VHSOCK_NAME'left to VHSOCK_NAME'right) := VHSOCK_NAME;
+            sock.name(VHSOCK_NAME'right+1 to 31) := (others => nul);
+
+            -- Both buffers consist of TL_WORDS words, word 0 holds the command/message type:
+            -- CMD_REGION:    base | size in words
+            -- CMD_DATA:      region | word offset | word count | data ...
+            -- CMD_RUN:       control (10: halt, 9: dmem_rdata valid, 8: imem_rdata valid, 2: rst_n,
+            --                1: external_interrupt_pending, 0: timer_interrupt_pending) |
+            --                quantum | imem_rdata | dmem_rdata
+            -- CMD_CONTINUE:  -
+            -- CMD_STATE_READ:  first state word | count (only after a sync with the core halted)
+            -- CMD_STATE_WRITE: first state word | count | words ... (only before the first run)
+            -- MSG_ACK:       -
+            -- MSG_WRITE_LOG: count | (address | data) ...
+            -- MSG_SYNC:      elapsed cycles | imem_addr | dmem_addr | dmem_wdata |
+            --                control (7: halted, 6: imem read, 5: dmem read, 4: dmem write,
+            --                3..0: dmem_byte_enable)
+            -- MSG_STATE:     count | words ...
+            -- MSG_RETIRE_LOG: count | (control | pc | rd value or store address | store data) ...
+            --                control: 19..16: store byte enable, 12..8: rd, 2: trap return,
+            --                1: trap, 0: retired (see the retire port of eisv_core)
+            -- With LOCKSTEP all messages are enlarged, so up to RETIRE_LOG_SIZE events are batched.
+            sock.in_buffer_size := TL_BUFFER_SIZE;
+            sock.in_buffer := new std_ulogic_vector(sock.in_buffer_size - 1 downto 0);
+            sock.out_buffer_size := TL_BUFFER_SIZE;
+            sock.out_buffer := new std_ulogic_vector(sock.out_buffer_size - 1 downto 0);
+            sock.out_buffer.all := (others => '0');
+            vhsock_init(sock.all);
+
+            -- Set up mirrors until the first run command
+            loop
+                vhsock_recv(sock.all);
+                cmd := get_natural(0);
+                exit when cmd = CMD_RUN;
+
+                if cmd = CMD_REGION then
+                    regions(region_count).base := unsigned(get_word(1));
+                    regions(region_count).words := get_natural(2);
+                    regions(region_count).data :=
+                        new word_array_t'(0 to get_natural(2) - 1 => (others => '0'));
+                    regions(region_count).dirty :=
+                        new boolean_vector'(0 to get_natural(2) - 1 => false);
+                    region_count := region_count + 1;
+                elsif cmd = CMD_DATA then
+                    region := get_natural(1);
+                    offset := get_natural(2);
+                    for i in 0 to get_natural(3) - 1 loop
+                        regions(region).data(offset + i) := get_word(DATA_HEADER_WORDS + i);
+                    end loop;
+                elsif cmd = CMD_STATE_WRITE then
+                    write_state;
+                end if;
+
+                put(0, MSG_ACK);
+                vhsock_send(sock.all);
+            end loop;
+
+            apply_run;
+
+            while true loop
+                wait until rising_edge(clk);
+                elapsed := elapsed + 1;
+
+                imem_remote := false;
+                dmem_read_remote := false;
+                dmem_write_remote := false;
+
+                if LOCKSTEP then
+                    log_retire;
+                end if;
+
+                -- Requests were issued during the last cycle, answer them like a synchronous memory
+                if imem_ren = '1' then
+                    lookup(imem_addr);
+                    if found then
+                        imem_rdata <= regions(region).data(offset);
+                    else
+                        imem_remote := true;
+                    end if;
+                end if;
+
+                if dmem_ren = '1' then
+                    lookup(dmem_addr);
+                    if found then
+                        dmem_rdata <= regions(region).data(offset);
+                    else
+                        dmem_read_remote := true;
+                    end if;
+                end if;
+
+                if dmem_wen = '1' then
+                    lookup(dmem_addr);
+                    if found then
+                        word := regions(region).data(offset);
+                        for b in 0 to 3 loop
+                            if dmem_byte_enable(b) = '1' then
+                                word(8 * b + 7 downto 8 * b) := dmem_wdata(8 * b + 7 downto 8 * b);
+                            end if;
+                        end loop;
+                        regions(region).data(offset) := word;
+
+                        if not regions(region).dirty(offset) then
+                            regions(region).dirty(offset) := true;
+                            log(log_count) := (region, offset);
+                            log_count := log_count + 1;
+                        end if;
+                    else
+                        dmem_write_remote := true;
+                    end if;
+                end if;
+
+                if log_count = LOG_SIZE then
+                    flush_log;
+                end if;
+
+                if elapsed = quantum or imem_remote or dmem_read_remote or dmem_write_remote or
+                   state_halted = '1' then
+                    flush_retire_log;
+                    flush_log;
+
+                    word := (others => '0');
+                    word(7) := state_halted;
+                    word(6) := '1' when imem_remote else '0';
+                    word(5) := '1' when dmem_read_remote else '0';
+                    word(4) := '1' when dmem_write_remote else '0';
+                    word(3 downto 0) := dmem_byte_enable;
+
+                    put(0, MSG_SYNC);
+                    put(1, elapsed);
+                    put(2, imem_addr);
+                    put(3, dmem_addr);
+                    put(4, dmem_wdata);
+                    put(5, word);
+                    vhsock_send(sock.all);
+
+                    receive_run;
+                end if;
+            end loop;
+        end process;
+    end generate;
 
 end architecture;
\ No newline at end of file
@@ -1,14 +1,75 @@
 #include "vhsock.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <unistd.h>
+
+vhsock_inproc vhsock_inproc_channel;
 
 static char STD_ULOGIC_CHAR[] = {'U', 'X', '0', '1', 'Z', 'W', 'L', 'H', '-'};
 
+static const uint8_t STD_ULOGIC_0 = 2;
+static const uint8_t STD_ULOGIC_1 = 3;
+
+// Expands the 8 bits of a byte (MSB first) to 8 std_ulogic values
+static uint64_t unpack_table[256];
+
+static void init_unpack_table(void) {
+    for (int byte = 0; byte < 256; byte++) {
+        uint8_t ulogic[8];
+        for (int i = 0; i < 8; i++) {
+            ulogic[i] = (byte >> (7 - i)) & 1 ? STD_ULOGIC_1 : STD_ULOGIC_0;
+        }
+        memcpy(&unpack_table[byte], ulogic, sizeof(uint64_t));
+    }
+}
+
+// Gathers bit 0 of each of the 8 bytes in x into one byte, the first byte becomes the MSB
+static uint32_t gather_bits(uint64_t x) {
+    return ((x & 0x0101010101010101ull) * 0x8040201008040201ull) >> 56;
+}
+
+// Packs 32 std_ulogic values into a word holding the '1' bits and a word flagging every value
+// that is neither '0' nor '1'. Flagged bits are transmitted as 0.
+static void pack_word(char const* ulogic, uint32_t* value_out, uint32_t* invalid_out) {
+    uint32_t value = 0;
+    uint32_t invalid = 0;
+    for (int i = 0; i < 4; i++) {
+        uint64_t x;
+        memcpy(&x, ulogic + 8 * i, sizeof(x));
+        // '0' and '1' are the only values with x ^ 2 in {0, 1}
+        uint64_t t = (x ^ 0x0202020202020202ull) & 0xfefefefefefefefeull;
+        value = (value << 8) | gather_bits(x);
+        invalid = (invalid << 8) | gather_bits((t >> 1) | (t >> 2) | (t >> 3));
+    }
+    *value_out = value & ~invalid;
+    *invalid_out = invalid;
+}
+
+static void pack_out_buffer(vhsock_handle* sock) {
+    int words = sock->out_buffer_size / 32;
+    for (int i = 0; i < words; i++) {
+        pack_word(&sock->out_buffer->data[32 * i], &sock->out_wire[i], &sock->out_wire[words + i]);
+    }
+}
+
+static void unpack_in_buffer(vhsock_handle* sock) {
+    int words = sock->in_buffer_size / 32;
+    for (int i = 0; i < words; i++) {
+        uint32_t word = sock->in_wire[i];
+        for (int j = 0; j < 4; j++) {
+            memcpy(&sock->in_buffer->data[32 * i + 8 * j], &unpack_table[(word >> (24 - 8 * j)) & 0xff],
+                   sizeof(uint64_t));
+        }
+    }
+}
+
 vhsock_handle* vhsock_create() {
     printf("Creating empty vhsock handle\n");
 
@@ -20,14 +81,98 @@ vhsock_handle* vhsock_create() {
     sock->out_buffer = NULL;
     sock->fd = 0;
     sock->connected = 0;
+    sock->shm = NULL;
+    sock->inproc = NULL;
+    sock->in_wire_size = 0;
+    sock->in_wire = NULL;
+    sock->out_wire_size = 0;
+    sock->out_wire = NULL;
 
     return sock;
 }
 
+static void vhsock_init_shm(vhsock_handle* sock) {
+    if (sock->in_wire_size > VHSOCK_SHM_SLOT_SIZE || sock->out_wire_size > VHSOCK_SHM_SLOT_SIZE) {
+        printf("Buffer sizes exceed shm slot size %d\n", VHSOCK_SHM_SLOT_SIZE);
+        exit(0);
+    }
+
+    char path[VHSOCK_NAME_MAXLEN + 16];
+    vhsock_shm_path(sock->name, path, sizeof(path));
+
+    int fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        perror("shm_open");
+        exit(0);
+    }
+    if (ftruncate(fd, sizeof(vhsock_shm)) == -1) {
+        perror("ftruncate");
+        exit(0);
+    }
+
+    sock->shm = mmap(NULL, sizeof(vhsock_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (sock->shm == MAP_FAILED) {
+        perror("mmap");
+        exit(0);
+    }
+
+    sock->shm->server_pid = getpid();
+    __atomic_store_n(&sock->shm->magic, VHSOCK_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    // Wait for the SystemC side to attach, the name is not needed afterwards
+    while (__atomic_load_n(&sock->shm->client_pid, __ATOMIC_ACQUIRE) == 0) {
+        usleep(1000);
+    }
+    shm_unlink(path);
+
+    printf("Connected %s\n", path);
+}
+
+// The SystemC side is already running in this process, the wire buffers become the channel's
+static void vhsock_init_inproc(vhsock_handle* sock) {
+    if (sock->in_wire_size > VHSOCK_INPROC_BUFFER_SIZE ||
+        sock->out_wire_size > VHSOCK_INPROC_BUFFER_SIZE) {
+        printf("Buffer sizes exceed inproc buffer size %d\n", VHSOCK_INPROC_BUFFER_SIZE);
+        exit(0);
+    }
+
+    sock->inproc = &vhsock_inproc_channel;
+    free(sock->in_wire);
+    free(sock->out_wire);
+    sock->in_wire = sock->inproc->to_server;
+    sock->out_wire = sock->inproc->to_client;
+
+    printf("Connected %s\n", sock->name);
+}
+
 void vhsock_init(vhsock_handle* sock) {
     printf("Initializing Socket: %s, %d, %p, %d, %p\n", sock->name, sock->in_buffer_size,
            sock->in_buffer, sock->out_buffer_size, sock->out_buffer);
 
+    if (sock->in_buffer_size % 32 != 0 || sock->out_buffer_size % 32 != 0) {
+        printf("Buffer sizes have to be multiples of 32\n");
+        exit(0);
+    }
+
+    // Wire format: in  = one value word per 32 std_ulogic
+    //              out = all value words followed by one invalid (not '0'/'1') mask per value word
+    init_unpack_table();
+    sock->in_wire_size = sock->in_buffer_size / 8;
+    sock->in_wire = malloc(sock->in_wire_size);
+    sock->out_wire_size = 2 * (sock->out_buffer_size / 8);
+    sock->out_wire = malloc(sock->out_wire_size);
+
+    if (vhsock_inproc_selected(sock->name)) {
+        vhsock_init_inproc(sock);
+        return;
+    }
+
+    if (vhsock_shm_selected(sock->name)) {
+        vhsock_init_shm(sock);
+        return;
+    }
+
     sock->fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
 
     struct sockaddr_un addr;
@@ -46,7 +191,23 @@ void vhsock_init(vhsock_handle* sock) {
 }
 
 void vhsock_send(vhsock_handle* sock) {
-    int result = send(sock->fd, sock->out_buffer->data, sock->out_buffer_size, 0);
+    pack_out_buffer(sock);
+
+    if (sock->inproc != NULL) {
+        vhsock_inproc_pass(sock->inproc, VHSOCK_INPROC_SYSTEMC);
+        return;
+    }
+
+    if (sock->shm != NULL) {
+        if (vhsock_shm_push(&sock->shm->to_client, sock->out_wire, sock->out_wire_size,
+                            &sock->shm->client_pid) == -1) {
+            printf("send: peer disconnected\n");
+            exit(0);
+        }
+        return;
+    }
+
+    int result = send(sock->fd, sock->out_wire, sock->out_wire_size, 0);
     if (result == -1) {
         perror("send");
         exit(0);
@@ -54,9 +215,27 @@ void vhsock_send(vhsock_handle* sock) {
 }
 
 void vhsock_recv(vhsock_handle* sock) {
-    int result = recv(sock->fd, sock->in_buffer->data, sock->in_buffer_size, 0);
+    if (sock->inproc != NULL) {
+        // The SystemC side never exits without taking this thread down with it
+        vhsock_inproc_take(sock->inproc, VHSOCK_INPROC_GHDL);
+        unpack_in_buffer(sock);
+        return;
+    }
+
+    if (sock->shm != NULL) {
+        if (vhsock_shm_pop(&sock->shm->to_server, sock->in_wire, sock->in_wire_size,
+                           &sock->shm->client_pid) == -1) {
+            printf("recv: peer disconnected\n");
+            exit(0);
+        }
+        unpack_in_buffer(sock);
+        return;
+    }
+
+    int result = recv(sock->fd, sock->in_wire, sock->in_wire_size, 0);
     if (result == -1) {
         perror("send");
         exit(0);
     }
+    unpack_in_buffer(sock);
 }
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include <stddef.h>
+#include <stdint.h>
+
+#include "vhsock_inproc.h"
+#include "vhsock_shm.h"
 
 #define VHSOCK_NAME_MAXLEN 32
 
@@ -18,6 +22,13 @@ typedef struct {
     // Not visible to VHDL
     int fd;
     int connected;
+    vhsock_shm* shm;
+    vhsock_inproc* inproc;
+    // Packed representation exchanged with the SystemC side
+    int in_wire_size;
+    uint32_t* in_wire;
+    int out_wire_size;
+    uint32_t* out_wire;
 } vhsock_handle;
 
 vhsock_handle* vhsock_create(void);
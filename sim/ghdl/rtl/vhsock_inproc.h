@@ -0,0 +1,72 @@
+#ifndef VHSOCK_INPROC_H
+#define VHSOCK_INPROC_H
+
+// In-process transport for vhsock, used by both the GHDL (C) and the SystemC (C++) side when
+// core_sim is linked into eisv-mem-system-inproc and runs in a thread of it.
+//
+// Both sides strictly alternate between sending and receiving, so there is one buffer per
+// direction and a baton instead of rings: the side holding the baton works on the buffers and
+// passes it on with its message, the other side waits for it like vhsock_shm_pop (spin, then
+// futex). The GHDL side packs and unpacks directly in the buffers.
+
+#include "vhsock_shm.h"
+
+#define VHSOCK_INPROC_PREFIX "inproc:"
+#define VHSOCK_INPROC_PREFIX_LEN 7
+#define VHSOCK_INPROC_BUFFER_SIZE VHSOCK_SHM_SLOT_SIZE
+
+// Holder of the baton, the SystemC side sends first and starts with it
+#define VHSOCK_INPROC_SYSTEMC 0
+#define VHSOCK_INPROC_GHDL 1
+// Passed to the SystemC side when ghdl_main returns
+#define VHSOCK_INPROC_EXITED 2
+
+typedef struct {
+    VHSOCK_SHM_CACHELINE uint32_t baton;
+    // Per side, so one side leaving the wait cannot clear the flag of the other
+    uint32_t waiting[2];
+
+    // SystemC -> GHDL
+    VHSOCK_SHM_CACHELINE uint32_t to_server[VHSOCK_INPROC_BUFFER_SIZE / 4];
+    // GHDL -> SystemC
+    VHSOCK_SHM_CACHELINE uint32_t to_client[VHSOCK_INPROC_BUFFER_SIZE / 4];
+} vhsock_inproc;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// Defined in vhsock.c, one core_sim per process. Zero initialized, so the SystemC side holds the
+// baton before either side started.
+extern vhsock_inproc vhsock_inproc_channel;
+#ifdef __cplusplus
+}
+#endif
+
+// Returns non-zero if name selects the in-process transport
+static inline int vhsock_inproc_selected(char const* name) {
+    return strncmp(name, VHSOCK_INPROC_PREFIX, VHSOCK_INPROC_PREFIX_LEN) == 0;
+}
+
+// Waits until the baton is passed to side. Returns -1 if core_sim exited instead.
+static inline int vhsock_inproc_take(vhsock_inproc* channel, uint32_t side) {
+    static int32_t const no_peer_pid = 0;
+    uint32_t baton;
+    while ((baton = __atomic_load_n(&channel->baton, __ATOMIC_ACQUIRE)) != side) {
+        if (baton == VHSOCK_INPROC_EXITED) {
+            return -1;
+        }
+        vhsock_shm_wait(&channel->baton, &channel->waiting[side], baton, &no_peer_pid);
+    }
+    return 0;
+}
+
+static inline void vhsock_inproc_pass(vhsock_inproc* channel, uint32_t side) {
+    vhsock_shm_notify(&channel->baton, &channel->waiting[side], side);
+}
+
+static inline void vhsock_inproc_exit(vhsock_inproc* channel) {
+    vhsock_shm_notify(&channel->baton, &channel->waiting[VHSOCK_INPROC_SYSTEMC],
+                      VHSOCK_INPROC_EXITED);
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef VHSOCK_SHM_H
+#define VHSOCK_SHM_H
+
+// Shared memory transport for vhsock, used by both the GHDL (C) and the SystemC (C++) side.
+//
+// The region contains one single-producer/single-consumer ring per direction. Producer and
+// consumer only exchange head/tail counters through atomics, a consumer that finds its ring
+// empty spins for a while and then parks on the counter with a futex. The kernel is therefore
+// only involved if one side is waiting for longer than the spin phase.
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define VHSOCK_SHM_PREFIX "shm:"
+#define VHSOCK_SHM_PREFIX_LEN 4
+#define VHSOCK_SHM_MAGIC 0x56485348u
+
+#define VHSOCK_SHM_SLOTS 8
+#define VHSOCK_SHM_SLOT_SIZE 2048
+#define VHSOCK_SHM_SPIN 20000
+#define VHSOCK_SHM_PARK_NS 100000000
+
+#define VHSOCK_SHM_CACHELINE __attribute__((aligned(64)))
+
+typedef struct {
+    // Written by producer
+    VHSOCK_SHM_CACHELINE uint32_t head;
+    uint32_t head_waiting;
+    // Written by consumer
+    VHSOCK_SHM_CACHELINE uint32_t tail;
+    uint32_t tail_waiting;
+
+    VHSOCK_SHM_CACHELINE char slots[VHSOCK_SHM_SLOTS][VHSOCK_SHM_SLOT_SIZE];
+} vhsock_shm_ring;
+
+typedef struct {
+    uint32_t magic;
+    int32_t server_pid;
+    int32_t client_pid;
+    // SystemC -> GHDL
+    vhsock_shm_ring to_server;
+    // GHDL -> SystemC
+    vhsock_shm_ring to_client;
+} vhsock_shm;
+
+// Returns non-zero if name selects the shared memory transport
+static inline int vhsock_shm_selected(char const* name) {
+    return strncmp(name, VHSOCK_SHM_PREFIX, VHSOCK_SHM_PREFIX_LEN) == 0;
+}
+
+// Writes the shm_open() object name for a vhsock name ("shm:<id>" -> "/vhsock-<id>")
+static inline void vhsock_shm_path(char const* name, char* path_out, size_t path_len) {
+    char const* id = vhsock_shm_selected(name) ? name + VHSOCK_SHM_PREFIX_LEN : name;
+    path_out[0] = '\0';
+    strncat(path_out, "/vhsock-", path_len - 1);
+    strncat(path_out, id, path_len - strlen(path_out) - 1);
+}
+
+static inline void vhsock_shm_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// Spinning only pays off if the peer can make progress on another CPU at the same time
+static inline int vhsock_shm_spin_count(void) {
+    static int spin_count = -1;
+    if (spin_count == -1) {
+        spin_count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? VHSOCK_SHM_SPIN : 0;
+    }
+    return spin_count;
+}
+
+// Waits until *word differs from old. Returns -1 if the peer process went away in the meantime.
+static inline int vhsock_shm_wait(uint32_t* word, uint32_t* waiting, uint32_t old,
+                                  int32_t const* peer_pid) {
+    int spin_count = vhsock_shm_spin_count();
+    for (int i = 0; i < spin_count; i++) {
+        if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != old) {
+            return 0;
+        }
+        vhsock_shm_cpu_relax();
+    }
+
+    while (1) {
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(word, __ATOMIC_SEQ_CST) != old) {
+            __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+            return 0;
+        }
+
+        struct timespec timeout = {0, VHSOCK_SHM_PARK_NS};
+        syscall(SYS_futex, word, FUTEX_WAIT, old, &timeout, NULL, 0);
+        __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+
+        if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != old) {
+            return 0;
+        }
+
+        int32_t pid = __atomic_load_n(peer_pid, __ATOMIC_ACQUIRE);
+        if (pid != 0 && kill(pid, 0) == -1 && errno == ESRCH) {
+            return -1;
+        }
+    }
+}
+
+static inline void vhsock_shm_notify(uint32_t* word, uint32_t* waiting, uint32_t value) {
+    __atomic_store_n(word, value, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+static inline int vhsock_shm_push(vhsock_shm_ring* ring, void const* data, size_t size,
+                                  int32_t const* peer_pid) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail;
+    while (head - (tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= VHSOCK_SHM_SLOTS) {
+        if (vhsock_shm_wait(&ring->tail, &ring->tail_waiting, tail, peer_pid) == -1) {
+            return -1;
+        }
+    }
+
+    memcpy(ring->slots[head % VHSOCK_SHM_SLOTS], data, size);
+    vhsock_shm_notify(&ring->head, &ring->head_waiting, head + 1);
+    return 0;
+}
+
+static inline int vhsock_shm_pop(vhsock_shm_ring* ring, void* data, size_t size,
+                                 int32_t const* peer_pid) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+        if (vhsock_shm_wait(&ring->head, &ring->head_waiting, tail, peer_pid) == -1) {
+            return -1;
+        }
+    }
+
+    memcpy(data, ring->slots[tail % VHSOCK_SHM_SLOTS], size);
+    vhsock_shm_notify(&ring->tail, &ring->tail_waiting, tail + 1);
+    return 0;
+}
+
+#endif
@@ -1,9 +1,33 @@
 #include "ghdl_module.hh"
 
-static constexpr char STD_ULOGIC_CHAR[]{'U', 'X', '0', '1', 'Z', 'W', 'L', 'H', '-'};
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <thread>
+
+#ifdef GHDL_INPROC
+// Entry point of the GHDL runtime for designs bound with ghdl --bind
+extern "C" int ghdl_main(int argc, char** argv);
+#endif
+
+// Buffer sizes are counted in words, the transports in bytes
+static size_t buffer_bytes(int buffer_size) {
+    return static_cast<size_t>(buffer_size) * sizeof(uint32_t);
+}
 
 VHSocket::VHSocket(std::string name, int in_buffer_size, int out_buffer_size)
     : in_buffer_size(in_buffer_size), out_buffer_size(out_buffer_size) {
+    if (vhsock_inproc_selected(name.c_str())) {
+        connect_inproc(name);
+        return;
+    }
+
+    if (vhsock_shm_selected(name.c_str())) {
+        connect_shm(name);
+        return;
+    }
+
     fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
     // Init addr with "\0" + name
     addr.sun_family = AF_UNIX;
@@ -18,19 +42,113 @@ VHSocket::VHSocket(std::string name, int in_buffer_size, int out_buffer_size)
     errno = 0;
 }
 
-void VHSocket::vhsend(std::vector<uint8_t> const& out_data) {
-    assert(out_data.size() == out_buffer_size);
+void VHSocket::connect_shm(std::string name) {
+    assert(buffer_bytes(in_buffer_size) <= VHSOCK_SHM_SLOT_SIZE &&
+           buffer_bytes(out_buffer_size) <= VHSOCK_SHM_SLOT_SIZE);
+
+    char path[64];
+    vhsock_shm_path(name.c_str(), path, sizeof(path));
+
+    // Wait until the GHDL side created and sized the region
+    struct stat st;
+    do {
+        fd = shm_open(path, O_RDWR, 0);
+        if (fd != -1 &&
+            (fstat(fd, &st) == -1 || st.st_size < static_cast<off_t>(sizeof(vhsock_shm)))) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd == -1) {
+            usleep(1000);
+        }
+    } while (fd == -1);
+
+    void* region = mmap(nullptr, sizeof(vhsock_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    fd = -1;
+    if (region == MAP_FAILED) {
+        perror("mmap");
+        exit(0);
+    }
+    shm = static_cast<vhsock_shm*>(region);
+
+    while (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != VHSOCK_SHM_MAGIC) {
+        usleep(1000);
+    }
+    __atomic_store_n(&shm->client_pid, getpid(), __ATOMIC_RELEASE);
+    errno = 0;
+}
+
+// Nothing to wait for, core_sim only has to run in this process
+void VHSocket::connect_inproc([[maybe_unused]] std::string name) {
+#ifdef GHDL_INPROC
+    assert(buffer_bytes(in_buffer_size) <= VHSOCK_INPROC_BUFFER_SIZE &&
+           buffer_bytes(out_buffer_size) <= VHSOCK_INPROC_BUFFER_SIZE);
+    inproc = &vhsock_inproc_channel;
+    fd = -1;
+#else
+    printf("%s requires core_sim in this process (eisv-mem-system-inproc)\n", name.c_str());
+    exit(1);
+#endif
+}
+
+#ifdef GHDL_INPROC
+void VHSocket::start_inproc(int argc, char** argv) {
+    std::thread([argc, argv] {
+        int status = ghdl_main(argc, argv);
+        printf("core_sim exited with %d\n", status);
+        vhsock_inproc_exit(&vhsock_inproc_channel);
+    }).detach();
+}
+#endif
+
+void VHSocket::vhsend(std::vector<uint32_t> const& out_data) {
+    assert(out_data.size() == static_cast<size_t>(out_buffer_size));
+
+    if (inproc != nullptr) {
+        memcpy(inproc->to_server, out_data.data(), buffer_bytes(out_buffer_size));
+        vhsock_inproc_pass(inproc, VHSOCK_INPROC_GHDL);
+        return;
+    }
+
+    if (shm != nullptr) {
+        if (vhsock_shm_push(&shm->to_server, out_data.data(), buffer_bytes(out_buffer_size),
+                            &shm->server_pid) == -1) {
+            printf("send: peer disconnected\n");
+            exit(0);
+        }
+        return;
+    }
 
-    int result = send(fd, out_data.data(), out_buffer_size, 0);
+    int result = send(fd, out_data.data(), buffer_bytes(out_buffer_size), 0);
     if (result == -1) {
         perror("send");
         exit(0);
     }
 }
 
-void VHSocket::vhrecv(std::vector<uint8_t>& in_data) {
-    assert(in_data.size() == in_buffer_size);
-    int result = recv(fd, in_data.data(), in_buffer_size, 0);
+void VHSocket::vhrecv(std::vector<uint32_t>& in_data) {
+    assert(in_data.size() == static_cast<size_t>(in_buffer_size));
+
+    if (inproc != nullptr) {
+        if (vhsock_inproc_take(inproc, VHSOCK_INPROC_SYSTEMC) == -1) {
+            printf("recv: peer disconnected\n");
+            exit(0);
+        }
+        memcpy(in_data.data(), inproc->to_client, buffer_bytes(in_buffer_size));
+        return;
+    }
+
+    if (shm != nullptr) {
+        if (vhsock_shm_pop(&shm->to_client, in_data.data(), buffer_bytes(in_buffer_size),
+                           &shm->server_pid) == -1) {
+            printf("recv: peer disconnected\n");
+            exit(0);
+        }
+        return;
+    }
+
+    int result = recv(fd, in_data.data(), buffer_bytes(in_buffer_size), 0);
 
     if (result == -1) {
         perror("recv");
@@ -46,15 +164,23 @@ int VHSocket::get_in_buffer_size() {
     return in_buffer_size;
 }
 
+bool GHDLModule::replay_cycle() {
+    return false;
+}
+
+void GHDLModule::exchange() {
+    copy_to_outbuffer(out_buffer);
+    vhsock.vhsend(out_buffer);
+    vhsock.vhrecv(in_buffer);
+    copy_from_inbuffer(in_buffer);
+}
+
 void GHDLModule::vhsock_thread() {
-    std::vector<uint8_t> out_buffer(vhsock.get_out_buffer_size());
-    std::vector<uint8_t> in_buffer(vhsock.get_in_buffer_size());
     while (1) {
         wait(clk.posedge_event());
         wait(1, SC_PS);
-        copy_to_outbuffer(out_buffer);
-        vhsock.vhsend(out_buffer);
-        vhsock.vhrecv(in_buffer);
-        copy_from_inbuffer(in_buffer);
+        if (!replay_cycle()) {
+            exchange();
+        }
     }
 }
@@ -1,18 +1,38 @@
+#ifndef GHDL_MODULE_HH
+#define GHDL_MODULE_HH
+
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <systemc.h>
 
+#include "vhsock_inproc.h"
+#include "vhsock_shm.h"
+
+// Buffer sizes are given in 32 bit words of the packed wire format
 class VHSocket {
    public:
     VHSocket(std::string name, int in_buffer_size, int out_buffer_size);
 
-    void vhsend(std::vector<uint8_t> const& out_data);
-    void vhrecv(std::vector<uint8_t>& in_data);
+    void vhsend(std::vector<uint32_t> const& out_data);
+    void vhrecv(std::vector<uint32_t>& in_data);
 
     int get_out_buffer_size();
     int get_in_buffer_size();
 
+#ifdef GHDL_INPROC
+    // Runs core_sim, linked into this executable, with the given arguments in its own thread
+    static void start_inproc(int argc, char** argv);
+#endif
+
    private:
+    void connect_shm(std::string name);
+    void connect_inproc(std::string name);
+
+    // Only set if the shared memory transport was selected with a "shm:" name
+    vhsock_shm* shm = nullptr;
+    // Only set if the in-process transport was selected with an "inproc:" name
+    vhsock_inproc* inproc = nullptr;
+
     int fd;
     int addrlen;
     sockaddr_un addr;
@@ -25,16 +45,34 @@ struct GHDLModule : public sc_module {
 
    public:
     sc_in<bool> clk;
-    GHDLModule(sc_module_name name, VHSocket vhsock) : vhsock(vhsock) {
-        SC_THREAD(vhsock_thread);
+    // Without the thread the socket is left to a TransactionBridge, or the owner calls exchange()
+    // itself instead of clocking the module
+    GHDLModule(sc_module_name name, VHSocket vhsock, bool thread = true)
+        : vhsock(vhsock),
+          out_buffer(vhsock.get_out_buffer_size()),
+          in_buffer(vhsock.get_in_buffer_size()) {
+        if (thread) {
+            SC_THREAD(vhsock_thread);
+        }
     }
 
    protected:
-    virtual void copy_to_outbuffer(std::vector<uint8_t>& out_data) = 0;
-    virtual void copy_from_inbuffer(std::vector<uint8_t> const& in_data) = 0;
+    // Sends the current inputs to the GHDL side and takes over the outputs it answers with
+    void exchange();
+
+    virtual void copy_to_outbuffer(std::vector<uint32_t>& out_data) = 0;
+    virtual void copy_from_inbuffer(std::vector<uint32_t> const& in_data) = 0;
+
+    // Called every cycle before exchanging buffers. Returns true for cycles the GHDL side already
+    // simulated ahead of SystemC time in the last exchange, these are not exchanged again.
+    virtual bool replay_cycle();
 
    private:
     VHSocket vhsock;
+    std::vector<uint32_t> out_buffer;
+    std::vector<uint32_t> in_buffer;
 
     void vhsock_thread();
-};
\ No newline at end of file
+};
+
+#endif
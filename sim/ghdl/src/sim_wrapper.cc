@@ -1,92 +1,206 @@
 #include "sim_wrapper.hh"
 
-static constexpr uint8_t STD_ULOGIC_0 = 2;
-static constexpr uint8_t STD_ULOGIC_1 = 3;
+// Word indices of the packed buffers, see core_sim.vhd for the layout
+static constexpr int IN_IMEM_ADDR = 0;
+static constexpr int IN_DMEM_ADDR = 1;
+static constexpr int IN_DMEM_WDATA = 2;
+static constexpr int IN_CONTROL = 3;
+
+static constexpr int IN_CONTROL_IMEM_REN = 6;
+static constexpr int IN_CONTROL_DMEM_REN = 5;
+static constexpr int IN_CONTROL_DMEM_WEN = 4;
+static constexpr uint32_t IN_CONTROL_BYTE_ENABLE_MASK = 0xf;
+
+static constexpr int IN_CONSUMED = 4;
+
+static constexpr int OUT_CONTROL = 0;
+static constexpr int OUT_IMEM_RDATA = 1;
+static constexpr int OUT_DMEM_RDATA = 2;
+
+static constexpr int OUT_CONTROL_RST_N = 2;
+static constexpr int OUT_CONTROL_EXTERNAL_INTERRUPT_PENDING = 1;
+static constexpr int OUT_CONTROL_TIMER_INTERRUPT_PENDING = 0;
+
+// Words of a lookahead record, see core_sim.vhd
+static constexpr int RECORD_EXPECTED_IMEM_ADDR = 0;
+static constexpr int RECORD_EXPECTED_CONTROL = 1;
+static constexpr int RECORD_CONTROL = 2;
+static constexpr int RECORD_IMEM_RDATA = 3;
+static constexpr int RECORD_DMEM_RDATA = 4;
+
+static constexpr char const* IN_WORD_NAME[]{"o_imem_addr", "o_dmem_addr", "o_dmem_wdata",
+                                            "o_imem_ren/o_dmem_ren/o_dmem_wen/o_dmem_byte_enable"};
+
+// Kept out of line, only called if the core drives anything but '0' or '1'
+__attribute__((noinline, cold)) static void warn_invalid(uint32_t const* invalid) {
+    for (int i = 0; i < sim_wrapper::IN_VALUE_WORDS; i++) {
+        if (invalid[i] != 0) {
+            printf("WARN: Converting non '0'/'1' bits %08x of %s to '0'\n", invalid[i],
+                   IN_WORD_NAME[i]);
+        }
+    }
+}
 
-static constexpr char STD_ULOGIC_CHAR[]{'U', 'X', '0', '1', 'Z', 'W', 'L', 'H', '-'};
+static bool bit(uint32_t word, int index) {
+    return (word >> index) & 1;
+}
 
-static bool ulogic_to_bit(uint8_t ulogic) {
-    if (ulogic == STD_ULOGIC_0) {
-        return false;
-    } else if (ulogic == STD_ULOGIC_1) {
-        return true;
-    } else {
-        printf("WARN: Converting '%c' to '0'\n", STD_ULOGIC_CHAR[ulogic]);
-        return false;
-    }
+static uint32_t input_control(sim_wrapper::Inputs const& inputs) {
+    return (inputs.rst_n << OUT_CONTROL_RST_N) |
+           (inputs.external_interrupt_pending << OUT_CONTROL_EXTERNAL_INTERRUPT_PENDING) |
+           (inputs.timer_interrupt_pending << OUT_CONTROL_TIMER_INTERRUPT_PENDING);
 }
 
-static uint8_t bit_to_ulogic(bool bit) {
-    if (bit) {
-        return STD_ULOGIC_1;
-    } else {
-        return STD_ULOGIC_0;
-    }
+bool sim_wrapper::Inputs::operator==(Inputs const& other) const {
+    return rst_n == other.rst_n && imem_rdata == other.imem_rdata &&
+           dmem_rdata == other.dmem_rdata &&
+           external_interrupt_pending == other.external_interrupt_pending &&
+           timer_interrupt_pending == other.timer_interrupt_pending;
+}
+
+void sim_wrapper::set_predictor(Predictor* predictor) {
+    this->predictor = predictor;
 }
 
-template <int n>
-static int copy_from_ghdl(uint8_t const* src, sc_bv<n>& dst) {
-    for (int i = n - 1; i >= 0; i--) {
-        dst[i] = ulogic_to_bit(*src);
-        src++;
+sim_wrapper::Outputs const& sim_wrapper::step(Inputs const& inputs) {
+    direct_inputs = inputs;
+    if (!replay_cycle()) {
+        exchange();
     }
-    return n;
+    return direct_outputs;
 }
 
-static int copy_from_ghdl(uint8_t const* src, bool& dst) {
-    dst = ulogic_to_bit(*src);
-    return 1;
+sim_wrapper::Inputs sim_wrapper::read_inputs() {
+    if (direct) {
+        return direct_inputs;
+    }
+
+    Inputs inputs;
+    inputs.rst_n = i_eisV_rst_n.read();
+    inputs.imem_rdata = i_imem_rdata.read();
+    inputs.dmem_rdata = i_dmem_rdata.read();
+    inputs.external_interrupt_pending = i_external_interrupt_pending.read();
+    inputs.timer_interrupt_pending = i_timer_interrupt_pending.read();
+    return inputs;
 }
 
-template <int n>
-static int copy_to_ghdl(sc_bv<n> const& src, uint8_t* dst) {
-    for (int i = n - 1; i >= 0; i--) {
-        *dst = bit_to_ulogic(bool(src[i]));
-        dst++;
+void sim_wrapper::write_outputs(Outputs const& outputs) {
+    if (direct) {
+        direct_outputs = outputs;
+        return;
     }
-    return n;
+
+    o_imem_addr.write(outputs.imem_addr);
+    o_imem_ren.write(outputs.imem_ren);
+    o_dmem_addr.write(outputs.dmem_addr);
+    o_dmem_ren.write(outputs.dmem_ren);
+    o_dmem_wen.write(outputs.dmem_wen);
+    o_dmem_wdata.write(outputs.dmem_wdata);
+    o_dmem_byte_enable.write(outputs.dmem_byte_enable);
 }
 
-static int copy_to_ghdl(bool const& src, uint8_t* dst) {
-    *dst = bit_to_ulogic(src);
-    return 1;
+void sim_wrapper::copy_to_outbuffer(std::vector<uint32_t>& out_data) {
+    if (quantum > 1) {
+        copy_batch_to_outbuffer(out_data);
+        return;
+    }
+
+    Inputs inputs = read_inputs();
+    out_data[OUT_CONTROL] = input_control(inputs);
+    out_data[OUT_IMEM_RDATA] = inputs.imem_rdata;
+    out_data[OUT_DMEM_RDATA] = inputs.dmem_rdata;
 }
 
-void sim_wrapper::copy_to_outbuffer(std::vector<uint8_t>& out_data) {
-    uint8_t* out_ptr = out_data.data();
-    int written;
+// The first record holds the inputs for the current cycle. As long as reset and interrupt lines
+// are stable, further records predict a sequential instruction fetch without data memory access,
+// the GHDL side stops at the first record whose expected outputs do not match the core.
+void sim_wrapper::copy_batch_to_outbuffer(std::vector<uint32_t>& out_data) {
+    batch.clear();
+    batch.push_back(Record{outputs, read_inputs()});
+
+    if (predictor != nullptr && outputs.imem_ren) {
+        int limit = std::min(quantum - 1, predictor->stable_cycles(batch.back().inputs));
+        uint32_t address = outputs.imem_addr;
+        for (int i = 0; i < limit; i++) {
+            address += 4;
+
+            Record record;
+            record.expected = Outputs{address, true, 0, false, false, 0, 0};
+            record.inputs = batch.back().inputs;
+            if (!predictor->peek_imem(address, record.inputs.imem_rdata)) {
+                break;
+            }
+            batch.push_back(record);
+        }
+    }
 
-    written = copy_to_ghdl(i_eisV_rst_n.read(), out_ptr);
-    out_ptr += written;
+    out_data.assign(out_data.size(), 0);
+    out_data[0] = batch.size();
+    for (size_t i = 0; i < batch.size(); i++) {
+        Record const& record = batch[i];
+        uint32_t* words = &out_data[1 + LOOKAHEAD_RECORD_WORDS * i];
+        words[RECORD_EXPECTED_IMEM_ADDR] = record.expected.imem_addr;
+        words[RECORD_EXPECTED_CONTROL] = (record.expected.imem_ren << IN_CONTROL_IMEM_REN) |
+                                         (record.expected.dmem_ren << IN_CONTROL_DMEM_REN) |
+                                         (record.expected.dmem_wen << IN_CONTROL_DMEM_WEN);
+        words[RECORD_CONTROL] = input_control(record.inputs);
+        words[RECORD_IMEM_RDATA] = record.inputs.imem_rdata;
+        words[RECORD_DMEM_RDATA] = record.inputs.dmem_rdata;
+    }
+}
 
-    written = copy_to_ghdl(i_imem_rdata.read(), out_ptr);
-    out_ptr += written;
+void sim_wrapper::copy_from_inbuffer(std::vector<uint32_t> const& in_data) {
+    uint32_t const* value = in_data.data();
+    uint32_t const* invalid = value + (quantum > 1 ? LOOKAHEAD_IN_VALUE_WORDS : IN_VALUE_WORDS);
 
-    written = copy_to_ghdl(i_dmem_rdata.read(), out_ptr);
-    out_ptr += written;
+    if ((invalid[0] | invalid[1] | invalid[2] | invalid[3]) != 0) {
+        warn_invalid(invalid);
+    }
 
-    written = copy_to_ghdl(i_external_interrupt_pending.read(), out_ptr);
-    out_ptr += written;
+    uint32_t control = value[IN_CONTROL];
+
+    outputs.imem_addr = value[IN_IMEM_ADDR];
+    outputs.imem_ren = bit(control, IN_CONTROL_IMEM_REN);
+    outputs.dmem_addr = value[IN_DMEM_ADDR];
+    outputs.dmem_ren = bit(control, IN_CONTROL_DMEM_REN);
+    outputs.dmem_wen = bit(control, IN_CONTROL_DMEM_WEN);
+    outputs.dmem_wdata = value[IN_DMEM_WDATA];
+    outputs.dmem_byte_enable = control & IN_CONTROL_BYTE_ENABLE_MASK;
+
+    if (quantum > 1) {
+        consumed = value[IN_CONSUMED];
+        replayed = 0;
+        replay_cycle();
+        return;
+    }
 
-    written = copy_to_ghdl(i_timer_interrupt_pending.read(), out_ptr);
-    out_ptr += written;
+    write_outputs(outputs);
 }
 
-void sim_wrapper::copy_from_inbuffer(std::vector<uint8_t> const& in_data) {
-    uint8_t const* in_ptr = in_data.data();
-    int read;
-
-#define READ_TO_OUT(port)                      \
-    decltype(port)::data_type port##_buf;      \
-    read = copy_from_ghdl(in_ptr, port##_buf); \
-    in_ptr += read;                            \
-    port.write(port##_buf);
-
-    READ_TO_OUT(o_imem_addr)
-    READ_TO_OUT(o_imem_ren)
-    READ_TO_OUT(o_dmem_addr)
-    READ_TO_OUT(o_dmem_ren)
-    READ_TO_OUT(o_dmem_wen)
-    READ_TO_OUT(o_dmem_wdata)
-    READ_TO_OUT(o_dmem_byte_enable)
+// Presents the outputs of cycles the GHDL side simulated ahead. Signals the prediction did not
+// cover (dmem address, data and byte enable) show their value at the end of the batch.
+bool sim_wrapper::replay_cycle() {
+    if (replayed >= consumed) {
+        return false;
+    }
+
+    if (replayed > 0 && !(read_inputs() == batch[replayed].inputs)) {
+        printf("ERROR: Testbench diverged from lookahead prediction %d of %d\n", replayed,
+               consumed);
+        exit(1);
+    }
+    replayed++;
+
+    if (replayed < consumed) {
+        Outputs replay_outputs = outputs;
+        replay_outputs.imem_addr = batch[replayed].expected.imem_addr;
+        replay_outputs.imem_ren = batch[replayed].expected.imem_ren;
+        replay_outputs.dmem_ren = batch[replayed].expected.dmem_ren;
+        replay_outputs.dmem_wen = batch[replayed].expected.dmem_wen;
+        write_outputs(replay_outputs);
+    } else {
+        write_outputs(outputs);
+    }
+
+    return true;
 }
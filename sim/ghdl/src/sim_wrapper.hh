@@ -1,28 +1,120 @@
+#ifndef SIM_WRAPPER_HH
+#define SIM_WRAPPER_HH
+
 #include <systemc.h>
 
 #include "ghdl_module.hh"
 
+// The vector ports are native integers instead of the sc_bv of the QuestaSim interface generated
+// by scgenmod, which are slow to copy, compare and convert every cycle
 struct sim_wrapper : public GHDLModule {
     sc_in<bool> i_eisV_clk;
     sc_in<bool> i_eisV_rst_n;
-    sc_out<sc_bv<32>> o_imem_addr;
+    sc_out<uint32_t> o_imem_addr;
     sc_out<bool> o_imem_ren;
-    sc_in<sc_bv<32>> i_imem_rdata;
-    sc_out<sc_bv<32>> o_dmem_addr;
+    sc_in<uint32_t> i_imem_rdata;
+    sc_out<uint32_t> o_dmem_addr;
     sc_out<bool> o_dmem_ren;
-    sc_in<sc_bv<32>> i_dmem_rdata;
+    sc_in<uint32_t> i_dmem_rdata;
     sc_out<bool> o_dmem_wen;
-    sc_out<sc_bv<32>> o_dmem_wdata;
-    sc_out<sc_bv<4>> o_dmem_byte_enable;
+    sc_out<uint32_t> o_dmem_wdata;
+    sc_out<uint8_t> o_dmem_byte_enable;
     sc_in<bool> i_external_interrupt_pending;
     sc_in<bool> i_timer_interrupt_pending;
 
    public:
-    sim_wrapper(sc_module_name name, VHSocket vhsock) : GHDLModule(name, vhsock) {
+    // Packed buffer sizes in words: one value word per 32 signals, the input additionally carries
+    // one mask word per value word flagging bits that were neither '0' nor '1'
+    static constexpr int IN_VALUE_WORDS = 4;
+    static constexpr int IN_BUFFER_WORDS = 2 * IN_VALUE_WORDS;
+    static constexpr int OUT_BUFFER_WORDS = 3;
+
+    // Lookahead (quantum > 1): the input additionally carries the number of consumed cycles, the
+    // output carries a batch of up to quantum cycles
+    static constexpr int MAX_QUANTUM = 64;
+    static constexpr int LOOKAHEAD_IN_VALUE_WORDS = IN_VALUE_WORDS + 1;
+    static constexpr int LOOKAHEAD_IN_BUFFER_WORDS = 2 * LOOKAHEAD_IN_VALUE_WORDS;
+    static constexpr int LOOKAHEAD_RECORD_WORDS = 5;
+    static constexpr int lookahead_out_buffer_words(int quantum) {
+        return 1 + LOOKAHEAD_RECORD_WORDS * quantum;
+    }
+
+    struct Outputs {
+        uint32_t imem_addr;
+        bool imem_ren;
+        uint32_t dmem_addr;
+        bool dmem_ren;
+        bool dmem_wen;
+        uint32_t dmem_wdata;
+        uint8_t dmem_byte_enable;
+    };
+
+    struct Inputs {
+        bool rst_n;
+        uint32_t imem_rdata;
+        uint32_t dmem_rdata;
+        bool external_interrupt_pending;
+        bool timer_interrupt_pending;
+
+        bool operator==(Inputs const& other) const;
+    };
+
+    // Predicts the testbench for cycles ahead of SystemC time. The prediction has to be exact,
+    // the GHDL side can not roll back, but it only uses a predicted cycle after checking that the
+    // core behaved as assumed (sequential instruction fetch without data memory access).
+    class Predictor {
+       public:
+        // Number of following cycles for which reset and interrupt lines keep the value they have
+        // in inputs, the inputs of the current cycle
+        virtual int stable_cycles(Inputs const& inputs) = 0;
+        // Side effect free read of the word the testbench will return for an IMEM read
+        virtual bool peek_imem(uint32_t address, uint32_t& value_out) = 0;
+    };
+
+    // With direct the module neither has a thread nor uses its ports besides the clock, the
+    // testbench calls step() once per cycle instead
+    sim_wrapper(sc_module_name name, VHSocket vhsock, bool pin_level = true, int quantum = 1,
+                bool direct = false)
+        : GHDLModule(name, vhsock, pin_level && !direct), quantum(quantum), direct(direct) {
+        assert(quantum >= 1 && quantum <= MAX_QUANTUM);
         clk(i_eisV_clk);
     }
 
+    void set_predictor(Predictor* predictor);
+
+    // Direct mode: one cycle of the ports, returns the outputs the core answers to the inputs
+    // (the values the output ports would show until the next cycle)
+    Outputs const& step(Inputs const& inputs);
+
    protected:
-    void copy_to_outbuffer(std::vector<uint8_t>& out_data) override;
-    void copy_from_inbuffer(std::vector<uint8_t> const& in_data) override;
+    void copy_to_outbuffer(std::vector<uint32_t>& out_data) override;
+    void copy_from_inbuffer(std::vector<uint32_t> const& in_data) override;
+    bool replay_cycle() override;
+
+   private:
+    struct Record {
+        Outputs expected;
+        Inputs inputs;
+    };
+
+    Inputs read_inputs();
+    void write_outputs(Outputs const& outputs);
+    void copy_batch_to_outbuffer(std::vector<uint32_t>& out_data);
+
+    int quantum;
+    bool direct;
+    Predictor* predictor = nullptr;
+
+    // Port values in direct mode
+    Inputs direct_inputs{};
+    Outputs direct_outputs{};
+
+    // Last outputs received from the GHDL side
+    Outputs outputs{};
+    // Batch sent in the last exchange and the number of its cycles the GHDL side consumed
+    std::vector<Record> batch;
+    int consumed = 0;
+    int replayed = 0;
 };
+
+#endif
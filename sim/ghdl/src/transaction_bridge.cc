@@ -0,0 +1,184 @@
+#include "transaction_bridge.hh"
+
+#include <algorithm>
+
+// Commands (SystemC -> GHDL), word 0
+static constexpr uint32_t CMD_REGION = 1;
+static constexpr uint32_t CMD_DATA = 2;
+static constexpr uint32_t CMD_RUN = 3;
+static constexpr uint32_t CMD_CONTINUE = 4;
+static constexpr uint32_t CMD_STATE_READ = 5;
+static constexpr uint32_t CMD_STATE_WRITE = 6;
+
+// Messages (GHDL -> SystemC), word 0
+static constexpr uint32_t MSG_ACK = 1;
+static constexpr uint32_t MSG_WRITE_LOG = 2;
+static constexpr uint32_t MSG_SYNC = 3;
+static constexpr uint32_t MSG_STATE = 4;
+static constexpr uint32_t MSG_RETIRE_LOG = 5;
+
+static constexpr int DATA_HEADER_WORDS = 4;
+static constexpr int DATA_WORDS = TransactionBridge::WORDS - DATA_HEADER_WORDS;
+
+static constexpr int STATE_HEADER_WORDS = 3;
+static constexpr int STATE_WORDS = TransactionBridge::WORDS - STATE_HEADER_WORDS;
+
+static constexpr int RUN_CONTROL_RST_N = 2;
+static constexpr int RUN_CONTROL_EXTERNAL_INTERRUPT_PENDING = 1;
+static constexpr int RUN_CONTROL_TIMER_INTERRUPT_PENDING = 0;
+static constexpr int RUN_CONTROL_IMEM_RDATA_VALID = 8;
+static constexpr int RUN_CONTROL_DMEM_RDATA_VALID = 9;
+static constexpr int RUN_CONTROL_HALT = 10;
+
+static constexpr int SYNC_CONTROL_HALTED = 7;
+static constexpr int SYNC_CONTROL_IMEM_READ = 6;
+static constexpr int SYNC_CONTROL_DMEM_READ = 5;
+static constexpr int SYNC_CONTROL_DMEM_WRITE = 4;
+static constexpr uint32_t SYNC_CONTROL_BYTE_ENABLE_MASK = 0xf;
+
+static constexpr int RETIRE_WORDS = 4;
+static constexpr int RETIRE_CONTROL_VALID = 0;
+static constexpr int RETIRE_CONTROL_TRAP = 1;
+static constexpr int RETIRE_CONTROL_TRAP_RETURN = 2;
+static constexpr int RETIRE_CONTROL_RD = 8;
+static constexpr int RETIRE_CONTROL_BYTE_ENABLE = 16;
+
+static constexpr int MAX_REGIONS = 4;
+
+TransactionBridge::TransactionBridge(VHSocket vhsock, bool lockstep)
+    : vhsock(vhsock),
+      message_words(out_buffer_words(lockstep)),
+      out_buffer(out_buffer_words(lockstep)),
+      in_buffer(in_buffer_words(lockstep)) {}
+
+void TransactionBridge::exchange() {
+    vhsock.vhsend(out_buffer);
+    vhsock.vhrecv(in_buffer);
+}
+
+void TransactionBridge::add_region(uint32_t base, uint32_t const* data, size_t words) {
+    assert(region_count < MAX_REGIONS);
+
+    out_buffer.assign(message_words, 0);
+    out_buffer[0] = CMD_REGION;
+    out_buffer[1] = base;
+    out_buffer[2] = words;
+    exchange();
+    assert(in_buffer[0] == MSG_ACK);
+
+    // The mirror starts out zeroed, so only chunks with content have to be transferred
+    for (size_t offset = 0; offset < words; offset += DATA_WORDS) {
+        size_t count = std::min<size_t>(DATA_WORDS, words - offset);
+        uint32_t const* begin = data + offset;
+        if (std::all_of(begin, begin + count, [](uint32_t word) { return word == 0; })) {
+            continue;
+        }
+
+        out_buffer.assign(message_words, 0);
+        out_buffer[0] = CMD_DATA;
+        out_buffer[1] = region_count;
+        out_buffer[2] = offset;
+        out_buffer[3] = count;
+        std::copy(begin, begin + count, out_buffer.begin() + DATA_HEADER_WORDS);
+        exchange();
+        assert(in_buffer[0] == MSG_ACK);
+    }
+
+    region_count++;
+}
+
+TransactionBridge::Sync TransactionBridge::run(
+    Run const& run, std::function<void(uint32_t address, uint32_t value)> const& write_back,
+    std::function<void(Retire const& retire)> const& retire) {
+    out_buffer.assign(message_words, 0);
+    out_buffer[0] = CMD_RUN;
+    out_buffer[1] = (run.rst_n << RUN_CONTROL_RST_N) |
+                    (run.external_interrupt_pending << RUN_CONTROL_EXTERNAL_INTERRUPT_PENDING) |
+                    (run.timer_interrupt_pending << RUN_CONTROL_TIMER_INTERRUPT_PENDING) |
+                    (run.imem_rdata_valid << RUN_CONTROL_IMEM_RDATA_VALID) |
+                    (run.dmem_rdata_valid << RUN_CONTROL_DMEM_RDATA_VALID) |
+                    (run.halt << RUN_CONTROL_HALT);
+    out_buffer[2] = std::min(std::max(run.quantum, 1u), MAX_QUANTUM);
+    out_buffer[3] = run.imem_rdata;
+    out_buffer[4] = run.dmem_rdata;
+    exchange();
+
+    while (in_buffer[0] == MSG_WRITE_LOG || in_buffer[0] == MSG_RETIRE_LOG) {
+        uint32_t count = in_buffer[1];
+        if (in_buffer[0] == MSG_WRITE_LOG) {
+            for (uint32_t i = 0; i < count; i++) {
+                write_back(in_buffer[2 + 2 * i], in_buffer[3 + 2 * i]);
+            }
+        } else {
+            for (uint32_t i = 0; i < count && retire; i++) {
+                retire(decode_retire(&in_buffer[2 + RETIRE_WORDS * i]));
+            }
+        }
+
+        out_buffer.assign(message_words, 0);
+        out_buffer[0] = CMD_CONTINUE;
+        exchange();
+    }
+
+    assert(in_buffer[0] == MSG_SYNC);
+
+    uint32_t control = in_buffer[5];
+
+    Sync sync;
+    sync.elapsed = in_buffer[1];
+    sync.imem_read = (control >> SYNC_CONTROL_IMEM_READ) & 1;
+    sync.imem_addr = in_buffer[2];
+    sync.dmem_read = (control >> SYNC_CONTROL_DMEM_READ) & 1;
+    sync.dmem_write = (control >> SYNC_CONTROL_DMEM_WRITE) & 1;
+    sync.dmem_addr = in_buffer[3];
+    sync.dmem_wdata = in_buffer[4];
+    sync.dmem_byte_enable = control & SYNC_CONTROL_BYTE_ENABLE_MASK;
+    sync.halted = (control >> SYNC_CONTROL_HALTED) & 1;
+    return sync;
+}
+
+// Stores never write a register, so word 2 holds either the store address or the register value
+TransactionBridge::Retire TransactionBridge::decode_retire(uint32_t const* record) {
+    uint32_t control = record[0];
+    uint8_t byte_enable = (control >> RETIRE_CONTROL_BYTE_ENABLE) & 0xf;
+    return Retire{
+        .valid = ((control >> RETIRE_CONTROL_VALID) & 1) != 0,
+        .trap = ((control >> RETIRE_CONTROL_TRAP) & 1) != 0,
+        .trap_return = ((control >> RETIRE_CONTROL_TRAP_RETURN) & 1) != 0,
+        .pc = record[1],
+        .rd = static_cast<uint8_t>((control >> RETIRE_CONTROL_RD) & 0x1f),
+        .rd_value = byte_enable != 0 ? 0 : record[2],
+        .store_addr = byte_enable != 0 ? record[2] : 0,
+        .store_data = record[3],
+        .store_byte_enable = byte_enable,
+    };
+}
+
+void TransactionBridge::read_state(uint32_t first, uint32_t count, uint32_t* words_out) {
+    for (uint32_t offset = 0; offset < count; offset += STATE_WORDS) {
+        uint32_t chunk = std::min<uint32_t>(STATE_WORDS, count - offset);
+
+        out_buffer.assign(message_words, 0);
+        out_buffer[0] = CMD_STATE_READ;
+        out_buffer[1] = first + offset;
+        out_buffer[2] = chunk;
+        exchange();
+        assert(in_buffer[0] == MSG_STATE && in_buffer[1] == chunk);
+
+        std::copy(in_buffer.begin() + 2, in_buffer.begin() + 2 + chunk, words_out + offset);
+    }
+}
+
+void TransactionBridge::write_state(uint32_t first, uint32_t count, uint32_t const* words) {
+    for (uint32_t offset = 0; offset < count; offset += STATE_WORDS) {
+        uint32_t chunk = std::min<uint32_t>(STATE_WORDS, count - offset);
+
+        out_buffer.assign(message_words, 0);
+        out_buffer[0] = CMD_STATE_WRITE;
+        out_buffer[1] = first + offset;
+        out_buffer[2] = chunk;
+        std::copy(words + offset, words + offset + chunk, out_buffer.begin() + STATE_HEADER_WORDS);
+        exchange();
+        assert(in_buffer[0] == MSG_ACK);
+    }
+}
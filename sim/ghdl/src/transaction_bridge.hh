@@ -0,0 +1,93 @@
+#ifndef TRANSACTION_BRIDGE_HH
+#define TRANSACTION_BRIDGE_HH
+
+#include <functional>
+#include <vector>
+
+#include "ghdl_module.hh"
+
+// Transaction level connection to core_sim (TRANSACTION_LEVEL => true).
+//
+// Memories are mirrored into core_sim, which serves IMEM/DMEM accesses to them on its own. The
+// SystemC side is only contacted when the core accesses anything else, when a granted number of
+// cycles has passed or when core_sim has to flush its log of dirty mirror words.
+class TransactionBridge {
+   public:
+    // Message sizes in words, see core_sim.vhd for the layout. Lockstep mode (LOCKSTEP => true)
+    // uses larger messages to batch the retire log.
+    static constexpr int WORDS = 16;
+    static constexpr int LOCKSTEP_WORDS = 128;
+    static int in_buffer_words(bool lockstep) { return 2 * out_buffer_words(lockstep); }
+    static int out_buffer_words(bool lockstep) { return lockstep ? LOCKSTEP_WORDS : WORDS; }
+
+    // Core state at a synchronization point
+    struct Sync {
+        uint32_t elapsed;  // Cycles since the previous run()
+        bool imem_read;    // IMEM read that has to be served by the SystemC side
+        uint32_t imem_addr;
+        bool dmem_read;  // DMEM read that has to be served by the SystemC side
+        bool dmem_write;  // DMEM write that has to be served by the SystemC side
+        uint32_t dmem_addr;
+        uint32_t dmem_wdata;
+        uint8_t dmem_byte_enable;
+        bool halted;  // No instruction in flight, the state can be read (see Run::halt)
+    };
+
+    // Inputs applied to the core until the next synchronization point
+    struct Run {
+        bool rst_n;
+        bool external_interrupt_pending;
+        bool timer_interrupt_pending;
+        uint32_t quantum;  // Cycles after which core_sim synchronizes at the latest
+        bool imem_rdata_valid;
+        uint32_t imem_rdata;
+        bool dmem_rdata_valid;
+        uint32_t dmem_rdata;
+        bool halt;  // Stop issuing instructions and synchronize once the pipeline is drained
+    };
+
+    // Event of the retire port of eisv_core, only reported in lockstep mode
+    struct Retire {
+        bool valid;        // The instruction at pc completed
+        bool trap;         // The trap handler was entered, pc is mepc and rd_value mcause
+        bool trap_return;  // mret returned to pc
+        uint32_t pc;
+        uint8_t rd;  // 0 if no register is written
+        uint32_t rd_value;
+        uint32_t store_addr;  // Word address
+        uint32_t store_data;
+        uint8_t store_byte_enable;  // 0 if nothing is stored
+    };
+
+    static constexpr uint32_t MAX_QUANTUM = 1 << 30;
+
+    TransactionBridge(VHSocket vhsock, bool lockstep = false);
+
+    // Mirrors a memory starting at byte address base into core_sim, only allowed before run()
+    void add_region(uint32_t base, uint32_t const* data, size_t words);
+
+    // Lets the core run until the next synchronization point. Words written to mirrored memory are
+    // passed to write_back and, in lockstep mode, retire events in order to retire before run()
+    // returns.
+    Sync run(Run const& run,
+             std::function<void(uint32_t address, uint32_t value)> const& write_back,
+             std::function<void(Retire const& retire)> const& retire = nullptr);
+
+    // Architectural state words [first, first + count) in the order of the state port of
+    // eisv_core. Reading requires the last Sync to be halted, writing is only allowed before the
+    // first run(), which then starts from the written state instead of the reset state.
+    void read_state(uint32_t first, uint32_t count, uint32_t* words_out);
+    void write_state(uint32_t first, uint32_t count, uint32_t const* words);
+
+   private:
+    void exchange();
+    static Retire decode_retire(uint32_t const* record);
+
+    VHSocket vhsock;
+    int message_words;
+    std::vector<uint32_t> out_buffer;
+    std::vector<uint32_t> in_buffer;
+    int region_count = 0;
+};
+
+#endif
@@ -66,12 +66,19 @@ proc sim_compile {} {
   sim_compile_hdl
 
   eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/main.cc
+  eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/checkpoint.cc
   eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/device.cc
+  eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/elf_loader.cc
+  eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/iss.cc
   eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/system.cc
+  eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/testbench.cc
   eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/memory.cc
+  eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/sparse_memory.cc
   eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/stop_simulation_device.cc
   eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/timer_device.cc
   eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/uart_device.cc
+  eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/trace.cc
+  eval sccom -work testbench -I sim/questasim/eisv-mem-system sim/common/eisv-mem-system/wave_capture.cc
 
   eval sccom -link -work testbench
 
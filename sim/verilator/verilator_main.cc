@@ -0,0 +1,186 @@
+// Simulates eisv_core_wrapper as a Verilator model (translated to Verilog by ghdl-yosys-plugin)
+// with the same Testbench as the GHDL co-simulation, without SystemC and without a second process.
+
+#include <verilated.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "Veisv_core_wrapper.h"
+#include "profiler.h"
+#include "testbench.h"
+#include "trace.h"
+
+int main(int argc, char *argv[]) {
+    TestbenchPaths paths;
+    char const *profile_path = nullptr;
+    uint32_t profile_period = 1;
+    uint64_t max_cycles = 0;
+    WaveCaptureOptions wave_capture;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--isa=", 6) == 0) {
+            // Accepted for the same command line as eisv-mem-system, the model fixes the ISA
+        } else if (strncmp(argv[i], "--image=", 8) == 0) {
+            paths.image = argv[i] + 8;
+        } else if (strncmp(argv[i], "--uart-in=", 10) == 0) {
+            paths.uart_in = argv[i] + 10;
+        } else if (strncmp(argv[i], "--uart-out=", 11) == 0) {
+            paths.uart_out = argv[i] + 11;
+        } else if (strncmp(argv[i], "--dump=", 7) == 0) {
+            paths.dump = argv[i] + 7;
+        } else if (strncmp(argv[i], "--max-cycles=", 13) == 0) {
+            max_cycles = strtoull(argv[i] + 13, nullptr, 0);
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            profile_path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--profile-period=", 17) == 0) {
+            profile_period = strtoul(argv[i] + 17, nullptr, 0);
+            if (profile_period < 1) {
+                printf("Profile period has to be at least 1\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--wave-capture=", 15) == 0) {
+            wave_capture.path = argv[i] + 15;
+        } else if (strncmp(argv[i], "--wave-pc=", 10) == 0) {
+            wave_capture.pc = argv[i] + 10;
+        } else if (strncmp(argv[i], "--wave-window=", 14) == 0) {
+            if (!parse_wave_window(argv[i] + 14, wave_capture)) {
+                printf("Wave window has to be <first cycle>:<last cycle>\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--wave-pre=", 11) == 0) {
+            wave_capture.pre = strtoul(argv[i] + 11, nullptr, 0);
+        } else if (strncmp(argv[i], "--wave-post=", 12) == 0) {
+            wave_capture.post = strtoul(argv[i] + 12, nullptr, 0);
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            if (!Trace::parse_level(argv[i] + 8, Trace::level)) {
+                printf("Trace level has to be none, warn or access\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--trace-file=", 13) == 0) {
+            if (!Trace::open_binary(argv[i] + 13)) {
+                printf("Could not open trace file %s\n", argv[i] + 13);
+                return 1;
+            }
+        } else {
+            printf("Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Testbench tb(paths);
+    tb.acquire_dmi();
+
+    std::unique_ptr<Profiler> profiler;
+    if (profile_path) {
+        profiler = std::make_unique<Profiler>(tb.image, tb.rom_dmi, profile_period);
+    }
+
+    if (wave_capture.path) {
+        tb.start_wave_capture(wave_capture);
+    }
+
+    std::unique_ptr<VerilatedContext> context = std::make_unique<VerilatedContext>();
+    std::unique_ptr<Veisv_core_wrapper> core = std::make_unique<Veisv_core_wrapper>(context.get());
+    core->clk_i = 0;
+    core->rst_ni = 0;
+    core->imem_rdata_i = 0;
+    core->dmem_rdata_i = 0;
+    core->external_interrupt_pending_i = 0;
+    core->timer_interrupt_pending_i = 0;
+    core->state_halt_i = 0;
+    core->state_sel_i = 0;
+    core->state_wen_i = 0;
+    core->state_wdata_i = 0;
+    core->eval();
+    printf("[TB] Reset on\n");
+
+    // Same sequence as the pin level loop of main.cc: the testbench answers the outputs the core
+    // settled to in the previous cycle, then the core takes the rising edge with the inputs it
+    // already has and only afterwards sees the new ones, as core_sim applies them 1 ps after it
+    uint32_t imem_rdata = 0;
+    uint32_t dmem_rdata = 0;
+    uint64_t cycle = 0;
+    // The SystemC loop runs once more during initialization, before the first clock edge
+    tb.system.tick_all();
+    while (!*tb.stop_criterium) {
+        bool rst_n = cycle >= RESET_CYCLES;
+        if (cycle == RESET_CYCLES) {
+            printf("[TB] Reset off\n");
+        }
+
+        if (core->imem_ren_o) {
+            imem_rdata = tb.imem_read(core->imem_addr_o);
+        }
+
+        if (profiler && rst_n) {
+            profiler->fetch(core->imem_addr_o);
+        }
+
+        if (core->dmem_ren_o) {
+            dmem_rdata = tb.dmem_read(core->dmem_addr_o);
+        }
+
+        if (core->dmem_wen_o) {
+            tb.dmem_write(core->dmem_addr_o, core->dmem_wdata_o, core->dmem_byte_enable_o);
+        }
+
+        bool timer_interrupt_pending = *tb.timer_interrupt_pending_flag;
+
+        if (tb.wave) {
+            tb.wave->sample(WaveCapture::Sample{
+                .cycle = tb.system.get_cycle(),
+                .imem_addr = core->imem_addr_o,
+                .imem_rdata = imem_rdata,
+                .dmem_addr = core->dmem_addr_o,
+                .dmem_rdata = dmem_rdata,
+                .dmem_wdata = core->dmem_wdata_o,
+                .dmem_byte_enable = core->dmem_byte_enable_o,
+                .rst_n = rst_n,
+                .imem_ren = core->imem_ren_o != 0,
+                .dmem_ren = core->dmem_ren_o != 0,
+                .dmem_wen = core->dmem_wen_o != 0,
+                .external_interrupt_pending = false,
+                .timer_interrupt_pending = timer_interrupt_pending,
+            });
+        }
+
+        tb.system.tick_all();
+
+        core->clk_i = 1;
+        core->eval();
+
+        core->rst_ni = rst_n;
+        core->imem_rdata_i = imem_rdata;
+        core->dmem_rdata_i = dmem_rdata;
+        core->external_interrupt_pending_i = 0;
+        core->timer_interrupt_pending_i = timer_interrupt_pending;
+        core->clk_i = 0;
+        core->eval();
+
+        cycle++;
+        if (max_cycles != 0 && cycle >= max_cycles) {
+            printf("[TB] ERROR Program did not finish within %" PRIu64 " cycles\n", max_cycles);
+            break;
+        }
+    }
+    core->final();
+
+    bool finished = *tb.stop_criterium;
+    tb.print_results();
+    if (profiler) {
+        profiler->print_summary(5);
+        if (profiler->write(profile_path)) {
+            printf("[TB] Wrote profile to %s and %s.folded\n", profile_path, profile_path);
+        }
+    }
+    if (tb.wave) {
+        tb.wave->finish();
+    }
+    tb.dump_memory();
+
+    Trace::close();
+    return finished ? 0 : 1;
+}